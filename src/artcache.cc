@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2021, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2021, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -25,7 +25,9 @@
 
 #include <cstring>
 #include <algorithm>
+#include <functional>
 #include <dirent.h>
+#include <fcntl.h>
 
 #include "artcache.hh"
 #include "os.hh"
@@ -52,6 +54,14 @@ struct TraverseData
     {}
 
     virtual ~TraverseData() {}
+
+    /*!
+     * Reconstruct full hash from name found in two-level hash directory.
+     */
+    std::string hash_from_path(const char *path) const
+    {
+        return temp_path_.substr(temp_path_.length() - 2, 2) + path;
+    }
 };
 
 struct CountData: public TraverseData
@@ -309,27 +319,36 @@ static bool count_cached_hashes(std::string path, size_t &count)
     return true;
 }
 
-ArtCache::Object::Object(uint8_t priority, const std::string &hash,
-                         const uint8_t *objdata, size_t length):
-    priority_(priority),
-    hash_(hash)
+/*!
+ * Object data mapped directly from cache file.
+ *
+ * The mapping is released when the last reference to the data is dropped.
+ */
+class MappedObjectData: public ArtCache::ObjectData
 {
-    msg_log_assert(objdata != nullptr);
-    msg_log_assert(length > 0);
+  private:
+    struct os_mapped_file_data mapped_;
 
-    std::copy(objdata, objdata + length, std::back_inserter(data_));
-}
+  public:
+    explicit MappedObjectData(const struct os_mapped_file_data &mapped):
+        mapped_(mapped)
+    {
+        msg_log_assert(mapped_.ptr != nullptr);
+        msg_log_assert(mapped_.length > 0);
+    }
 
-ArtCache::Object::Object(uint8_t priority, std::string &&hash,
-                         const uint8_t *objdata, size_t length):
-    priority_(priority),
-    hash_(std::move(hash))
-{
-    msg_log_assert(objdata != nullptr);
-    msg_log_assert(length > 0);
+    ~MappedObjectData() override
+    {
+        os_unmap_file(&mapped_);
+    }
 
-    std::copy(objdata, objdata + length, std::back_inserter(data_));
-}
+    const uint8_t *data() const override
+    {
+        return static_cast<const uint8_t *>(mapped_.ptr);
+    }
+
+    size_t size() const override { return mapped_.length; }
+};
 
 void ArtCache::Statistics::dump(const char *what) const
 {
@@ -354,20 +373,69 @@ bool ArtCache::Timestamp::reset(const ArtCache::Path &path)
         return false;
     }
 
-    timestamps_[0].tv_sec = buf.st_atim.tv_sec;
-    timestamps_[0].tv_usec = buf.st_atim.tv_nsec / 1000;
+    usec_ = uint64_t(buf.st_atim.tv_sec) * USEC_PER_SEC + buf.st_atim.tv_nsec / 1000;
 
     return true;
 }
 
 bool ArtCache::Timestamp::set_access_time(const ArtCache::Path &path) const
 {
-    return os_path_utimes(path.str().c_str(), timestamps_);
+    return set_access_time(path.str(), usec_);
 }
 
 bool ArtCache::Timestamp::set_access_time(const std::string &path) const
 {
-    return os_path_utimes(path.c_str(), timestamps_);
+    return set_access_time(path, usec_);
+}
+
+bool ArtCache::Timestamp::set_access_time(const std::string &path, uint64_t usec)
+{
+    struct timeval timestamps[2] {};
+
+    timestamps[0].tv_sec = usec / USEC_PER_SEC;
+    timestamps[0].tv_usec = usec % USEC_PER_SEC;
+
+    return os_path_utimes(path.c_str(), timestamps);
+}
+
+static void record_access(std::unordered_map<std::string, uint64_t> &entries,
+                          const std::string &hash, uint64_t usec)
+{
+    auto &t(entries[hash]);
+
+    if(t < usec)
+        t = usec;
+}
+
+size_t ArtCache::AccessLog::record(const std::string &stream_key,
+                                   const std::string &source_hash,
+                                   const std::string &object_hash,
+                                   uint64_t usec)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    record_access(entries_.stream_keys_, stream_key, usec);
+    record_access(entries_.sources_, source_hash, usec);
+    record_access(entries_.objects_, object_hash, usec);
+
+    if(entries_.latest_ < usec)
+        entries_.latest_ = usec;
+
+    return entries_.size();
+}
+
+void ArtCache::AccessLog::take(Entries &dest)
+{
+    dest.clear();
+
+    std::lock_guard<std::mutex> lock(lock_);
+    std::swap(dest, entries_);
+}
+
+void ArtCache::AccessLog::clear()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    entries_.clear();
 }
 
 bool ArtCache::Manager::init()
@@ -395,7 +463,8 @@ bool ArtCache::Manager::init()
 
     if(!count_cached_hashes(cache_root_ + '/', keys) ||
        !count_cached_hashes(sources_path_.str(), sources) ||
-       !count_cached_hashes(objects_path_.str(), objects))
+       !count_cached_hashes(objects_path_.str(), objects) ||
+       !build_index())
         reset();
     else
         statistics_.set(keys, sources, objects);
@@ -425,6 +494,9 @@ void ArtCache::Manager::reset()
 {
     os_system_formatted(false, "rm -r '%s'", cache_root_.c_str());
     statistics_.reset();
+    index_.clear();
+    object_memory_cache_.clear();
+    access_log_.clear();
     timestamp_for_hot_path_.reset();
 }
 
@@ -622,8 +694,244 @@ static std::string get_stream_key_source_link(const ArtCache::Path &stream_key_d
     return link_name;
 }
 
+static bool parse_priority(const char *path, uint8_t &priority)
+{
+    unsigned int temp = 0;
+
+    for(char ch = *path++; ch != '\0'; ch = *path++)
+    {
+        if(ch < '0' || ch > '9')
+            return false;
+
+        temp *= 10;
+        temp += ch - '0';
+
+        if(temp > UINT8_MAX)
+            return false;
+    }
+
+    if(temp == 0)
+        return false;
+
+    priority = temp;
+
+    return true;
+}
+
+enum class IndexPart
+{
+    STREAMS,
+    SOURCES,
+    OBJECTS,
+};
+
+template <IndexPart IP>
+struct BuildIndexData: public TraverseData
+{
+    const std::string &cache_root_;
+    ArtCache::Index &index_;
+
+    explicit BuildIndexData(const std::string &root,
+                            const std::string &cache_root,
+                            ArtCache::Index &index):
+        TraverseData(root),
+        cache_root_(cache_root),
+        index_(index)
+    {}
+};
+
+struct IndexEntryData
+{
+    const std::string &cache_root_;
+    const std::string hash_;
+    ArtCache::Index &index_;
+
+    IndexEntryData(const IndexEntryData &) = delete;
+    IndexEntryData &operator=(const IndexEntryData &) = delete;
+
+    explicit IndexEntryData(const std::string &cache_root, std::string &&hash,
+                            ArtCache::Index &index):
+        cache_root_(cache_root),
+        hash_(std::move(hash)),
+        index_(index)
+    {}
+};
+
+static int index_stream_key_priority(const char *path, unsigned char dtype,
+                                     void *user_data)
+{
+    if(dtype != DT_DIR)
+        return 0;
+
+    uint8_t priority;
+
+    if(!parse_priority(path, priority))
+        return 0;
+
+    auto &data = *static_cast<IndexEntryData *>(user_data);
+
+    data.index_.add_key(data.hash_, priority);
+
+    const std::string source_hash(
+        get_stream_key_source_link(mk_stream_key_dirname(data.cache_root_,
+                                                         data.hash_, priority)));
+
+    if(!source_hash.empty())
+        data.index_.set_key_source(data.hash_, priority, source_hash);
+
+    return 0;
+}
+
+static int index_source_object(const char *path, unsigned char dtype,
+                               void *user_data)
+{
+    if(dtype != DT_REG)
+        return 0;
+
+    if((path == REFFILE_NAME))
+        return 0;
+
+    const char *sep = strchr(path, ':');
+
+    if(sep == nullptr || sep == path || !ArtCache::is_valid_hash(sep + 1))
+        return 0;
+
+    auto &data = *static_cast<IndexEntryData *>(user_data);
+
+    data.index_.set_source_object(data.hash_, std::string(path, sep - path),
+                                  sep + 1);
+
+    return 0;
+}
+
+template <>
+struct TraverseTraits<struct BuildIndexData<IndexPart::STREAMS>>
+{
+    using DT = struct BuildIndexData<IndexPart::STREAMS>;
+
+    static inline int traverse_sub_failed(DT &cd)
+    {
+        msg_error(errno, LOG_ALERT, "Failed indexing stream keys below %s",
+                  cd.temp_path_.c_str());
+        return -1;
+    }
+
+    static inline int traverse_found_hashdir(DT &cd, const char *path,
+                                             unsigned char dtype)
+    {
+        if(dtype != DT_DIR)
+            return 0;
+
+        const std::string p(cd.temp_path_ + '/' + path);
+        IndexEntryData data(cd.cache_root_, cd.hash_from_path(path), cd.index_);
+
+        os_foreach_in_path(p.c_str(), index_stream_key_priority, &data);
+
+        return 0;
+    }
+};
+
+template <>
+struct TraverseTraits<struct BuildIndexData<IndexPart::SOURCES>>
+{
+    using DT = struct BuildIndexData<IndexPart::SOURCES>;
+
+    static inline int traverse_sub_failed(DT &cd)
+    {
+        msg_error(errno, LOG_ALERT, "Failed indexing sources below %s",
+                  cd.temp_path_.c_str());
+        return -1;
+    }
+
+    static inline int traverse_found_hashdir(DT &cd, const char *path,
+                                             unsigned char dtype)
+    {
+        if(dtype != DT_DIR)
+            return 0;
+
+        const std::string p(cd.temp_path_ + '/' + path);
+        IndexEntryData data(cd.cache_root_, cd.hash_from_path(path), cd.index_);
+
+        cd.index_.add_source(data.hash_);
+        os_foreach_in_path(p.c_str(), index_source_object, &data);
+
+        return 0;
+    }
+};
+
+template <>
+struct TraverseTraits<struct BuildIndexData<IndexPart::OBJECTS>>
+{
+    using DT = struct BuildIndexData<IndexPart::OBJECTS>;
+
+    static inline int traverse_sub_failed(DT &cd)
+    {
+        msg_error(errno, LOG_ALERT, "Failed indexing objects below %s",
+                  cd.temp_path_.c_str());
+        return -1;
+    }
+
+    static inline int traverse_found_hashdir(DT &cd, const char *path,
+                                             unsigned char dtype)
+    {
+        if(dtype != DT_REG)
+            return 0;
+
+        const std::string p(cd.temp_path_ + '/' + path);
+
+        struct stat buf;
+
+        if(os_lstat(p.c_str(), &buf) < 0)
+            return 0;
+
+        cd.index_.add_object(cd.hash_from_path(path), buf.st_size);
+
+        return 0;
+    }
+};
+
+template <IndexPart IP>
+static bool build_index_part(const std::string &path,
+                             const std::string &cache_root,
+                             ArtCache::Index &index)
+{
+    BuildIndexData<IP> data(path, cache_root, index);
+
+    if(os_foreach_in_path(path.c_str(), traverse_top<decltype(data)>, &data) == 0)
+        return true;
+
+    msg_error(errno, LOG_ALERT, "Failed indexing cache below \"%s\"", path.c_str());
+
+    return false;
+}
+
+bool ArtCache::Manager::build_index()
+{
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
+
+    index_.clear();
+
+    if(build_index_part<IndexPart::STREAMS>(cache_root_ + '/', cache_root_, index_) &&
+       build_index_part<IndexPart::SOURCES>(sources_path_.str(), cache_root_, index_) &&
+       build_index_part<IndexPart::OBJECTS>(objects_path_.str(), cache_root_, index_))
+    {
+        msg_vinfo(MESSAGE_LEVEL_DIAG,
+                  "Index: %zu stream keys, %zu sources, %zu objects",
+                  index_.get_number_of_stream_keys(),
+                  index_.get_number_of_sources(),
+                  index_.get_number_of_objects());
+        return true;
+    }
+
+    index_.clear();
+
+    return false;
+}
+
 static ArtCache::AddKeyResult
 link_to_source(ArtCache::Path &stream_key_dirname,
+               const ArtCache::StreamPrioPair &stream_key,
+               ArtCache::Index &index,
                const ArtCache::Path &source_root,
                const std::string &source_hash,
                const ArtCache::AddKeyResult result_if_added)
@@ -652,6 +960,8 @@ link_to_source(ArtCache::Path &stream_key_dirname,
         ArtCache::Path temp(stream_key_dirname);
         temp.append_part(old_link_name, true);
         os_file_delete(temp.str().c_str());
+        index.set_key_source(stream_key.stream_key_, stream_key.priority_,
+                             std::string());
         result_on_success = ArtCache::AddKeyResult::REPLACED;
     }
 
@@ -659,17 +969,23 @@ link_to_source(ArtCache::Path &stream_key_dirname,
 
     auto const reffile(mk_source_reffile_name(source_root, source_hash));
 
-    return link(stream_key_dirname.str(), reffile.str(),
-                result_on_success,
-                ArtCache::AddKeyResult::DISK_FULL,
-                ArtCache::AddKeyResult::IO_ERROR);
+    const auto result(link(stream_key_dirname.str(), reffile.str(),
+                           result_on_success,
+                           ArtCache::AddKeyResult::DISK_FULL,
+                           ArtCache::AddKeyResult::IO_ERROR));
+
+    if(result == result_on_success)
+        index.set_key_source(stream_key.stream_key_, stream_key.priority_,
+                             source_hash);
+
+    return result;
 }
 
 ArtCache::AddKeyResult
 ArtCache::Manager::add_stream_key_for_source(const ArtCache::StreamPrioPair &stream_key,
                                              const std::string &source_hash)
 {
-    std::lock_guard<std::mutex> lock(lock_);
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
 
     const ArtCache::AddSourceResult src_result =
         mk_source_entry(sources_path_, source_hash, timestamp_for_hot_path_);
@@ -680,6 +996,7 @@ ArtCache::Manager::add_stream_key_for_source(const ArtCache::StreamPrioPair &str
       case AddSourceResult::INSERTED:
         have_new_source = true;
         statistics_.add_source();
+        index_.add_source(source_hash);
         break;
 
       case AddSourceResult::NOT_CHANGED:
@@ -711,10 +1028,32 @@ ArtCache::Manager::add_stream_key_for_source(const ArtCache::StreamPrioPair &str
     switch(key_result)
     {
       case AddKeyResult::NOT_CHANGED:
-        /* key exists already, so we need to keep it the way it is until the
-         * new source is filled in */
         if(have_new_source)
+        {
+            const auto old_source(get_stream_key_source_link(stream_key_dir));
+
+            /* key exists already, so we need to keep it the way it is until
+             * the new source is filled in---unless the key refers to another
+             * source which is not filled in yet either, in which case the
+             * key is moved over to the new source right now */
+            if(old_source.empty() || old_source == source_hash ||
+               !pending_.is_source_pending__unlocked(old_source, false))
+                break;
+
+            key_result = link_to_source(stream_key_dir, stream_key, index_,
+                                        sources_path_, source_hash,
+                                        AddKeyResult::SOURCE_UNKNOWN);
+
+            if(key_result != AddKeyResult::REPLACED)
+                return key_result;
+
+            msg_vinfo(MESSAGE_LEVEL_DEBUG,
+                      "Key %s[%u] superseded pending source %s by %s",
+                      stream_key.stream_key_.c_str(), stream_key.priority_,
+                      old_source.c_str(), source_hash.c_str());
+            pending_.notify_key_unlinked__unlocked(stream_key, old_source);
             break;
+        }
 
         /* key exists and refers to another queued source that is about to be
          * filled in, so the key should be associated with the queued job */
@@ -724,19 +1063,23 @@ ArtCache::Manager::add_stream_key_for_source(const ArtCache::StreamPrioPair &str
 
         /* key exists and refers to some completely known source, so we can
          * replace the existing link by the new one */
-        return link_to_source(stream_key_dir, sources_path_, source_hash,
+        return link_to_source(stream_key_dir, stream_key, index_,
+                              sources_path_, source_hash,
                               AddKeyResult::INSERTED);
 
       case AddKeyResult::INSERTED:
         /* key didn't exist, so we can link to source entry right now */
         statistics_.add_stream();
+        index_.add_key(stream_key.stream_key_, stream_key.priority_);
         gc__unlocked();
-        return link_to_source(stream_key_dir, sources_path_, source_hash,
+        return link_to_source(stream_key_dir, stream_key, index_,
+                              sources_path_, source_hash,
                               have_new_source ? AddKeyResult::SOURCE_UNKNOWN : AddKeyResult::INSERTED);
 
       case AddKeyResult::REPLACED:
       case AddKeyResult::SOURCE_PENDING:
       case AddKeyResult::SOURCE_UNKNOWN:
+      case AddKeyResult::QUEUE_FULL:
         MSG_BUG("%s(): unreachable", __func__);
         return AddKeyResult::IO_ERROR;
 
@@ -811,7 +1154,7 @@ static int find_link_for_format(const char *path, unsigned char dtype, void *use
 }
 
 static bool compute_file_content_hash(const std::string &fname,
-                                      std::string &hash_string)
+                                      std::string &hash_string, size_t &size)
 {
     struct os_mapped_file_data mapped;
 
@@ -820,6 +1163,7 @@ static bool compute_file_content_hash(const std::string &fname,
 
     ArtCache::Manager::Hash hash;
     ArtCache::compute_hash(hash, static_cast<const uint8_t *>(mapped.ptr), mapped.length);
+    size = mapped.length;
 
     os_unmap_file(&mapped);
 
@@ -831,15 +1175,18 @@ static bool compute_file_content_hash(const std::string &fname,
 static ArtCache::UpdateSourceResult
 move_objects_and_update_source(const std::vector<std::string> &import_objects,
                                const ArtCache::Path &objects_path,
+                               const std::string &source_hash,
                                const ArtCache::Path &source_path,
-                               ArtCache::Statistics &statistics)
+                               ArtCache::Statistics &statistics,
+                               ArtCache::Index &index)
 {
     bool added_objects = false;
 
     for(const auto &fname : import_objects)
     {
         std::string object_hash_string;
-        if(!compute_file_content_hash(fname, object_hash_string))
+        size_t object_size;
+        if(!compute_file_content_hash(fname, object_hash_string, object_size))
         {
             msg_error(0, LOG_ERR,
                       "Cannot import object \"%s\" (ignored)", fname.c_str());
@@ -853,6 +1200,7 @@ move_objects_and_update_source(const std::vector<std::string> &import_objects,
           case ArtCache::AddObjectResult::EXISTS:
             msg_vinfo(MESSAGE_LEVEL_DEBUG, "Already have object %s (%s)",
                       object_hash_string.c_str(), fname.c_str());
+            index.add_object(object_hash_string, object_size);
             break;
 
           case ArtCache::AddObjectResult::INSERTED:
@@ -860,6 +1208,7 @@ move_objects_and_update_source(const std::vector<std::string> &import_objects,
                       object_hash_string.c_str(), fname.c_str());
             added_objects = true;
             statistics.add_object();
+            index.add_object(object_hash_string, object_size);
             break;
 
           case ArtCache::AddObjectResult::IO_ERROR:
@@ -905,10 +1254,11 @@ move_objects_and_update_source(const std::vector<std::string> &import_objects,
             os_file_delete(find_data.found_.c_str());
         }
 
-        link(link_path.str(), object_name.str(),
-             ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY,
-             ArtCache::UpdateSourceResult::DISK_FULL,
-             ArtCache::UpdateSourceResult::IO_ERROR);
+        if(link(link_path.str(), object_name.str(),
+                ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY,
+                ArtCache::UpdateSourceResult::DISK_FULL,
+                ArtCache::UpdateSourceResult::IO_ERROR) == ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY)
+            index.set_source_object(source_hash, format_name, object_hash_string);
     }
 
     return added_objects
@@ -921,7 +1271,8 @@ link_pending_keys_to_source(std::vector<std::pair<ArtCache::StreamPrioPair, ArtC
                             const std::string &cache_root,
                             const ArtCache::Path &sources_path,
                             const std::string &source_hash,
-                            bool is_source_object_updated)
+                            bool is_source_object_updated,
+                            ArtCache::Index &index)
 {
     bool updated_keys = false;
 
@@ -939,7 +1290,8 @@ link_pending_keys_to_source(std::vector<std::pair<ArtCache::StreamPrioPair, ArtC
             continue;
         }
 
-        key.second = link_to_source(key_path, sources_path, source_hash,
+        key.second = link_to_source(key_path, key.first, index,
+                                    sources_path, source_hash,
                                     ArtCache::AddKeyResult::INSERTED);
 
         switch(key.second)
@@ -972,6 +1324,7 @@ link_pending_keys_to_source(std::vector<std::pair<ArtCache::StreamPrioPair, ArtC
           case ArtCache::AddKeyResult::INSERTED:
           case ArtCache::AddKeyResult::SOURCE_PENDING:
           case ArtCache::AddKeyResult::SOURCE_UNKNOWN:
+          case ArtCache::AddKeyResult::QUEUE_FULL:
             MSG_BUG("%s(): unreachable", __func__);
             return ArtCache::UpdateSourceResult::INTERNAL_ERROR;
         }
@@ -989,12 +1342,13 @@ ArtCache::Manager::update_source(const std::string &source_hash,
 {
     msg_log_assert(!source_hash.empty());
 
-    std::lock_guard<std::mutex> lock(lock_);
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
 
     const auto move_objects_result =
         move_objects_and_update_source(import_objects, objects_path_,
+                                       source_hash,
                                        mk_source_dir_name(sources_path_, source_hash),
-                                       statistics_);
+                                       statistics_, index_);
 
     if(move_objects_result != ArtCache::UpdateSourceResult::NOT_CHANGED &&
        move_objects_result != ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY)
@@ -1003,7 +1357,8 @@ ArtCache::Manager::update_source(const std::string &source_hash,
     const auto link_keys_result =
         link_pending_keys_to_source(pending_stream_keys, cache_root_,
                                     sources_path_, source_hash,
-                                    move_objects_result != ArtCache::UpdateSourceResult::NOT_CHANGED);
+                                    move_objects_result != ArtCache::UpdateSourceResult::NOT_CHANGED,
+                                    index_);
 
     if(link_keys_result != ArtCache::UpdateSourceResult::NOT_CHANGED &&
        link_keys_result != ArtCache::UpdateSourceResult::UPDATED_KEYS_ONLY)
@@ -1016,9 +1371,38 @@ ArtCache::Manager::update_source(const std::string &source_hash,
                : UpdateSourceResult::UPDATED_ALL));
 }
 
+bool ArtCache::Manager::link_keys_to_complete_source(const std::string &source_hash,
+                                                     std::vector<std::pair<StreamPrioPair, AddKeyResult>> &pending_stream_keys,
+                                                     UpdateSourceResult &result)
+{
+    msg_log_assert(!source_hash.empty());
+
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
+
+    const auto source_path(mk_source_dir_name(sources_path_, source_hash));
+    bool found = false;
+
+    {
+        OS::SuppressErrorsGuard suppress_errors;
+
+        if(os_foreach_in_path(source_path.str().c_str(),
+                              have_linked_outputs, &found) < 0)
+            return false;
+    }
+
+    if(!found)
+        return false;
+
+    result = link_pending_keys_to_source(pending_stream_keys, cache_root_,
+                                         sources_path_, source_hash,
+                                         false, index_);
+
+    return true;
+}
+
 void ArtCache::Manager::delete_key(const StreamPrioPair &stream_key)
 {
-    std::lock_guard<std::mutex> lock(lock_);
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
 
     const Path p(mk_stream_key_dirname(cache_root_, stream_key));
 
@@ -1037,7 +1421,10 @@ void ArtCache::Manager::delete_key(const StreamPrioPair &stream_key)
         Path temp(p);
         temp.append_part(linked_file, true);
         os_file_delete(temp.str().c_str());
+        index_.set_key_source(stream_key.stream_key_, stream_key.priority_,
+                              std::string());
         (void)delete_source(source_hash);
+        pending_.notify_key_deleted(stream_key, source_hash);
     }
 
     if(!os_rmdir(p.str().c_str(), true))
@@ -1048,6 +1435,7 @@ void ArtCache::Manager::delete_key(const StreamPrioPair &stream_key)
     }
 
     statistics_.remove_stream();
+    index_.remove_key(stream_key.stream_key_, stream_key.priority_);
 
     msg_vinfo(MESSAGE_LEVEL_DIAG, "Deleted key %s[%u]",
               stream_key.stream_key_.c_str(), stream_key.priority_);
@@ -1108,6 +1496,7 @@ bool ArtCache::Manager::delete_source(const std::string &source_hash)
     }
 
     statistics_.remove_source();
+    index_.remove_source(source_hash);
 
     msg_vinfo(MESSAGE_LEVEL_DIAG, "Deleted source %s", source_hash.c_str());
 
@@ -1131,17 +1520,15 @@ bool ArtCache::Manager::delete_object(const std::string &object_hash)
     }
 
     statistics_.remove_object();
+    index_.remove_object(object_hash);
+    object_memory_cache_.remove(object_hash);
 
     msg_vinfo(MESSAGE_LEVEL_DIAG, "Deleted object %s", object_hash.c_str());
 
     return true;
 }
 
-static ArtCache::LookupResult log_lookup(const ArtCache::LookupResult ret,
-                                         const std::string &stream_key,
-                                         uint8_t priority,
-                                         const std::string &object_hash,
-                                         const std::string &format)
+static const char *lookup_result_to_string(const ArtCache::LookupResult ret)
 {
     static constexpr const char *names_[] =
     {
@@ -1156,9 +1543,18 @@ static ArtCache::LookupResult log_lookup(const ArtCache::LookupResult ret,
     static_assert(sizeof(names_) / sizeof(names_[0]) == static_cast<size_t>(ArtCache::LookupResult::LAST_LOOKUP_RESULT) + 1U,
                   "Mismatch between lookup result enum and result strings");
 
-    const char *result_string = static_cast<size_t>(ret) < sizeof(names_) / sizeof(names_[0])
+    return static_cast<size_t>(ret) < sizeof(names_) / sizeof(names_[0])
         ? names_[static_cast<size_t>(ret)]
         : "***Invalid ArtCache::LookupResult code***";
+}
+
+static ArtCache::LookupResult log_lookup(const ArtCache::LookupResult ret,
+                                         const std::string &stream_key,
+                                         uint8_t priority,
+                                         const std::string &object_hash,
+                                         const std::string &format)
+{
+    const char *result_string = lookup_result_to_string(ret);
 
     if(object_hash.empty())
         msg_info("Lookup key %s prio %u format %s -> %s",
@@ -1180,7 +1576,7 @@ ArtCache::Manager::lookup(const ArtCache::StreamPrioPair &stream_key,
     msg_log_assert(!stream_key.stream_key_.empty());
     msg_log_assert(stream_key.priority_ > 0);
 
-    std::lock_guard<std::mutex> lock(lock_);
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
 
     return log_lookup(do_lookup(stream_key.stream_key_, stream_key.priority_,
                                 object_hash, format, obj),
@@ -1188,71 +1584,115 @@ ArtCache::Manager::lookup(const ArtCache::StreamPrioPair &stream_key,
                       object_hash, format);
 }
 
-static int find_highest(const char *path, unsigned char dtype, void *user_data)
+ArtCache::LookupResult
+ArtCache::Manager::lookup(const std::string &stream_key,
+                          const std::string &object_hash,
+                          const std::string &format,
+                          std::unique_ptr<Object> &obj) const
 {
-    if(dtype != DT_DIR)
-        return 0;
+    msg_log_assert(!stream_key.empty());
 
-    auto *prio = static_cast<uint8_t *>(user_data);
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
 
-    unsigned int temp = 0;
+    uint8_t prio;
+    const auto ret = do_lookup_highest(stream_key, object_hash, format, obj, prio);
 
-    for(char ch = *path++; ch != '\0'; ch = *path++)
-    {
-        if(ch < '0' || ch > '9')
-            return 0;
+    return log_lookup(ret, stream_key, prio, object_hash, format);
+}
 
-        temp *= 10;
-        temp += ch - '0';
+ArtCache::LookupResult
+ArtCache::Manager::lookup_fd(const std::string &stream_key,
+                             const std::string &object_hash,
+                             const std::string &format,
+                             std::unique_ptr<Object> &obj, int &fd) const
+{
+    msg_log_assert(!stream_key.empty());
 
-        if(temp > UINT8_MAX)
-            return 0;
-    }
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
 
-    if(temp > *prio)
-        *prio = temp;
+    uint8_t prio;
+    const auto ret = do_lookup_highest(stream_key, object_hash, format, obj,
+                                       prio, &fd);
 
-    return 0;
+    return log_lookup(ret, stream_key, prio, object_hash, format);
 }
 
-static uint8_t find_highest_priority(const std::string &cache_root,
-                                     const std::string &stream_key,
-                                     ArtCache::LookupResult &result_on_fail)
+size_t ArtCache::Manager::lookup(std::vector<LookupRequest> &requests) const
 {
-    ArtCache::Path p(cache_root);
-    p.append_hash(stream_key);
+    size_t found = 0;
 
-    uint8_t prio = 0;
+    {
+        std::shared_lock<std::shared_timed_mutex> lock(lock_);
 
-    OS::SuppressErrorsGuard suppress_errors;
+        for(auto &req : requests)
+        {
+            msg_log_assert(!req.stream_key_.empty());
 
-    if(os_foreach_in_path(p.str().c_str(), find_highest, &prio) < 0)
-        result_on_fail = ArtCache::LookupResult::IO_ERROR;
-    else
-        result_on_fail = ArtCache::LookupResult::KEY_UNKNOWN;
+            req.result_ = do_lookup_highest(req.stream_key_, req.object_hash_,
+                                            req.format_, req.obj_,
+                                            req.priority_);
+
+            msg_vinfo(MESSAGE_LEVEL_DIAG, "Lookup key %s prio %u format %s -> %s",
+                      req.stream_key_.c_str(), req.priority_,
+                      req.format_.c_str(), lookup_result_to_string(req.result_));
+
+            if(req.result_ == LookupResult::FOUND)
+                ++found;
+        }
+    }
+
+    msg_info("Lookup of %zu keys -> %zu found", requests.size(), found);
 
-    return prio;
+    return found;
 }
 
 ArtCache::LookupResult
-ArtCache::Manager::lookup(const std::string &stream_key,
-                          const std::string &object_hash,
-                          const std::string &format,
-                          std::unique_ptr<Object> &obj) const
+ArtCache::Manager::do_lookup_highest(const std::string &stream_key,
+                                     const std::string &object_hash,
+                                     const std::string &format,
+                                     std::unique_ptr<ArtCache::Object> &obj,
+                                     uint8_t &priority, int *fd) const
 {
-    msg_log_assert(!stream_key.empty());
+    if(fd != nullptr)
+        *fd = -1;
 
-    std::lock_guard<std::mutex> lock(lock_);
+    const auto *prios(index_.find_priorities(stream_key));
+
+    priority = (prios != nullptr) ? prios->highest() : 0;
 
-    ArtCache::LookupResult result;
-    const uint8_t prio =
-        find_highest_priority(cache_root_, stream_key, result);
+    if(priority == 0)
+    {
+        obj = nullptr;
+        return pending_.is_stream_key_pending(stream_key, 0)
+            ? LookupResult::PENDING
+            : LookupResult::KEY_UNKNOWN;
+    }
 
-    const auto ret = (prio > 0)
-        ? do_lookup(stream_key, prio, object_hash, format, obj)
-        : result;
+    const auto result = do_lookup(stream_key, priority, object_hash, format,
+                                  obj, fd);
 
-    return log_lookup(ret, stream_key, prio, object_hash, format);
+    if(result != LookupResult::PENDING)
+        return result;
+
+    /* while the image of highest priority is being processed, return the best
+     * image we already have */
+    for(uint8_t prio = prios->next_lower(priority);
+        prio > 0;
+        prio = prios->next_lower(prio))
+    {
+        if(do_lookup(stream_key, prio, object_hash, format, obj, fd) == LookupResult::FOUND)
+        {
+            msg_vinfo(MESSAGE_LEVEL_DIAG,
+                      "Key %s prio %u pending, falling back to prio %u",
+                      stream_key.c_str(), priority, prio);
+            priority = prio;
+            return LookupResult::FOUND;
+        }
+    }
+
+    obj = nullptr;
+
+    return LookupResult::PENDING;
 }
 
 void ArtCache::Manager::mark_hot_path(const std::string &stream_key,
@@ -1261,106 +1701,130 @@ void ArtCache::Manager::mark_hot_path(const std::string &stream_key,
 {
     timestamp_for_hot_path_.increment();
 
-    {
-        timestamp_for_hot_path_.set_access_time(objects_path_);
-
-        ArtCache::Path p(objects_path_);
-        p.append_hash(object_hash, true);
-        timestamp_for_hot_path_.set_access_time(p);
-    }
+    if(access_log_.record(stream_key, source_hash, object_hash,
+                          timestamp_for_hot_path_.get()) >= ACCESS_LOG_FLUSH_THRESHOLD)
+        background_task_.flush_access_log();
+}
 
-    {
-        ArtCache::Path p(cache_root_);
-        p.append_hash(stream_key);
-        timestamp_for_hot_path_.set_access_time(p);
-    }
+/*!
+ * Check if source is still being processed, and if so, tell the queue that a
+ * client is waiting for it.
+ */
+static bool is_pending_and_demanded(ArtCache::PendingIface &pending,
+                                    const std::string &source_hash)
+{
+    if(!pending.is_source_pending(source_hash))
+        return false;
 
-    {
-        const ArtCache::Path p(mk_source_reffile_name(sources_path_, source_hash));
-        timestamp_for_hot_path_.set_access_time(p);
-    }
+    pending.promote_pending_source(source_hash);
+    return true;
 }
 
 ArtCache::LookupResult
 ArtCache::Manager::do_lookup(const std::string &stream_key, uint8_t priority,
                              const std::string &object_hash,
                              const std::string &format,
-                             std::unique_ptr<ArtCache::Object> &obj) const
+                             std::unique_ptr<ArtCache::Object> &obj,
+                             int *fd) const
 {
     obj = nullptr;
 
-    const Path p(mk_stream_key_dirname(cache_root_, stream_key, priority));
-    if(!p.exists())
-        return LookupResult::KEY_UNKNOWN;
+    if(fd != nullptr)
+        *fd = -1;
+
+    const std::string *const source_hash(index_.find_source_for_key(stream_key, priority));
+    if(source_hash == nullptr)
+        return pending_.is_stream_key_pending(stream_key, priority)
+            ? LookupResult::PENDING
+            : LookupResult::KEY_UNKNOWN;
 
-    const std::string source_hash(get_stream_key_source_link(p));
-    if(source_hash.empty())
+    if(source_hash->empty())
         return LookupResult::ORPHANED;
 
-    Path src(mk_source_dir_name(sources_path_, source_hash));
-    if(!src.exists())
-        return pending_.is_source_pending(source_hash, false)
+    if(index_.find_source(*source_hash) == nullptr)
+        return is_pending_and_demanded(pending_, *source_hash)
             ? LookupResult::PENDING
             : LookupResult::ORPHANED;
 
-    if(!object_hash.empty())
+    const std::string *const found_object(index_.find_object_for_format(*source_hash, format));
+    if(found_object == nullptr)
+        return is_pending_and_demanded(pending_, *source_hash)
+            ? LookupResult::PENDING
+            : LookupResult::FORMAT_NOT_SUPPORTED;
+
+    if(!object_hash.empty() && *found_object == object_hash)
     {
         /* caller has provided a hint that he knows the data for the given
          * object hash, so don't read anything from file if the object hasn't
          * changed */
-        Path temp(src);
-        temp.append_part(std::string(format) + ':' + object_hash, true);
+        msg_vinfo(MESSAGE_LEVEL_DIAG,
+                  "Object has not changed for key %s prio %u format %s",
+                  stream_key.c_str(), priority, format.c_str());
 
-        if(temp.exists())
-        {
-            msg_vinfo(MESSAGE_LEVEL_DIAG,
-                      "Object has not changed for key %s prio %u format %s",
-                      stream_key.c_str(), priority, format.c_str());
-
-            obj = std::make_unique<ArtCache::Object>(priority, object_hash);
-
-            if(obj != nullptr)
-            {
-                mark_hot_path(stream_key, source_hash, obj->hash_);
-                statistics_.mark_for_gc();
-            }
+        obj = std::make_unique<ArtCache::Object>(priority, object_hash);
 
-            return LookupResult::FOUND;
+        if(obj != nullptr)
+        {
+            mark_hot_path(stream_key, *source_hash, obj->hash_);
+            statistics_.mark_for_gc();
         }
+
+        return LookupResult::FOUND;
     }
 
+    msg_vinfo(MESSAGE_LEVEL_DIAG,
+              "Returning object %s for key %s prio %u format %s%s",
+              found_object->c_str(), stream_key.c_str(), priority,
+              format.c_str(), fd != nullptr ? " as file descriptor" : "");
 
-    struct FindFormatLinkData find_data { format };
-    if(os_foreach_in_path(src.str().c_str(),
-                          find_link_for_format, &find_data) < 0)
-        return LookupResult::IO_ERROR;
+    if(fd != nullptr)
+    {
+        Path objfile(objects_path_);
+        objfile.append_hash(*found_object, true);
 
-    if(find_data.found_.empty())
-        return pending_.is_source_pending(source_hash, false)
-            ? LookupResult::PENDING
-            : LookupResult::FORMAT_NOT_SUPPORTED;
+        *fd = open(objfile.str().c_str(), O_RDONLY | O_CLOEXEC);
 
-    msg_vinfo(MESSAGE_LEVEL_DIAG,
-              "Returning %s for key %s prio %u format %s",
-              find_data.found_.c_str(), stream_key.c_str(), priority,
-              format.c_str());
+        if(*fd < 0)
+        {
+            msg_error(errno, LOG_ERR,
+                      "Failed opening object \"%s\"", objfile.str().c_str());
+            return LookupResult::IO_ERROR;
+        }
 
-    src.append_part(find_data.found_, true);
+        obj = std::make_unique<ArtCache::Object>(priority, *found_object);
+    }
+    else
+    {
+        auto objdata(object_memory_cache_.lookup(*found_object));
 
-    struct os_mapped_file_data mapped;
-    if(os_map_file_to_memory(&mapped, src.str().c_str()) < 0)
-        return LookupResult::IO_ERROR;
+        if(objdata == nullptr)
+        {
+            Path objfile(objects_path_);
+            objfile.append_hash(*found_object, true);
 
-    obj = std::make_unique<ArtCache::Object>(
-            priority,
-            find_data.found_.substr(format.length() + 1, std::string::npos),
-            static_cast<const uint8_t *>(mapped.ptr), mapped.length);
+            struct os_mapped_file_data mapped;
+            if(os_map_file_to_memory(&mapped, objfile.str().c_str()) < 0)
+                return LookupResult::IO_ERROR;
 
-    os_unmap_file(&mapped);
+            if(object_memory_cache_.is_cacheable(mapped.length))
+            {
+                objdata = std::make_shared<ArtCache::BufferedObjectData>(
+                                static_cast<const uint8_t *>(mapped.ptr),
+                                mapped.length);
+                os_unmap_file(&mapped);
+                object_memory_cache_.insert(*found_object, objdata);
+            }
+            else
+                objdata = std::make_shared<MappedObjectData>(mapped);
+        }
+
+        obj = std::make_unique<ArtCache::Object>(priority, *found_object,
+                                                 std::move(objdata));
+    }
 
     if(obj != nullptr)
     {
-        mark_hot_path(stream_key, source_hash, obj->hash_);
+        mark_hot_path(stream_key, *source_hash, obj->hash_);
         statistics_.mark_for_gc();
     }
 
@@ -1548,16 +2012,20 @@ struct DecimateCacheEntriesData: public TraverseData
 
     struct timespec oldest_remaining_;
 
-    std::mutex &manager_lock_;
+    std::shared_timed_mutex &manager_lock_;
     DeletedCounts &deleted_;
     ArtCache::Statistics &statistics_;
+    ArtCache::Index &index_;
+    ArtCache::ObjectMemoryCache &object_memory_cache_;
 
     explicit DecimateCacheEntriesData(const std::string &root,
                                       CollectMinMaxTimestampsData &cd,
                                       const struct timespec &threshold,
                                       DeletedCounts &deleted,
                                       ArtCache::Statistics &statistics,
-                                      std::mutex &manager_lock):
+                                      ArtCache::Index &index,
+                                      ArtCache::ObjectMemoryCache &object_memory_cache,
+                                      std::shared_timed_mutex &manager_lock):
         TraverseData(root),
         cd_(cd),
         threshold_(threshold),
@@ -1565,7 +2033,9 @@ struct DecimateCacheEntriesData: public TraverseData
                            std::numeric_limits<decltype(timespec::tv_nsec)>::max() },
         manager_lock_(manager_lock),
         deleted_(deleted),
-        statistics_(statistics)
+        statistics_(statistics),
+        index_(index),
+        object_memory_cache_(object_memory_cache)
     {}
 
     explicit DecimateCacheEntriesData(std::string &&root,
@@ -1573,7 +2043,9 @@ struct DecimateCacheEntriesData: public TraverseData
                                       const struct timespec &threshold,
                                       DeletedCounts &deleted,
                                       ArtCache::Statistics &statistics,
-                                      std::mutex &manager_lock):
+                                      ArtCache::Index &index,
+                                      ArtCache::ObjectMemoryCache &object_memory_cache,
+                                      std::shared_timed_mutex &manager_lock):
         TraverseData(std::move(root)),
         cd_(cd),
         threshold_(threshold),
@@ -1581,7 +2053,9 @@ struct DecimateCacheEntriesData: public TraverseData
                            std::numeric_limits<decltype(timespec::tv_nsec)>::max() },
         manager_lock_(manager_lock),
         deleted_(deleted),
-        statistics_(statistics)
+        statistics_(statistics),
+        index_(index),
+        object_memory_cache_(object_memory_cache)
     {}
 };
 
@@ -1600,7 +2074,7 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::STREAMS>>
 
         const std::string p(cd.temp_path_ + '/' + path);
 
-        std::lock_guard<std::mutex> lock(cd.manager_lock_);
+        std::lock_guard<std::shared_timed_mutex> lock(cd.manager_lock_);
 
         struct stat buf;
         if(os_lstat(p.c_str(), &buf) < 0)
@@ -1620,6 +2094,7 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::STREAMS>>
 
             ++cd.deleted_.streams_;
             cd.statistics_.remove_stream(true);
+            cd.index_.remove_stream_key(cd.hash_from_path(path));
         }
 
         return 0;
@@ -1644,7 +2119,7 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::SOURCES>>
         ArtCache::Path ref(p);
         ref.append_part(REFFILE_NAME, true);
 
-        std::lock_guard<std::mutex> lock(cd.manager_lock_);
+        std::lock_guard<std::shared_timed_mutex> lock(cd.manager_lock_);
 
         struct stat buf;
 
@@ -1663,6 +2138,7 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::SOURCES>>
 
             ++cd.deleted_.sources_;
             cd.statistics_.remove_source(true);
+            cd.index_.remove_source(cd.hash_from_path(path));
         }
 
         return 0;
@@ -1684,7 +2160,7 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::OBJECTS>>
 
         const std::string p(cd.temp_path_ + '/' + path);
 
-        std::lock_guard<std::mutex> lock(cd.manager_lock_);
+        std::lock_guard<std::shared_timed_mutex> lock(cd.manager_lock_);
 
         struct stat buf;
 
@@ -1703,6 +2179,9 @@ struct TraverseTraits<struct DecimateCacheEntriesData<DecimateType::OBJECTS>>
 
             ++cd.deleted_.objects_;
             cd.statistics_.remove_object(true);
+            const std::string object_hash(cd.hash_from_path(path));
+            cd.index_.remove_object(object_hash);
+            cd.object_memory_cache_.remove(object_hash);
         }
 
         return 0;
@@ -1713,14 +2192,17 @@ template <DecimateType DT>
 static void decimate(CollectMinMaxTimestampsData &cd,
                      const struct timespec &threshold,
                      DeletedCounts &deleted_counts,
-                     ArtCache::Statistics &statistics, const std::string &path,
-                     std::mutex &manager_lock)
+                     ArtCache::Statistics &statistics,
+                     ArtCache::Index &index,
+                     ArtCache::ObjectMemoryCache &object_memory_cache,
+                     const std::string &path,
+                     std::shared_timed_mutex &manager_lock)
 {
     cd.temp_path_.resize(cd.temp_path_original_len_);
 
     DecimateCacheEntriesData<DT> data(cd.temp_path_, cd, threshold,
-                                      deleted_counts, statistics,
-                                      manager_lock);
+                                      deleted_counts, statistics, index,
+                                      object_memory_cache, manager_lock);
 
     if(os_foreach_in_path(path.c_str(), traverse_top<decltype(data)>, &data) == 0 &&
        data.oldest_remaining_.tv_sec < std::numeric_limits<decltype(timespec::tv_sec)>::max())
@@ -1763,7 +2245,13 @@ static void delete_empty_middle_directories(const ArtCache::Path &path)
 
 ArtCache::GCResult ArtCache::Manager::do_gc()
 {
-    std::unique_lock<std::mutex> lock(lock_);
+    /* GC decisions are based on access times, so they must be up-to-date */
+    do_flush_access_log();
+
+    /* cache traversal only needs a shared lock, so lookups can proceed
+     * while statistics are collected; entries are removed under exclusive
+     * lock, one at a time */
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
 
     bool need_new_statistics = true;
 
@@ -1827,20 +2315,24 @@ ArtCache::GCResult ArtCache::Manager::do_gc()
 
         /* keep this order for most effective decimation */
         decimate<DecimateType::STREAMS>(streams_minmax, streams_threshold,
-                                        deleted_counts, statistics_,
+                                        deleted_counts, statistics_, index_,
+                                        object_memory_cache_,
                                         cache_root_, lock_);
         decimate<DecimateType::SOURCES>(sources_minmax, sources_threshold,
-                                        deleted_counts, statistics_,
+                                        deleted_counts, statistics_, index_,
+                                        object_memory_cache_,
                                         sources_path_.str(), lock_);
         decimate<DecimateType::OBJECTS>(objects_minmax, objects_threshold,
-                                        deleted_counts, statistics_,
+                                        deleted_counts, statistics_, index_,
+                                        object_memory_cache_,
                                         objects_path_.str(), lock_);
 
-        lock.lock();
-        delete_empty_middle_directories(Path(cache_root_));
-        delete_empty_middle_directories(sources_path_);
-        delete_empty_middle_directories(objects_path_);
-        lock.unlock();
+        {
+            std::lock_guard<std::shared_timed_mutex> xlock(lock_);
+            delete_empty_middle_directories(Path(cache_root_));
+            delete_empty_middle_directories(sources_path_);
+            delete_empty_middle_directories(objects_path_);
+        }
 
         if(deleted_counts.streams_ > 0 || deleted_counts.sources_ > 0 || deleted_counts.objects_ > 0)
         {
@@ -1861,7 +2353,10 @@ ArtCache::GCResult ArtCache::Manager::do_gc()
     while(fail_rounds_left >= 0 && statistics_.exceeds_limits(lower_limits_));
 
     if(removed_anything)
+    {
         statistics_.dump("Cache statistics after garbage collection");
+        object_memory_cache_.dump("Object memory cache");
+    }
 
     return removed_anything ? GCResult::DEFLATED : GCResult::NOT_POSSIBLE;
 }
@@ -1939,11 +2434,79 @@ static void reset_timestamps(const std::string &path,
     failure_count += rd.failure_count_;
 }
 
+static void flush_access_times(const std::unordered_map<std::string, uint64_t> &entries,
+                               const std::function<ArtCache::Path(const std::string &)> &mk_path,
+                               size_t &success_count, size_t &failure_count)
+{
+    for(const auto &e : entries)
+    {
+        if(ArtCache::Timestamp::set_access_time(mk_path(e.first).str(), e.second))
+            ++success_count;
+        else
+            ++failure_count;
+    }
+}
+
+void ArtCache::Manager::do_flush_access_log()
+{
+    AccessLog::Entries entries;
+    access_log_.take(entries);
+
+    if(entries.size() == 0)
+        return;
+
+    /* shared lock is sufficient: we are not changing the cache structure, but
+     * need to keep entries from being deleted while we are touching them */
+    std::shared_lock<std::shared_timed_mutex> lock(lock_);
+
+    size_t success_count = 0;
+    size_t failure_count = 0;
+
+    {
+        /* entries may have been removed since they have been accessed */
+        OS::SuppressErrorsGuard suppress_errors;
+
+        flush_access_times(entries.stream_keys_,
+                           [this] (const std::string &hash)
+                           {
+                               Path p(cache_root_);
+                               p.append_hash(hash);
+                               return p;
+                           },
+                           success_count, failure_count);
+        flush_access_times(entries.sources_,
+                           [this] (const std::string &hash)
+                           {
+                               return mk_source_reffile_name(sources_path_, hash);
+                           },
+                           success_count, failure_count);
+        flush_access_times(entries.objects_,
+                           [this] (const std::string &hash)
+                           {
+                               Path p(objects_path_);
+                               p.append_hash(hash, true);
+                               return p;
+                           },
+                           success_count, failure_count);
+
+        /* timestamp on objects directory is used as start value for the hot
+         * path timestamp on next startup */
+        Timestamp::set_access_time(objects_path_.str(), entries.latest_);
+    }
+
+    msg_vinfo(MESSAGE_LEVEL_DIAG,
+              "Flushed access log (%zu set, %zu failed)",
+              success_count, failure_count);
+}
+
 void ArtCache::Manager::do_reset_all_timestamps()
 {
     msg_info("Resetting all timestamps");
 
-    std::lock_guard<std::mutex> lock(lock_);
+    std::lock_guard<std::shared_timed_mutex> lock(lock_);
+
+    /* all timestamps are going to be equal, recorded accesses are irrelevant */
+    access_log_.clear();
 
     timestamp_for_hot_path_.reset();
     timestamp_for_hot_path_.set_access_time(objects_path_);
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2021, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2021, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -23,13 +23,18 @@
 #define ARTCACHE_HH
 
 #include <mutex>
+#include <shared_mutex>
+#include <atomic>
 #include <condition_variable>
 #include <thread>
 #include <deque>
+#include <unordered_map>
 #include <memory>
 
 #include "cachetypes.hh"
 #include "cachepath.hh"
+#include "cacheindex.hh"
+#include "objectcache.hh"
 #include "pending.hh"
 #include "md5.hh"
 #include "messages.h"
@@ -103,7 +108,8 @@ class Statistics
     size_t number_of_sources_;
     size_t number_of_objects_;
 
-    bool changed_;
+    /*! Set by lookups, so it may be changed while holding a shared lock. */
+    std::atomic<bool> changed_;
 
   public:
     Statistics(const Statistics &) = delete;
@@ -126,7 +132,7 @@ class Statistics
     {}
 
     explicit Statistics(const Statistics &src, uint8_t percentage):
-        changed_(src.changed_)
+        changed_(src.changed_.load())
     {
         if(percentage > 100)
             percentage = 100;
@@ -153,15 +159,7 @@ class Statistics
         changed_ = true;
     }
 
-    bool mark_unchanged()
-    {
-        if(!changed_)
-            return false;
-
-        changed_ = false;
-
-        return true;
-    }
+    bool mark_unchanged() { return changed_.exchange(false); }
 
     void mark_for_gc() { changed_ = true; }
 
@@ -205,22 +203,28 @@ class Statistics
 class Timestamp
 {
   private:
-    struct timeval timestamps_[2];
-    bool overflown_;
+    static constexpr uint64_t USEC_PER_SEC = 1000UL * 1000UL;
+
+    /*!
+     * Access time in microseconds.
+     *
+     * Atomic so that lookups can increment it while holding a shared lock.
+     */
+    std::atomic<uint64_t> usec_;
+    std::atomic<bool> overflown_;
 
   public:
     Timestamp(const Timestamp &) = delete;
     Timestamp &operator=(const Timestamp &) = delete;
 
     explicit Timestamp():
-        timestamps_{},
+        usec_(0),
         overflown_(false)
     {}
 
     void reset()
     {
-        timestamps_[0].tv_sec = 0;
-        timestamps_[0].tv_usec = 0;
+        usec_ = 0;
         overflown_ = false;
     }
 
@@ -228,31 +232,91 @@ class Timestamp
 
     bool increment()
     {
-        struct timeval &access_time(timestamps_[0]);
-
         if(overflown_)
             return false;
 
-        if(++access_time.tv_usec < 1000L * 1000L)
-            return true;
+        const uint64_t usec = ++usec_;
 
-        access_time.tv_usec = 0;
+        if(usec / USEC_PER_SEC <= uint64_t(std::numeric_limits<long>::max()))
+            return true;
 
-        if(access_time.tv_sec < std::numeric_limits<long>::max())
-            ++access_time.tv_sec;
-        else if(!overflown_)
-        {
+        if(!overflown_.exchange(true))
             msg_info("TIMESTAMP OVERFLOW");
-            overflown_ = true;
-        }
 
-        return !overflown_;
+        return false;
     }
 
     bool is_overflown() const { return overflown_; }
 
+    uint64_t get() const { return usec_; }
+
     bool set_access_time(const Path &path) const;
     bool set_access_time(const std::string &path) const;
+
+    static bool set_access_time(const std::string &path, uint64_t usec);
+};
+
+/*!
+ * Cache entries accessed by lookups, not yet written to file system.
+ *
+ * Lookups only record which entries have been accessed at which time. The
+ * access times are written to file system in batches by the
+ * #ArtCache::BackgroundTask, so that the read path does not cause any
+ * metadata writes. Repeated accesses of the same entry between two flushes
+ * are coalesced into a single update.
+ */
+class AccessLog
+{
+  public:
+    struct Entries
+    {
+        std::unordered_map<std::string, uint64_t> stream_keys_;
+        std::unordered_map<std::string, uint64_t> sources_;
+        std::unordered_map<std::string, uint64_t> objects_;
+        uint64_t latest_;
+
+        explicit Entries(): latest_(0) {}
+
+        void clear()
+        {
+            stream_keys_.clear();
+            sources_.clear();
+            objects_.clear();
+            latest_ = 0;
+        }
+
+        size_t size() const
+        {
+            return stream_keys_.size() + sources_.size() + objects_.size();
+        }
+    };
+
+  private:
+    std::mutex lock_;
+    Entries entries_;
+
+  public:
+    AccessLog(const AccessLog &) = delete;
+    AccessLog &operator=(const AccessLog &) = delete;
+
+    explicit AccessLog() {}
+
+    /*!
+     * Record access of a stream key, its source, and an object.
+     *
+     * \returns
+     *     The number of distinct entries in the log.
+     */
+    size_t record(const std::string &stream_key,
+                  const std::string &source_hash,
+                  const std::string &object_hash, uint64_t usec);
+
+    /*!
+     * Move all entries to \p dest, leaving the log empty.
+     */
+    void take(Entries &dest);
+
+    void clear();
 };
 
 class Manager;
@@ -265,6 +329,7 @@ class BackgroundTask
         SHUTDOWN,
         RESET_TIMESTAMPS,
         GC,
+        FLUSH_ACCESS_LOG,
     };
 
     std::thread th_;
@@ -290,12 +355,43 @@ class BackgroundTask
 
     bool garbage_collection() { return append_action(Action::GC); }
     bool reset_all_timestamps() { return append_action(Action::RESET_TIMESTAMPS); }
+    bool flush_access_log() { return append_action(Action::FLUSH_ACCESS_LOG); }
 
   private:
     void task_main();
     bool append_action(Action action);
 };
 
+/*!
+ * Single lookup in a batch of lookups.
+ *
+ * Stream key, object hash, and format are filled in by the caller, the
+ * remaining fields are filled in by #ArtCache::Manager::lookup().
+ */
+struct LookupRequest
+{
+    const std::string stream_key_;
+    const std::string object_hash_;
+    const std::string format_;
+
+    LookupResult result_;
+    uint8_t priority_;
+    std::unique_ptr<Object> obj_;
+
+    LookupRequest(const LookupRequest &) = delete;
+    LookupRequest(LookupRequest &&) = default;
+    LookupRequest &operator=(const LookupRequest &) = delete;
+
+    explicit LookupRequest(std::string &&stream_key, std::string &&object_hash,
+                           std::string &&format):
+        stream_key_(std::move(stream_key)),
+        object_hash_(std::move(object_hash)),
+        format_(std::move(format)),
+        result_(LookupResult::KEY_UNKNOWN),
+        priority_(0)
+    {}
+};
+
 class Manager
 {
   public:
@@ -303,13 +399,22 @@ class Manager
 
     static constexpr uint8_t LIMITS_LOW_HI_PERCENTAGE = 60;
 
+    /*! Flush access log when it contains this many entries. */
+    static constexpr size_t ACCESS_LOG_FLUSH_THRESHOLD = 256;
+
   private:
-    mutable std::mutex lock_;
+    /*!
+     * Lookups take this lock shared, all modifications take it exclusive.
+     */
+    mutable std::shared_timed_mutex lock_;
 
     const std::string cache_root_;
     const Path sources_path_;
     const Path objects_path_;
 
+    Index index_;
+    mutable ObjectMemoryCache object_memory_cache_;
+
     mutable Statistics statistics_;
     const Statistics &upper_limits_;
     const Statistics lower_limits_;
@@ -317,17 +422,32 @@ class Manager
     PendingIface &pending_;
 
     mutable Timestamp timestamp_for_hot_path_;
+    mutable AccessLog access_log_;
     mutable BackgroundTask background_task_;
 
   public:
     Manager(const Manager &) = delete;
     Manager &operator=(const Manager &) = delete;
 
+    /*!
+     * Constructor.
+     *
+     * \param cache_root
+     *     Path to the cache on file system.
+     * \param upper_limits
+     *     Garbage collection kicks in when any of these limits is exceeded.
+     * \param pending
+     *     Interface for querying pending conversions.
+     * \param object_memory_budget
+     *     Maximum number of bytes of recently used objects to keep in RAM.
+     *     Pass 0 to always read objects from file system.
+     */
     explicit Manager(const char *cache_root, const Statistics &upper_limits,
-                     PendingIface &pending):
+                     PendingIface &pending, size_t object_memory_budget):
         cache_root_(cache_root),
         sources_path_(cache_root_ + "/.src"),
         objects_path_(cache_root_ + "/.obj"),
+        object_memory_cache_(object_memory_budget),
         upper_limits_(upper_limits),
         lower_limits_(upper_limits_, LIMITS_LOW_HI_PERCENTAGE),
         pending_(pending),
@@ -378,6 +498,27 @@ class Manager
                                      std::vector<std::string> &&import_objects,
                                      std::vector<std::pair<StreamPrioPair, AddKeyResult>> &pending_stream_keys);
 
+    /*!
+     * Associate pending keys with a source which has been converted already.
+     *
+     * This is for downloads which turn out to have the same content as a
+     * source stored in cache, so that they need not be converted again.
+     *
+     * \param source_hash
+     *     Content hash of the downloaded data.
+     * \param pending_stream_keys
+     *     Stream key/priority pairs to be updated to point to the source.
+     * \param[out] result
+     *     Outcome of updating the keys.
+     *
+     * \returns
+     *     False if the source is not in cache or not filled in yet, in which
+     *     case \p pending_stream_keys are left untouched.
+     */
+    bool link_keys_to_complete_source(const std::string &source_hash,
+                                      std::vector<std::pair<StreamPrioPair, AddKeyResult>> &pending_stream_keys,
+                                      UpdateSourceResult &result);
+
     /*!
      * Remove key/prio pair, remove source if it would be left unreferenced.
      *
@@ -399,15 +540,47 @@ class Manager
                         const std::string &format,
                         std::unique_ptr<Object> &obj) const;
 
+    /*!
+     * Look up stream key, return object file instead of object data.
+     *
+     * \param stream_key, object_hash, format
+     *     See #ArtCache::Manager::lookup().
+     * \param obj
+     *     The object found for the stream key. It never contains any data.
+     * \param[out] fd
+     *     A read-only file descriptor of the object file, owned by the
+     *     caller. It is -1 if the lookup failed, or if \p object_hash refers
+     *     to the object found, meaning that the caller has the object
+     *     already.
+     */
+    LookupResult lookup_fd(const std::string &stream_key,
+                           const std::string &object_hash,
+                           const std::string &format,
+                           std::unique_ptr<Object> &obj, int &fd) const;
+
+    /*!
+     * Look up many stream keys at once.
+     *
+     * Each stream key is looked up for its highest priority, just like the
+     * single key lookup does. The lock is taken only once for the whole
+     * batch.
+     *
+     * \returns
+     *     The number of lookups which returned #ArtCache::LookupResult::FOUND.
+     */
+    size_t lookup(std::vector<LookupRequest> &requests) const;
+
     GCResult gc()
     {
-        std::lock_guard<std::mutex> lock(lock_);
+        std::lock_guard<std::shared_timed_mutex> lock(lock_);
         return gc__unlocked();
     }
 
   private:
     GCResult gc__unlocked();
 
+    bool build_index();
+
     static int delete_unreferenced_objects(const char *path, unsigned char dtype,
                                            void *user_data);
 
@@ -436,10 +609,17 @@ class Manager
      */
     bool delete_object(const std::string &object_hash);
 
+    LookupResult do_lookup_highest(const std::string &stream_key,
+                                   const std::string &object_hash,
+                                   const std::string &format,
+                                   std::unique_ptr<Object> &obj,
+                                   uint8_t &priority, int *fd = nullptr) const;
+
     LookupResult do_lookup(const std::string &stream_key, uint8_t priority,
                            const std::string &object_hash,
                            const std::string &format,
-                           std::unique_ptr<Object> &obj) const;
+                           std::unique_ptr<Object> &obj,
+                           int *fd = nullptr) const;
 
     void mark_hot_path(const std::string &stream_key,
                        const std::string &source_hash,
@@ -449,6 +629,7 @@ class Manager
 
     GCResult do_gc();
     void do_reset_all_timestamps();
+    void do_flush_access_log();
 
   public:
     struct BackgroundActions
@@ -456,6 +637,7 @@ class Manager
       private:
         static GCResult gc(Manager &manager) { return manager.do_gc(); }
         static void reset_all_timestamps(Manager &manager) { manager.do_reset_all_timestamps(); }
+        static void flush_access_log(Manager &manager) { manager.do_flush_access_log(); }
 
         friend class BackgroundTask;
     };
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -24,10 +24,16 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <algorithm>
+#include <chrono>
 
 #include "artcache.hh"
 #include "messages.h"
 
+/*!
+ * Interval for writing recorded access times to file system.
+ */
+static constexpr auto access_log_flush_interval(std::chrono::seconds(60));
+
 void ArtCache::BackgroundTask::task_main()
 {
     while(true)
@@ -41,7 +47,14 @@ void ArtCache::BackgroundTask::task_main()
             lock.lock();
         }
 
-        have_work_.wait(lock, [this] { return !pending_actions_.empty(); });
+        if(!have_work_.wait_for(lock, access_log_flush_interval,
+                                [this] { return !pending_actions_.empty(); }))
+        {
+            /* nothing else to do for a while, write recorded access times */
+            lock.unlock();
+            Manager::BackgroundActions::flush_access_log(manager_);
+            continue;
+        }
 
         const auto current_action(pending_actions_.front());
         pending_actions_.pop_front();
@@ -51,6 +64,7 @@ void ArtCache::BackgroundTask::task_main()
         switch(current_action)
         {
           case Action::SHUTDOWN:
+            Manager::BackgroundActions::flush_access_log(manager_);
             all_work_done_.notify_all();
             return;
 
@@ -61,6 +75,10 @@ void ArtCache::BackgroundTask::task_main()
           case Action::RESET_TIMESTAMPS:
             Manager::BackgroundActions::reset_all_timestamps(manager_);
             break;
+
+          case Action::FLUSH_ACCESS_LOG:
+            Manager::BackgroundActions::flush_access_log(manager_);
+            break;
         }
     }
 }
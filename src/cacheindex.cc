@@ -0,0 +1,154 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "cacheindex.hh"
+
+void ArtCache::Index::clear()
+{
+    keys_.clear();
+    sources_.clear();
+    objects_.clear();
+}
+
+void ArtCache::Index::add_key(const std::string &stream_key, uint8_t priority)
+{
+    auto &key(keys_[stream_key]);
+    key.sources_.emplace(priority, std::string());
+    key.priorities_.set(priority);
+}
+
+void ArtCache::Index::set_key_source(const std::string &stream_key,
+                                     uint8_t priority,
+                                     const std::string &source_hash)
+{
+    auto &key(keys_[stream_key]);
+    key.sources_[priority] = source_hash;
+    key.priorities_.set(priority);
+}
+
+void ArtCache::Index::remove_key(const std::string &stream_key, uint8_t priority)
+{
+    auto it(keys_.find(stream_key));
+
+    if(it == keys_.end())
+        return;
+
+    it->second.sources_.erase(priority);
+    it->second.priorities_.clear(priority);
+
+    if(it->second.sources_.empty())
+        keys_.erase(it);
+}
+
+void ArtCache::Index::remove_stream_key(const std::string &stream_key)
+{
+    keys_.erase(stream_key);
+}
+
+void ArtCache::Index::add_source(const std::string &source_hash)
+{
+    sources_[source_hash].clear();
+}
+
+void ArtCache::Index::set_source_object(const std::string &source_hash,
+                                        const std::string &format,
+                                        const std::string &object_hash)
+{
+    sources_[source_hash][format] = object_hash;
+}
+
+void ArtCache::Index::remove_source(const std::string &source_hash)
+{
+    sources_.erase(source_hash);
+}
+
+void ArtCache::Index::add_object(const std::string &object_hash, size_t size)
+{
+    objects_[object_hash] = size;
+}
+
+void ArtCache::Index::remove_object(const std::string &object_hash)
+{
+    objects_.erase(object_hash);
+}
+
+const ArtCache::Index::Priorities *
+ArtCache::Index::find_key(const std::string &stream_key) const
+{
+    const auto it(keys_.find(stream_key));
+    return it != keys_.end() ? &it->second.sources_ : nullptr;
+}
+
+const ArtCache::PriorityBitmap *
+ArtCache::Index::find_priorities(const std::string &stream_key) const
+{
+    const auto it(keys_.find(stream_key));
+    return it != keys_.end() ? &it->second.priorities_ : nullptr;
+}
+
+const std::string *
+ArtCache::Index::find_source_for_key(const std::string &stream_key,
+                                     uint8_t priority) const
+{
+    const auto *prios(find_key(stream_key));
+
+    if(prios == nullptr)
+        return nullptr;
+
+    const auto it(prios->find(priority));
+    return it != prios->end() ? &it->second : nullptr;
+}
+
+const ArtCache::Index::Formats *
+ArtCache::Index::find_source(const std::string &source_hash) const
+{
+    const auto it(sources_.find(source_hash));
+    return it != sources_.end() ? &it->second : nullptr;
+}
+
+const std::string *
+ArtCache::Index::find_object_for_format(const std::string &source_hash,
+                                        const std::string &format) const
+{
+    const auto *formats(find_source(source_hash));
+
+    if(formats == nullptr)
+        return nullptr;
+
+    const auto it(formats->find(format));
+    return it != formats->end() ? &it->second : nullptr;
+}
+
+bool ArtCache::Index::get_object_size(const std::string &object_hash,
+                                      size_t &size) const
+{
+    const auto it(objects_.find(object_hash));
+
+    if(it == objects_.end())
+        return false;
+
+    size = it->second;
+    return true;
+}
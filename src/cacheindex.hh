@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef CACHEINDEX_HH
+#define CACHEINDEX_HH
+
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <cstdint>
+
+/*!
+ * \addtogroup cache
+ */
+/*!@{*/
+
+namespace ArtCache
+{
+
+/*!
+ * Set of priorities of a stream key.
+ *
+ * Priorities are in range 1 through 255, priority 0 is used to indicate
+ * absence of any priority.
+ */
+class PriorityBitmap
+{
+  private:
+    uint64_t words_[4];
+
+  public:
+    explicit PriorityBitmap(): words_{} {}
+
+    void set(uint8_t priority) { words_[priority / 64] |= bit(priority); }
+    void clear(uint8_t priority) { words_[priority / 64] &= ~bit(priority); }
+    bool test(uint8_t priority) const { return (words_[priority / 64] & bit(priority)) != 0; }
+
+    bool empty() const
+    {
+        return (words_[0] | words_[1] | words_[2] | words_[3]) == 0;
+    }
+
+    /*!
+     * Highest priority in set, or 0 if the set is empty.
+     */
+    uint8_t highest() const { return highest_in_words(4); }
+
+    /*!
+     * Highest priority in set lower than \p priority, or 0 if there is none.
+     */
+    uint8_t next_lower(uint8_t priority) const
+    {
+        const unsigned int idx = priority / 64;
+        const uint64_t below = words_[idx] & (bit(priority) - 1);
+
+        if(below != 0)
+            return idx * 64 + highest_bit(below);
+
+        return highest_in_words(idx);
+    }
+
+  private:
+    static uint64_t bit(uint8_t priority) { return uint64_t(1) << (priority % 64); }
+
+    static unsigned int highest_bit(uint64_t word)
+    {
+        return 63 - __builtin_clzll(word);
+    }
+
+    uint8_t highest_in_words(unsigned int count) const
+    {
+        while(count-- > 0)
+        {
+            if(words_[count] != 0)
+                return count * 64 + highest_bit(words_[count]);
+        }
+
+        return 0;
+    }
+};
+
+/*!
+ * In-memory mirror of the cache structure stored on file system.
+ *
+ * The index reflects the mappings from stream key and priority to source,
+ * from source and format to object, and from object to its size. It allows
+ * answering lookups without enumerating any directories. The file system
+ * remains the authoritative storage; the index is built from it on startup
+ * and must be updated along with any change made to the file system.
+ *
+ * \note
+ *     This class is not thread-safe. It is protected by the lock of the
+ *     #ArtCache::Manager which owns it.
+ */
+class Index
+{
+  public:
+    /*! Map of format name to object hash. */
+    using Formats = std::map<std::string, std::string>;
+
+    /*! Map of priority to source hash (empty if not linked to any source). */
+    using Priorities = std::map<uint8_t, std::string>;
+
+  private:
+    struct KeyEntry
+    {
+        Priorities sources_;
+        PriorityBitmap priorities_;
+    };
+
+    std::unordered_map<std::string, KeyEntry> keys_;
+    std::unordered_map<std::string, Formats> sources_;
+    std::unordered_map<std::string, size_t> objects_;
+
+  public:
+    Index(const Index &) = delete;
+    Index &operator=(const Index &) = delete;
+
+    explicit Index() {}
+
+    void clear();
+
+    void add_key(const std::string &stream_key, uint8_t priority);
+    void set_key_source(const std::string &stream_key, uint8_t priority,
+                        const std::string &source_hash);
+    void remove_key(const std::string &stream_key, uint8_t priority);
+    void remove_stream_key(const std::string &stream_key);
+
+    void add_source(const std::string &source_hash);
+    void set_source_object(const std::string &source_hash,
+                           const std::string &format,
+                           const std::string &object_hash);
+    void remove_source(const std::string &source_hash);
+
+    void add_object(const std::string &object_hash, size_t size);
+    void remove_object(const std::string &object_hash);
+
+    const Priorities *find_key(const std::string &stream_key) const;
+    const PriorityBitmap *find_priorities(const std::string &stream_key) const;
+    const std::string *find_source_for_key(const std::string &stream_key,
+                                           uint8_t priority) const;
+    const Formats *find_source(const std::string &source_hash) const;
+    const std::string *find_object_for_format(const std::string &source_hash,
+                                              const std::string &format) const;
+    bool get_object_size(const std::string &object_hash, size_t &size) const;
+
+    size_t get_number_of_stream_keys() const { return keys_.size(); }
+    size_t get_number_of_sources() const     { return sources_.size(); }
+    size_t get_number_of_objects() const     { return objects_.size(); }
+};
+
+}
+
+/*!@}*/
+
+#endif /* !CACHEINDEX_HH */
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -23,7 +23,8 @@
 #define CACHETYPES_HH
 
 #include <string>
-#include <vector>
+#include <memory>
+#include <cstdint>
 
 /*!
  * \addtogroup cache
@@ -54,6 +55,28 @@ struct StreamPrioPair
     {}
 };
 
+/*!
+ * Read-only view of the data of a cached object.
+ *
+ * Implementations keep the object data accessible for their whole lifetime.
+ * Instances are shared among users of the data via \c std::shared_ptr, so
+ * that object data can be passed on without copying it.
+ */
+class ObjectData
+{
+  protected:
+    explicit ObjectData() {}
+
+  public:
+    ObjectData(const ObjectData &) = delete;
+    ObjectData &operator=(const ObjectData &) = delete;
+
+    virtual ~ObjectData() {}
+
+    virtual const uint8_t *data() const = 0;
+    virtual size_t size() const = 0;
+};
+
 class Object
 {
   public:
@@ -61,7 +84,7 @@ class Object
     const std::string hash_;
 
   private:
-    std::vector<uint8_t> data_;
+    std::shared_ptr<const ObjectData> data_;
 
   public:
     Object(const Object &) = delete;
@@ -77,12 +100,30 @@ class Object
     {}
 
     explicit Object(uint8_t priority, const std::string &hash,
-                    const uint8_t *objdata, size_t length);
+                    std::shared_ptr<const ObjectData> &&objdata):
+        priority_(priority),
+        hash_(hash),
+        data_(std::move(objdata))
+    {}
 
     explicit Object(uint8_t priority, std::string &&hash,
-                    const uint8_t *objdata, size_t length);
+                    std::shared_ptr<const ObjectData> &&objdata):
+        priority_(priority),
+        hash_(std::move(hash)),
+        data_(std::move(objdata))
+    {}
 
-    const std::vector<uint8_t> data() const { return data_; }
+    bool empty() const { return data_ == nullptr || data_->size() == 0; }
+    const uint8_t *data() const { return data_ != nullptr ? data_->data() : nullptr; }
+    size_t size() const { return data_ != nullptr ? data_->size() : 0; }
+
+    /*!
+     * Get another reference to the object data.
+     *
+     * The returned pointer keeps the data alive even after this object has
+     * been destroyed.
+     */
+    std::shared_ptr<const ObjectData> share_data() const { return data_; }
 };
 
 }
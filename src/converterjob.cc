@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -23,9 +23,16 @@
 #include <config.h>
 #endif /* HAVE_CONFIG_H */
 
-#include <sstream>
+#include <algorithm>
+#include <cerrno>
+#include <sys/stat.h>
 
 #include "converterqueue.hh"
+#include "imageconvert.hh"
+#include "quantize.hh"
+#include "spawnhelper.hh"
+#include "stagedfile.hh"
+#include "md5.hh"
 #include "os.hh"
 #include "messages.h"
 
@@ -35,67 +42,96 @@ Converter::Job::State Converter::Job::get_state() const
     return state_;
 }
 
-void Converter::Job::add_pending_key(const ArtCache::StreamPrioPair &sp)
+bool Converter::Job::get_next_stage(Stage &stage) const
 {
     std::lock_guard<std::mutex> lock(lock_);
 
     switch(state_)
     {
       case State::DOWNLOAD_IDLE:
-      case State::DOWNLOADING_AND_CONVERTING:
-      case State::CONVERT_IDLE:
-      case State::CONVERTING:
+        stage = Stage::FETCH;
+        return true;
+
+      case State::DECODE_IDLE:
+        stage = Stage::DECODE;
+        return true;
+
+      case State::ENCODE_IDLE:
+        stage = Stage::ENCODE;
+        return true;
+
+      case State::IMPORT_IDLE:
+        stage = Stage::IMPORT;
+        return true;
+
+      case State::DOWNLOADING:
+      case State::DECODING:
+      case State::ENCODING:
+      case State::IMPORTING:
+      case State::DONE_OK:
+      case State::DONE_ERROR:
+        break;
+    }
+
+    return false;
+}
+
+bool Converter::Job::add_pending_key(const ArtCache::StreamPrioPair &sp)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    switch(state_)
+    {
+      case State::DOWNLOAD_IDLE:
+      case State::DOWNLOADING:
+      case State::DECODE_IDLE:
+      case State::DECODING:
+      case State::ENCODE_IDLE:
+      case State::ENCODING:
+      case State::IMPORT_IDLE:
+      case State::IMPORTING:
         break;
 
       case State::DONE_OK:
       case State::DONE_ERROR:
-        MSG_BUG("Cannot add pending key in state %u", static_cast<unsigned int>(state_));
-        return;
+        /* being finalized, the key would not be reported anymore */
+        return false;
     }
 
     pending_stream_keys_.emplace_back(std::move(
             std::make_pair(std::move(ArtCache::StreamPrioPair(sp.stream_key_,
                                                               sp.priority_)),
                            ArtCache::AddKeyResult::SOURCE_UNKNOWN)));
-}
 
-static void append_snippet(std::ostringstream &os, const std::string &workdir)
-{
-    os << "#! /bin/sh\ncd '" << workdir << "'\n";
+    return true;
 }
 
-static void append_snippet(std::ostringstream &os, const Converter::DownloadData *const dldata)
+bool Converter::Job::remove_pending_key(const ArtCache::StreamPrioPair &sp)
 {
-    if(dldata == nullptr)
-        return;
+    std::lock_guard<std::mutex> lock(lock_);
 
-    os << "wget -qO '" << dldata->output_file_name_ << "' '" << dldata->source_uri_ << "'\n"
-       << "test $? -eq 0 || exit 2\n"
-       << "test -f '" << dldata->output_file_name_ << "' || exit 1\n"
-       << "test -s '" << dldata->output_file_name_ << "' || exit 3\n";
-}
+    const auto it(std::find_if(pending_stream_keys_.begin(),
+                               pending_stream_keys_.end(),
+                               [&sp] (const auto &key)
+                               {
+                                   return key.first.priority_ == sp.priority_ &&
+                                          key.first.stream_key_ == sp.stream_key_;
+                               }));
 
-static void append_snippet(std::ostringstream &os, const Converter::ConvertData *const cdata)
-{
-    if(cdata == nullptr)
-        return;
+    if(it == pending_stream_keys_.end())
+        return false;
 
-    for(const auto &outfmt : cdata->output_formats_)
-        os << "nice -n " << cdata->niceness_
-           << " convert '" << cdata->input_file_name_
-           << "' -resize " << outfmt.dimensions_
-           << " -strip"
-           << " -colors 255 -dither FloydSteinberg -background transparent '"
-           << outfmt.format_spec_ << ':' << outfmt.filename_ << "' &\n";
+    /* keys cannot be assigned, so erase() is not available */
+    std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> remaining;
+    remaining.reserve(pending_stream_keys_.size() - 1);
 
-    os << "for i in `seq " << cdata->output_formats_.size() << "`\ndo\n"
-       << "    wait\n"
-       << "done\n";
+    for(auto key = pending_stream_keys_.begin(); key != pending_stream_keys_.end(); ++key)
+        if(key != it)
+            remaining.emplace_back(std::move(*key));
 
-    for(const auto &outfmt : cdata->output_formats_)
-       os << "test -s '" << outfmt.filename_ << "' || exit 4\n";
+    pending_stream_keys_.swap(remaining);
 
-    os << "exit 0\n";
+    return pending_stream_keys_.empty();
 }
 
 bool Converter::Job::write_data_to_file(const uint8_t *data, size_t length,
@@ -115,124 +151,270 @@ bool Converter::Job::write_data_to_file(const uint8_t *data, size_t length,
     return !failed;
 }
 
-static Converter::Job::State
-generate_script(const std::string &script_name,
-                const Converter::DownloadData *const dldata,
-                const Converter::ConvertData *const cdata,
-                Converter::Job::Result &result)
+static std::vector<std::string> mk_convert_command(const Converter::ConvertData &cdata)
 {
-    msg_log_assert(cdata != nullptr);
+    std::vector<std::pair<unsigned int, unsigned int>> dimensions;
 
+    for(const auto &outfmt : cdata.output_formats_)
     {
-        OS::SuppressErrorsGuard suppress_errors;
+        unsigned int width = 0;
+        unsigned int height = 0;
 
-        switch(os_path_get_type(script_name.c_str()))
-        {
-          case OS_PATH_TYPE_IO_ERROR:
-            /* OK, file does not exist */
-            break;
-
-          case OS_PATH_TYPE_FILE:
-            MSG_BUG("Found orphaned script \"%s\", replacing", script_name.c_str());
-            break;
-
-          case OS_PATH_TYPE_DIRECTORY:
-          case OS_PATH_TYPE_OTHER:
-            MSG_BUG("Found non-file path \"%s\", cannot continue", script_name.c_str());
-            result = Converter::Job::Result::INTERNAL_ERROR;
-            return Converter::Job::State::DONE_ERROR;
-        }
+        if(!Converter::parse_dimensions(outfmt.dimensions_, width, height))
+            MSG_BUG("Invalid output dimensions \"%s\"", outfmt.dimensions_.c_str());
+
+        dimensions.emplace_back(width, height);
     }
 
-    result = Converter::Job::Result::OK;
+    /*
+     * Decode the input only once and derive each rendition from the nearest
+     * larger one. The original image is at index 0 in the image list, the
+     * result of step i is at index i + 1.
+     */
+    std::vector<std::string> argv
+    {
+        "nice", "-n", std::to_string(cdata.niceness_),
+        "convert", cdata.output_directory_ + '/' + cdata.input_file_name_,
+        "-strip", "-background", "transparent",
+    };
 
-    msg_vinfo(MESSAGE_LEVEL_DIAG,
-              "Generate job script \"%s\"", script_name.c_str());
+    for(const auto &step : Converter::plan_renditions(dimensions))
+    {
+        const auto &outfmt(cdata.output_formats_[step.box_index_]);
+
+        argv.insert(argv.end(),
+                    {
+                        "(", "-clone", std::to_string(step.source_step_ + 1),
+                        "-resize", outfmt.dimensions_,
+                        "(", "+clone", "-colors", "255", "-dither", "FloydSteinberg",
+                        "-write", outfmt.format_spec_ + ':' +
+                                  cdata.output_directory_ + '/' + outfmt.filename_,
+                        "+delete", ")", ")",
+                    });
+    }
 
-    std::ostringstream os;
-    append_snippet(os, cdata->output_directory_);
-    append_snippet(os, dldata);
-    append_snippet(os, cdata);
+    argv.emplace_back("null:");
 
-    const auto &str(os.str());
-    if(!Converter::Job::write_data_to_file(
-            static_cast<const uint8_t *>(static_cast<const void *>(str.c_str())),
-            str.length(), script_name))
+    return argv;
+}
+
+/*
+ * Deadline for the external conversion tool. A pathological input file must
+ * not occupy a worker forever. Downloads are limited by the fetcher.
+ */
+static constexpr unsigned int convert_timeout_ms = 120U * 1000U;
+
+/*!
+ * Run external command through the helper process, log its timings.
+ *
+ * The command is terminated if it takes longer than \p timeout_ms
+ * milliseconds or if \p cancel is triggered.
+ */
+static bool run_command(const Converter::SpawnHelper &spawner,
+                        const std::vector<std::string> &argv,
+                        const std::string &workdir, unsigned int timeout_ms,
+                        const Converter::SpawnCancel &cancel)
+{
+    Converter::SpawnResult result;
+
+    if(!spawner.run(argv, result, timeout_ms, &cancel))
     {
-        result = Converter::Job::Result::IO_ERROR;
-        return Converter::Job::State::DONE_ERROR;
+        if(!result.canceled_)
+            msg_error(result.error_, LOG_ERR, "Failed running %s for %s",
+                      argv[0].c_str(), workdir.c_str());
+
+        return false;
     }
 
-    os_system_formatted(false, "chmod +x %s", script_name.c_str());
+    if(result.timed_out_)
+        msg_error(ETIMEDOUT, LOG_ERR, "%s for %s took longer than %u ms",
+                  argv[0].c_str(), workdir.c_str(), timeout_ms);
+
+    msg_vinfo(MESSAGE_LEVEL_DIAG,
+              "%s for %s: exit code %d, signal %d, spawn %" PRIu64 " us, "
+              "run %" PRIu64 " us",
+              argv[0].c_str(), workdir.c_str(), result.exit_code_,
+              result.signal_, result.spawn_us_, result.run_us_);
+
+    return result.succeeded();
+}
+
+static bool is_nonempty_file(const std::string &path, bool &exists)
+{
+    struct stat buf;
+
+    exists = stat(path.c_str(), &buf) == 0 && S_ISREG(buf.st_mode);
+
+    return exists && buf.st_size > 0;
+}
 
-    return dldata != nullptr
-        ? Converter::Job::State::DOWNLOADING_AND_CONVERTING
-        : Converter::Job::State::CONVERTING;
+static bool is_supported_in_process(const std::vector<Converter::OutputFormat> &formats)
+{
+    return std::all_of(formats.begin(), formats.end(),
+                       [] (const Converter::OutputFormat &f) { return f.format_spec_ == "png"; });
 }
 
-static Converter::Job::Result handle_script_exit_code(int exit_code)
+/*!
+ * Decode input file and scale it to all output dimensions in-process.
+ *
+ * \param cdata
+ *     What to convert.
+ *
+ * \param[out] renditions
+ *     Scaled images, one per output format.
+ *
+ * \param[out] use_fallback
+ *     Set to true if the input could not be handled in-process, in which
+ *     case the conversion should be done by the conversion script.
+ */
+static Converter::Job::Result
+decode_and_scale(const Converter::ConvertData &cdata,
+                 std::vector<Converter::RGBAImage> &renditions,
+                 bool &use_fallback)
 {
-    switch(exit_code)
+    use_fallback = false;
+
+    std::vector<std::pair<unsigned int, unsigned int>> dimensions;
+    unsigned int fit_width = 0;
+    unsigned int fit_height = 0;
+
+    for(const auto &outfmt : cdata.output_formats_)
     {
-      case 0:
-        return Converter::Job::Result::OK;
+        unsigned int width;
+        unsigned int height;
 
-      case 1:
-        return Converter::Job::Result::IO_ERROR;
+        if(!Converter::parse_dimensions(outfmt.dimensions_, width, height))
+        {
+            MSG_BUG("Invalid output dimensions \"%s\"", outfmt.dimensions_.c_str());
+            return Converter::Job::Result::INTERNAL_ERROR;
+        }
 
-      case 2:
-        return Converter::Job::Result::DOWNLOAD_ERROR;
+        dimensions.emplace_back(width, height);
+        fit_width = std::max(fit_width, width);
+        fit_height = std::max(fit_height, height);
+    }
 
-      case 3:
-        return Converter::Job::Result::INPUT_ERROR;
+    const std::string infile(cdata.output_directory_ + '/' + cdata.input_file_name_);
+    struct os_mapped_file_data mapped;
+
+    if(os_map_file_to_memory(&mapped, infile.c_str()) < 0)
+        return Converter::Job::Result::IO_ERROR;
+
+    /* decode only as large as needed for the largest output format */
+    Converter::RGBAImage image;
+    const auto decode_result(Converter::decode_image(static_cast<const uint8_t *>(mapped.ptr),
+                                                     mapped.length, image,
+                                                     fit_width, fit_height));
 
-      case 4:
-        return Converter::Job::Result::CONVERSION_ERROR;
+    os_unmap_file(&mapped);
 
-      default:
-        MSG_BUG("Unhandled script exit code %d", exit_code);
+    switch(decode_result)
+    {
+      case Converter::ImageResult::OK:
         break;
+
+      case Converter::ImageResult::UNSUPPORTED:
+      case Converter::ImageResult::INPUT_ERROR:
+        msg_vinfo(MESSAGE_LEVEL_DIAG,
+                  "Cannot decode \"%s\" in-process, using external tools",
+                  infile.c_str());
+        use_fallback = true;
+        return Converter::Job::Result::OK;
+
+      case Converter::ImageResult::INTERNAL_ERROR:
+        return Converter::Job::Result::INTERNAL_ERROR;
     }
 
-    return Converter::Job::Result::INTERNAL_ERROR;
+    /* each rendition is scaled from the nearest larger one */
+    const auto steps(Converter::plan_renditions(dimensions));
+    std::vector<Converter::RGBAImage> levels(steps.size());
+
+    for(size_t i = 0; i < steps.size(); ++i)
+    {
+        const auto &step(steps[i]);
+        const auto &box(dimensions[step.box_index_]);
+
+        Converter::resize_to_fit(step.source_step_ < 0 ? image : levels[step.source_step_],
+                                 image.width_, image.height_,
+                                 box.first, box.second, levels[i]);
+    }
+
+    renditions.clear();
+    renditions.resize(levels.size());
+
+    for(size_t i = 0; i < steps.size(); ++i)
+        renditions[steps[i].box_index_] = std::move(levels[i]);
+
+    return Converter::Job::Result::OK;
 }
 
+/*!
+ * Reduce colors of scaled images and write them to output files.
+ */
 static Converter::Job::Result
-move_files_to_cache(ArtCache::Manager &cache_manager, Converter::ConvertData &cdata,
-                    const std::string &source_hash,
-                    std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> &pending_stream_keys)
+encode_renditions(const Converter::ConvertData &cdata,
+                  const std::vector<Converter::RGBAImage> &renditions)
 {
-    std::vector<std::string> output_files;
+    msg_log_assert(renditions.size() == cdata.output_formats_.size());
 
-    for(const auto &outfmt : cdata.output_formats_)
-        // cppcheck-suppress useStlAlgorithm
-        output_files.emplace_back(cdata.output_directory_ + "/" + outfmt.filename_);
+    Converter::IndexedImage indexed;
+    std::vector<uint8_t> png;
+
+    for(size_t i = 0; i < renditions.size(); ++i)
+    {
+        const auto &outfmt(cdata.output_formats_[i]);
+
+        Converter::quantize(renditions[i], 255, indexed);
+
+        if(Converter::encode_png(indexed, png) != Converter::ImageResult::OK)
+            return Converter::Job::Result::CONVERSION_ERROR;
+
+        if(!Converter::Job::write_data_to_file(png.data(), png.size(),
+                                               cdata.output_directory_ + '/' + outfmt.filename_))
+            return Converter::Job::Result::IO_ERROR;
+    }
 
-    auto result(Converter::Job::Result::INTERNAL_ERROR);
+    return Converter::Job::Result::OK;
+}
 
-    switch(cache_manager.update_source(source_hash, std::move(output_files),
-                                       pending_stream_keys))
+static Converter::Job::Result
+update_source_to_job_result(ArtCache::UpdateSourceResult result)
+{
+    switch(result)
     {
       case ArtCache::UpdateSourceResult::NOT_CHANGED:
       case ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY:
       case ArtCache::UpdateSourceResult::UPDATED_KEYS_ONLY:
       case ArtCache::UpdateSourceResult::UPDATED_ALL:
-        result = Converter::Job::Result::OK;
-        break;
+        return Converter::Job::Result::OK;
 
       case ArtCache::UpdateSourceResult::IO_ERROR:
-        result = Converter::Job::Result::IO_ERROR;
-        break;
+        return Converter::Job::Result::IO_ERROR;
 
       case ArtCache::UpdateSourceResult::DISK_FULL:
-        result = Converter::Job::Result::DISK_FULL_ERROR;
-        break;
+        return Converter::Job::Result::DISK_FULL_ERROR;
 
       case ArtCache::UpdateSourceResult::INTERNAL_ERROR:
         break;
     }
 
-    return result;
+    return Converter::Job::Result::INTERNAL_ERROR;
+}
+
+static Converter::Job::Result
+move_files_to_cache(ArtCache::Manager &cache_manager, Converter::ConvertData &cdata,
+                    const std::string &source_hash,
+                    std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> &pending_stream_keys)
+{
+    std::vector<std::string> output_files;
+
+    for(const auto &outfmt : cdata.output_formats_)
+        // cppcheck-suppress useStlAlgorithm
+        output_files.emplace_back(cdata.output_directory_ + "/" + outfmt.filename_);
+
+    return update_source_to_job_result(
+                cache_manager.update_source(source_hash, std::move(output_files),
+                                            pending_stream_keys));
 }
 
 static int delete_all(const char *path, unsigned char dtype, void *user_data)
@@ -304,7 +486,6 @@ void Converter::Job::execute()
     switch(do_execute(lock))
     {
       case Result::OK:
-        state_ = State::DONE_OK;
         break;
 
       case Result::IO_ERROR:
@@ -313,7 +494,9 @@ void Converter::Job::execute()
       case Result::INPUT_ERROR:
       case Result::CONVERSION_ERROR:
       case Result::INTERNAL_ERROR:
+      case Result::CANCELED:
         state_ = State::DONE_ERROR;
+        renditions_.clear();
         break;
     }
 }
@@ -321,83 +504,384 @@ void Converter::Job::execute()
 Converter::Job::Result Converter::Job::do_execute(std::unique_lock<std::mutex> &lock)
 {
     Result result(Result::INTERNAL_ERROR);
+    State next_state(State::DONE_ERROR);
+
+    if(cancel_.is_triggered())
+        return Result::CANCELED;
 
     switch(state_)
     {
       case State::DOWNLOAD_IDLE:
-        result = create_empty_workdir(convert_data_.output_directory_);
+        state_ = State::DOWNLOADING;
+        next_state = State::DECODE_IDLE;
+
+        /* allow state queries while the stage is running */
+        lock.unlock();
+        result = fetch();
+        lock.lock();
 
         if(result == Result::OK)
-            state_ = generate_script(script_name_, &download_data_,
-                                     &convert_data_, result);
+        {
+            bool is_linked;
+            result = link_to_cached_content(lock, is_linked);
+
+            if(is_linked)
+                next_state = State::DONE_OK;
+        }
 
         break;
 
-      case State::CONVERT_IDLE:
-        result = ensure_workdir(convert_data_.output_directory_);
+      case State::DECODE_IDLE:
+        state_ = State::DECODING;
+        lock.unlock();
+        result = decode(next_state);
+        lock.lock();
+        break;
 
-        if(result == Result::OK)
-            state_ = generate_script(script_name_, nullptr,
-                                     &convert_data_, result);
+      case State::ENCODE_IDLE:
+        state_ = State::ENCODING;
+        next_state = State::IMPORT_IDLE;
+        lock.unlock();
+        result = encode();
+        lock.lock();
+        break;
 
+      case State::IMPORT_IDLE:
+        state_ = State::IMPORTING;
+        next_state = State::DONE_OK;
+        result = import(lock);
         break;
 
-      case State::DOWNLOADING_AND_CONVERTING:
-      case State::CONVERTING:
+      case State::DOWNLOADING:
+      case State::DECODING:
+      case State::ENCODING:
+      case State::IMPORTING:
       case State::DONE_OK:
       case State::DONE_ERROR:
-        MSG_BUG("Prepare job in state %u", static_cast<unsigned int>(state_));
+        MSG_BUG("Execute job in state %u", static_cast<unsigned int>(state_));
+        break;
+    }
+
+    if(result == Result::OK)
+        state_ = next_state;
+
+    return result;
+}
+
+/*
+ * Downloaded data, hashed and written to a staged file while it comes in.
+ */
+class DownloadSink: public Converter::FetchSink
+{
+  private:
+    MD5::Context ctx_;
+
+  public:
+    Converter::StagedFile file_;
+
+    DownloadSink(const DownloadSink &) = delete;
+    DownloadSink &operator=(const DownloadSink &) = delete;
+
+    explicit DownloadSink() { MD5::init(ctx_); }
+
+    bool write(const uint8_t *data, size_t length) override
+    {
+        MD5::update(ctx_, data, length);
+        return file_.write(data, length);
+    }
+
+    void finish(std::string &hash_string)
+    {
+        ArtCache::Manager::Hash hash;
+        MD5::finish(ctx_, hash);
+        ArtCache::hash_to_string(hash, hash_string);
+    }
+};
+
+static Converter::Job::Result fetch_error_to_job_result(Converter::FetchError error)
+{
+    switch(error)
+    {
+      case Converter::FetchError::OK:
+        return Converter::Job::Result::OK;
+
+      case Converter::FetchError::INVALID_URI:
+      case Converter::FetchError::UNSUPPORTED_PROTOCOL:
+      case Converter::FetchError::RESOLVE_FAILED:
+      case Converter::FetchError::CONNECT_FAILED:
+      case Converter::FetchError::TLS_FAILED:
+      case Converter::FetchError::TIMEOUT:
+      case Converter::FetchError::NETWORK_ERROR:
+      case Converter::FetchError::PROTOCOL_ERROR:
+      case Converter::FetchError::HTTP_STATUS:
+        return Converter::Job::Result::DOWNLOAD_ERROR;
+
+      case Converter::FetchError::TOO_LARGE:
+      case Converter::FetchError::EMPTY_BODY:
+        return Converter::Job::Result::INPUT_ERROR;
+
+      case Converter::FetchError::WRITE_FAILED:
+        return Converter::Job::Result::IO_ERROR;
+
+      case Converter::FetchError::CANCELED:
+        return Converter::Job::Result::CANCELED;
+
+      case Converter::FetchError::INTERNAL_ERROR:
         break;
     }
 
+    return Converter::Job::Result::INTERNAL_ERROR;
+}
+
+Converter::Job::Result Converter::Job::fetch()
+{
+    const auto &workdir(convert_data_.output_directory_);
+    const auto result(create_empty_workdir(workdir));
+
     if(result != Result::OK)
         return result;
 
-    /* allow state queries */
-    lock.unlock();
+    DownloadSink sink;
+
+    if(!sink.file_.create(workdir))
+        return Result::IO_ERROR;
+
+    FetchResult fetch_result;
+
+    if(!fetcher_.fetch(download_data_.source_uri_, sink, fetch_result, &cancel_))
+    {
+        if(fetch_result.error_ != FetchError::CANCELED)
+            msg_error(0, LOG_ERR, "Download of \"%s\" for %s failed: %s, "
+                      "HTTP status %ld (%s)",
+                      download_data_.source_uri_.c_str(), workdir.c_str(),
+                      fetch_error_to_string(fetch_result.error_),
+                      fetch_result.http_status_, fetch_result.detail_.c_str());
+
+        return fetch_error_to_job_result(fetch_result.error_);
+    }
+
+    msg_vinfo(MESSAGE_LEVEL_DIAG,
+              "Downloaded %zu bytes for %s in %" PRIu64 " us",
+              fetch_result.body_bytes_, workdir.c_str(), fetch_result.elapsed_us_);
+
+    if(!sink.file_.link_to(workdir + '/' + download_data_.output_file_name_))
+        return Result::IO_ERROR;
+
+    sink.finish(download_data_.content_hash_);
+
+    return Result::OK;
+}
+
+/*!
+ * Pass pending keys to the cache manager for linking them to a source.
+ *
+ * The cache manager calls #Converter::Job::add_pending_key() while holding
+ * its own lock, so the job lock must not be held while calling into the
+ * cache manager. The keys are taken out of the job for the call, and keys
+ * added in the meantime are linked to \p source_hash in further rounds.
+ *
+ * \param lock
+ *     The job lock, held by the caller.
+ *
+ * \param source_hash
+ *     Complete source to link keys added during the first round to.
+ *
+ * \param[out] result
+ *     Result of the last round.
+ *
+ * \param first_round
+ *     Function which passes the keys to the cache manager first. It returns
+ *     false if the keys could not be linked, in which case no further
+ *     rounds are made.
+ *
+ * \returns
+ *     The return value of \p first_round.
+ */
+template <typename F>
+bool Converter::Job::link_pending_keys(std::unique_lock<std::mutex> &lock,
+                                       const std::string &source_hash,
+                                       Result &result, const F &first_round)
+{
+    std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> done;
+    bool is_first_round = true;
+    bool is_linked = true;
+    bool keep_going;
+
+    do
+    {
+        auto keys(std::move(pending_stream_keys_));
+        pending_stream_keys_.clear();
+
+        lock.unlock();
+
+        if(is_first_round)
+            is_linked = keep_going = first_round(keys, result);
+        else
+        {
+            ArtCache::UpdateSourceResult update_result;
+            keep_going = cache_manager_.link_keys_to_complete_source(source_hash,
+                                                                     keys,
+                                                                     update_result);
+            if(keep_going)
+                result = update_source_to_job_result(update_result);
+        }
 
-    /* this is where most of the time will be spent */
-    result = handle_script_exit_code(os_system(msg_is_verbose(MESSAGE_LEVEL_DIAG),
-                                               script_name_.c_str()));
+        lock.lock();
 
-    /* lock again for data juggling below */
-    lock.lock();
+        for(auto &key : keys)
+            done.emplace_back(std::move(key));
+
+        is_first_round = false;
+    }
+    while(keep_going && result == Result::OK && !pending_stream_keys_.empty());
+
+    for(auto &key : pending_stream_keys_)
+        done.emplace_back(std::move(key));
+
+    pending_stream_keys_.swap(done);
+
+    return is_linked;
+}
+
+/*
+ * Skip conversion if the downloaded data is in cache already, possibly
+ * added by data or downloaded from another URI.
+ */
+Converter::Job::Result
+Converter::Job::link_to_cached_content(std::unique_lock<std::mutex> &lock,
+                                       bool &is_linked)
+{
+    is_linked = false;
+
+    const auto &content_hash(download_data_.content_hash_);
+
+    if(content_hash.empty() || content_hash == source_hash_)
+        return Result::OK;
+
+    Result result(Result::OK);
+
+    is_linked =
+        link_pending_keys(lock, content_hash, result,
+            [this, &content_hash] (auto &keys, Result &r)
+            {
+                ArtCache::UpdateSourceResult update_result;
+
+                if(!cache_manager_.link_keys_to_complete_source(content_hash,
+                                                                keys,
+                                                                update_result))
+                    return false;
+
+                r = update_source_to_job_result(update_result);
+                return true;
+            });
+
+    if(is_linked)
+        msg_vinfo(MESSAGE_LEVEL_DIAG,
+                  "Downloaded data for %s is cached as source %s already",
+                  source_hash_.c_str(), content_hash.c_str());
+
+    return result;
+}
+
+Converter::Job::Result Converter::Job::decode(State &next_state)
+{
+    auto result(ensure_workdir(convert_data_.output_directory_));
 
     if(result != Result::OK)
         return result;
 
-    switch(state_)
+    if(is_supported_in_process(convert_data_.output_formats_))
     {
-      case State::DOWNLOADING_AND_CONVERTING:
-      case State::CONVERTING:
-        result = move_files_to_cache(cache_manager_, convert_data_,
-                                     source_hash_, pending_stream_keys_);
-        break;
+        bool use_fallback;
+        result = decode_and_scale(convert_data_, renditions_, use_fallback);
 
-      case State::DONE_ERROR:
-        break;
+        if(result != Result::OK || !use_fallback)
+        {
+            next_state = State::ENCODE_IDLE;
+            return result;
+        }
+    }
 
-      case State::DOWNLOAD_IDLE:
-      case State::CONVERT_IDLE:
-      case State::DONE_OK:
-        MSG_BUG("State %u after script execution", static_cast<unsigned int>(state_));
-        result = Result::INTERNAL_ERROR;
-        break;
+    /* the external tool does all the work, there is nothing left to encode */
+    next_state = State::IMPORT_IDLE;
+
+    if(!run_command(spawner_, mk_convert_command(convert_data_),
+                    convert_data_.output_directory_,
+                    convert_timeout_ms, cancel_))
+        return cancel_.is_triggered() ? Result::CANCELED : Result::CONVERSION_ERROR;
+
+    for(const auto &outfmt : convert_data_.output_formats_)
+    {
+        bool exists;
+
+        if(!is_nonempty_file(convert_data_.output_directory_ + '/' +
+                             outfmt.filename_, exists))
+            return Result::CONVERSION_ERROR;
     }
 
+    return Result::OK;
+}
+
+Converter::Job::Result Converter::Job::encode()
+{
+    const auto result(encode_renditions(convert_data_, renditions_));
+
+    /* free memory as early as possible */
+    std::vector<RGBAImage>().swap(renditions_);
+
+    return result;
+}
+
+Converter::Job::Result Converter::Job::import(std::unique_lock<std::mutex> &lock)
+{
+    Result result(Result::INTERNAL_ERROR);
+
+    link_pending_keys(lock, source_hash_, result,
+        [this] (auto &keys, Result &r)
+        {
+            r = move_files_to_cache(cache_manager_, convert_data_,
+                                    source_hash_, keys);
+            return r == Result::OK;
+        });
+
     return result;
 }
 
+void Converter::Job::abandon(ArtCache::AddKeyResult result,
+                             ArtCache::PendingIface &pending)
+{
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+
+        msg_log_assert(state_ == State::DOWNLOAD_IDLE ||
+                       state_ == State::DECODE_IDLE);
+
+        state_ = State::DONE_ERROR;
+
+        for(auto &key : pending_stream_keys_)
+            key.second = result;
+    }
+
+    /* work directory does not exist yet for jobs which download first */
+    OS::SuppressErrorsGuard suppress_errors;
+    finalize(pending);
+}
+
 void Converter::Job::finalize(ArtCache::PendingIface &pending)
 {
-    std::lock_guard<std::mutex> lock(lock_);
+    std::unique_lock<std::mutex> lock(lock_);
+
+    /* notifications may call back into #Converter::Job::remove_pending_key()
+     * for this job, so don't keep the lock while sending them */
+    const auto keys(std::move(pending_stream_keys_));
+    pending_stream_keys_.clear();
+    lock.unlock();
 
-    for(const auto &key : pending_stream_keys_)
+    for(const auto &key : keys)
         pending.notify_pending_key_processed(key.first, source_hash_, key.second,
                                              cache_manager_);
 
     /* attempt cleaning up the nice way, file by file */
-    os_file_delete(script_name_.c_str());
     os_file_delete(std::string(convert_data_.output_directory_ + '/' + temp_file_name_).c_str());;
 
     /* clean up the safe way in case nice way didn't serve us well */
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -25,8 +25,14 @@
 
 #include <glib.h>
 #include <algorithm>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 #include "converterqueue.hh"
+#include "imageconvert.hh"
+#include "stagedfile.hh"
+#include "md5.hh"
 #include "dbus_handlers.hh"
 #include "dbus_iface_deep.h"
 #include "de_tahifi_artcache_errors.hh"
@@ -35,6 +41,12 @@
 
 static const std::string empty_string;
 
+/*
+ * There is no dedicated monitor error code for a full queue in the D-Bus
+ * interface, so report it as internal error.
+ */
+static constexpr auto monitor_error_queue_full = ArtCache::MonitorError::Code::INTERNAL;
+
 static std::string compute_uri_hash(const char *uri)
 {
     ArtCache::Manager::Hash hash;
@@ -46,10 +58,38 @@ static std::string compute_uri_hash(const char *uri)
     return result;
 }
 
-static std::string compute_data_hash(const uint8_t *data, size_t length)
+/*
+ * Hash data and write it to a staged file in a single pass.
+ *
+ * Data is processed in chunks small enough to stay in the CPU cache between
+ * hashing and writing. The hash is computed even if writing fails.
+ */
+static std::string stage_and_hash_data(const uint8_t *data, size_t length,
+                                       Converter::StagedFile &staged,
+                                       const std::string &directory)
 {
+    static constexpr size_t chunk_size = 64U * 1024U;
+
+    MD5::Context ctx;
+    MD5::init(ctx);
+
+    bool is_staging = staged.create(directory);
+
+    for(size_t offset = 0; offset < length; offset += chunk_size)
+    {
+        const size_t count = std::min(chunk_size, length - offset);
+
+        MD5::update(ctx, data + offset, count);
+
+        if(is_staging && !staged.write(data + offset, count))
+        {
+            staged.discard();
+            is_staging = false;
+        }
+    }
+
     ArtCache::Manager::Hash hash;
-    ArtCache::compute_hash(hash, data, length);
+    MD5::finish(ctx, hash);
 
     std::string result;
     ArtCache::hash_to_string(hash, result);
@@ -57,35 +97,369 @@ static std::string compute_data_hash(const uint8_t *data, size_t length)
     return result;
 }
 
-void Converter::Queue::worker_main()
+/*!
+ * Lower scheduling priority of the calling thread.
+ *
+ * Images are converted in-process by the worker threads, so they should not
+ * compete with the main loop for CPU time. This must not be done for the
+ * import stage, which does most of its work while holding the cache manager
+ * lock exclusively, or else lookups would have to wait for a thread which
+ * hardly gets any CPU time under load.
+ */
+static void lower_thread_priority(int niceness)
+{
+    const auto tid = static_cast<id_t>(syscall(SYS_gettid));
+
+    if(setpriority(PRIO_PROCESS, tid, niceness) < 0)
+        msg_error(errno, LOG_NOTICE,
+                  "Failed setting niceness of worker thread %u", tid);
+}
+
+static const char *stage_name(Converter::Stage stage)
+{
+    switch(stage)
+    {
+      case Converter::Stage::FETCH:
+        return "fetch";
+
+      case Converter::Stage::DECODE:
+        return "decode";
+
+      case Converter::Stage::ENCODE:
+        return "encode";
+
+      case Converter::Stage::IMPORT:
+        return "import";
+    }
+
+    return "???";
+}
+
+static const char *client_name(const std::string &client)
+{
+    return client.empty() ? "(unknown)" : client.c_str();
+}
+
+void Converter::PendingSources::add(const std::string &source_hash)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    ++sources_[source_hash];
+}
+
+void Converter::PendingSources::remove(const std::string &source_hash)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    const auto it(sources_.find(source_hash));
+
+    if(it == sources_.end())
+    {
+        MSG_BUG("Pending source %s not registered", source_hash.c_str());
+        return;
+    }
+
+    if(--it->second == 0)
+        sources_.erase(it);
+}
+
+bool Converter::PendingSources::contains(const std::string &source_hash) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return sources_.find(source_hash) != sources_.end();
+}
+
+void Converter::PendingSources::demand(const std::string &source_hash)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    const auto it(std::find(demanded_.begin(), demanded_.end(), source_hash));
+
+    if(it != demanded_.end())
+        demanded_.erase(it);
+
+    demanded_.push_back(source_hash);
+}
+
+std::vector<std::string> Converter::PendingSources::take_demanded()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    std::vector<std::string> result;
+    result.swap(demanded_);
+
+    return result;
+}
+
+void Converter::PendingSources::add_key(const std::string &stream_key,
+                                       uint8_t priority)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    ++keys_[std::make_pair(stream_key, priority)];
+}
+
+void Converter::PendingSources::remove_key(const std::string &stream_key,
+                                          uint8_t priority)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    const auto it(keys_.find(std::make_pair(stream_key, priority)));
+
+    if(it == keys_.end())
+    {
+        MSG_BUG("Pending key %s, prio %u not registered",
+                stream_key.c_str(), priority);
+        return;
+    }
+
+    if(--it->second == 0)
+        keys_.erase(it);
+}
+
+bool Converter::PendingSources::contains_key(const std::string &stream_key,
+                                            uint8_t priority) const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if(priority > 0)
+        return keys_.find(std::make_pair(stream_key, priority)) != keys_.end();
+
+    const auto it(keys_.lower_bound(std::make_pair(stream_key, priority)));
+    return it != keys_.end() && it->first.first == stream_key;
+}
+
+/*!
+ * Change scheduling attributes of a job waiting in the queue.
+ *
+ * The job is repositioned in its client's queue according to its new
+ * attributes.
+ */
+template <typename F>
+void Converter::Queue::reschedule__unlocked(const std::shared_ptr<Job> &job,
+                                            const F &modify)
+{
+    const auto client(clients_.find(job->schedule_.client_));
+    const auto it(client != clients_.end()
+                  ? client->second.jobs_.find(job)
+                  : JobSet::iterator());
+
+    if(client == clients_.end() || it == client->second.jobs_.end())
+    {
+        MSG_BUG("Cannot reschedule job for source %s", job->source_hash_.c_str());
+        return;
+    }
+
+    /* keep the job alive, the set may hold its only reference */
+    auto temp(*it);
+    client->second.jobs_.erase(it);
+    modify(temp->schedule_);
+    client->second.jobs_.insert(std::move(temp));
+}
+
+/*!
+ * Take next job for given stage, mark it as running.
+ *
+ * Jobs which have already passed earlier stages are preferred over new jobs
+ * so that work in progress is finished first.
+ *
+ * New jobs which a client is waiting for are taken first, across all
+ * clients. Otherwise, clients are served in a round-robin fashion, and the
+ * jobs of each client are taken in the order defined by their
+ * #Converter::JobSchedule.
+ */
+std::shared_ptr<Converter::Job> Converter::Queue::take_job__unlocked(Stage stage)
 {
+    process_deleted_keys__unlocked();
+    promote_demanded__unlocked();
+
+    auto &st(stages_[size_t(stage)]);
+
+    if(!st.jobs_.empty())
+    {
+        auto job(std::move(st.jobs_.front()));
+        st.jobs_.pop_front();
+        st.space_available_.notify_one();
+        return job;
+    }
+
+    const auto is_for_stage([stage] (const std::shared_ptr<Job> &j)
+                            {
+                                Stage s;
+                                return j->get_next_stage(s) && s == stage;
+                            });
+
+    std::map<std::string, Client>::iterator client(clients_.end());
+    JobSet::iterator it;
+    uint64_t best_demand = 0;
+
+    /* demanded jobs are sorted to the front of their client's queue */
+    for(auto c = clients_.begin(); c != clients_.end(); ++c)
+    {
+        for(auto j = c->second.jobs_.begin();
+            j != c->second.jobs_.end() && (*j)->schedule_.demand_ > best_demand;
+            ++j)
+        {
+            if(is_for_stage(*j))
+            {
+                best_demand = (*j)->schedule_.demand_;
+                client = c;
+                it = j;
+                break;
+            }
+        }
+    }
+
+    if(client == clients_.end())
+    {
+        /* start with the client following the one served last */
+        auto c(clients_.upper_bound(st.last_client_));
+
+        for(size_t i = 0; i < clients_.size(); ++i, ++c)
+        {
+            if(c == clients_.end())
+                c = clients_.begin();
+
+            it = std::find_if(c->second.jobs_.begin(), c->second.jobs_.end(),
+                              is_for_stage);
+
+            if(it != c->second.jobs_.end())
+            {
+                client = c;
+                st.last_client_ = c->first;
+                break;
+            }
+        }
+    }
+
+    if(client == clients_.end())
+        return nullptr;
+
+    auto job(*it);
+    client->second.jobs_.erase(it);
+    ++client->second.in_progress_;
+    --queued_jobs_;
+    queued_bytes_ -= job->schedule_.temp_bytes_;
+    jobs_by_source_.erase(job->source_hash_);
+    running_jobs_.push_back(job);
+
+    return job;
+}
+
+/*!
+ * Account for finalized job, forget about idle clients.
+ */
+void Converter::Queue::job_finished__unlocked(const std::shared_ptr<Job> &job)
+{
+    running_jobs_.erase(std::find(running_jobs_.begin(),
+                                  running_jobs_.end(), job));
+    pending_sources_.remove(job->source_hash_);
+
+    const auto client(clients_.find(job->schedule_.client_));
+
+    if(client == clients_.end() || client->second.in_progress_ == 0)
+    {
+        MSG_BUG("Finished job for source %s not accounted for",
+                job->source_hash_.c_str());
+        return;
+    }
+
+    if(--client->second.in_progress_ == 0 && client->second.jobs_.empty())
+        clients_.erase(client);
+}
+
+void Converter::Queue::dump_client_statistics() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    msg_vinfo(MESSAGE_LEVEL_INFO_MIN, "Converter queue: %zu client%s, %zu job%s in progress",
+              clients_.size(), clients_.size() != 1 ? "s" : "",
+              running_jobs_.size(), running_jobs_.size() != 1 ? "s" : "");
+
+    for(const auto &c : clients_)
+        msg_vinfo(MESSAGE_LEVEL_INFO_MIN, "Client %s: %zu queued, %zu in progress",
+                  client_name(c.first), c.second.jobs_.size(),
+                  c.second.in_progress_);
+}
+
+/*!
+ * Move job to the queue of the given stage.
+ *
+ * Blocks while the stage's queue is full.
+ *
+ * \returns
+ *     False if the queue is being shut down.
+ */
+bool Converter::Queue::pass_job_on__unlocked(std::shared_ptr<Job> &&job,
+                                            Stage stage,
+                                            std::unique_lock<std::mutex> &qlock)
+{
+    auto &st(stages_[size_t(stage)]);
+
+    st.space_available_.wait(qlock,
+                             [this, &st]()
+                             {
+                                 return shutdown_request_ ||
+                                        st.jobs_.size() < number_of_workers_;
+                             });
+
+    if(shutdown_request_)
+        return false;
+
+    st.jobs_.emplace_back(std::move(job));
+    st.job_available_.notify_one();
+
+    return true;
+}
+
+void Converter::Queue::worker_main(Stage stage)
+{
+    static constexpr int worker_niceness = 19;
+
+    /* the import stage updates the cache, and it is quick */
+    if(stage != Stage::IMPORT)
+        lower_thread_priority(worker_niceness);
+
+    auto &st(stages_[size_t(stage)]);
     std::unique_lock<std::mutex> qlock(lock_, std::defer_lock);
 
     while(1)
     {
         qlock.lock();
 
-        job_available_.wait(qlock,
-                            [this]()
-                            {
-                                return shutdown_request_ || !jobs_.empty();
-                            });
+        /* take job from queue and mark it as running, unlock the queue,
+         * execute the job --- IN THIS ORDER! */
+        std::shared_ptr<Job> job;
+
+        while(!shutdown_request_ && (job = take_job__unlocked(stage)) == nullptr)
+            st.job_available_.wait(qlock);
 
         if(shutdown_request_)
             break;
 
-        /* move job data to our own stack, unlock the queue,
-         * execute the job --- IN THIS ORDER! */
-        running_job_ = std::move(jobs_.front());
-        jobs_.pop_front();
-
         qlock.unlock();
 
-        running_job_->execute();
+        job->execute();
+
+        Stage next_stage;
+
+        if(job->get_next_stage(next_stage))
+        {
+            qlock.lock();
+
+            if(!pass_job_on__unlocked(std::move(job), next_stage, qlock))
+                break;
+        }
+        else
+        {
+            /* notifications may take the cache manager lock, so they are
+             * sent without holding the queue lock; the job remains in
+             * progress until then so that its source is still pending */
+            job->finalize(*this);
+
+            qlock.lock();
+            job_finished__unlocked(job);
+            process_deleted_keys__unlocked();
+        }
 
-        qlock.lock();
-        running_job_->finalize(*this);
-        running_job_ = nullptr;
         qlock.unlock();
     }
 }
@@ -93,7 +467,36 @@ void Converter::Queue::worker_main()
 void Converter::Queue::init()
 {
     os_mkdir_hierarchy(temp_dir_.c_str(), false);
-    worker_ = std::thread(&Converter::Queue::worker_main, this);
+
+    /* must be forked before any threads are started */
+    if(!spawner_.start())
+        msg_error(0, LOG_WARNING,
+                  "Running external tools without converter helper process");
+
+    /* must be initialized before any threads are started as well */
+    if(!fetcher_.init())
+        msg_error(0, LOG_WARNING, "Downloads will not be available");
+
+    msg_vinfo(MESSAGE_LEVEL_DIAG, "Starting %u converter worker%s per stage",
+              number_of_workers_, number_of_workers_ != 1 ? "s" : "");
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    for(size_t i = 0; i < stages_.size(); ++i)
+    {
+        const auto stage = static_cast<Stage>(i);
+
+        /* importing is quick and serialized by the cache manager anyway */
+        const unsigned int count = stage == Stage::IMPORT ? 1 : number_of_workers_;
+
+        msg_vinfo(MESSAGE_LEVEL_DEBUG, "%u worker%s for %s stage",
+                  count, count != 1 ? "s" : "", stage_name(stage));
+
+        for(unsigned int j = 0; j < count; ++j)
+            workers_.emplace_back(&Converter::Queue::worker_main, this, stage);
+    }
+
+    intake_thread_ = std::thread(&Converter::Queue::intake_main, this);
 }
 
 void Converter::Queue::shutdown()
@@ -104,19 +507,35 @@ void Converter::Queue::shutdown()
     {
         std::lock_guard<std::mutex> lock(lock_);
 
-        if(worker_.get_id() == std::thread::id())
+        if(workers_.empty())
             return;
 
-        job_available_.notify_all();
+        /* don't wait for slow downloads and conversions */
+        for(auto &job : running_jobs_)
+            job->cancel();
+
+        for(auto &st : stages_)
+        {
+            st.job_available_.notify_all();
+            st.space_available_.notify_all();
+        }
+
+        intake_available_.notify_all();
     }
 
-    worker_.join();
-    worker_ = std::thread();
+    intake_thread_.join();
+
+    for(auto &w : workers_)
+        w.join();
+
+    workers_.clear();
+    fetcher_.shutdown();
+    spawner_.stop();
 }
 
 void Converter::Queue::add_to_cache_by_uri(ArtCache::Manager &cache_manager,
                                            ArtCache::StreamPrioPair &&sp,
-                                           const char *uri)
+                                           const char *uri, const char *client)
 {
     msg_log_assert(!sp.stream_key_.empty());
     msg_log_assert(sp.priority_ > 0);
@@ -150,9 +569,16 @@ void Converter::Queue::add_to_cache_by_uri(ArtCache::Manager &cache_manager,
 
     auto workdir(temp_dir_ + '/' + source_hash_string);
 
-    if(queue(std::move(std::make_shared<Job>(std::move(workdir), temp_filename,
-                                             uri, std::string(source_hash_string),
-                                             std::move(sp), cache_manager))))
+    const auto queue_result(
+        make_room__unlocked(sp.priority_, 0)
+        ? queue(std::move(std::make_shared<Job>(std::move(workdir), temp_filename,
+                                                uri, std::string(source_hash_string),
+                                                std::move(sp), cache_manager,
+                                                spawner_, fetcher_)),
+                client, 0)
+        : ArtCache::AddKeyResult::QUEUE_FULL);
+
+    if(queue_result == ArtCache::AddKeyResult::SOURCE_PENDING)
     {
         tdbus_art_cache_monitor_emit_associated(dbus_get_artcache_monitor_iface(),
                                                 DBus::hexstring_to_variant(sp_copy.stream_key_),
@@ -160,21 +586,171 @@ void Converter::Queue::add_to_cache_by_uri(ArtCache::Manager &cache_manager,
         return;
     }
 
-    notify_pending_key_processed(sp_copy, source_hash_string, result, cache_manager);
+    notify_pending_key_processed(sp_copy, source_hash_string, queue_result,
+                                 cache_manager);
+}
+
+/*
+ * Check if data can be stored in cache for all output formats as is.
+ */
+static bool is_usable_as_is(const uint8_t *data, size_t length)
+{
+    Converter::PNGInfo info;
+
+    if(Converter::inspect_png(data, length, info) != Converter::ImageResult::OK)
+        return false;
+
+    for(const auto &outfmt : Converter::get_output_format_list().get_formats())
+    {
+        unsigned int width;
+        unsigned int height;
+
+        if(outfmt.format_spec_ != "png" ||
+           !Converter::parse_dimensions(outfmt.dimensions_, width, height) ||
+           !Converter::is_png_usable_as_is(info, width, height, 255))
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ * Import data to cache without conversion.
+ *
+ * The data is stored as object for each output format, so that it can be
+ * moved to the cache just like the results of a conversion job.
+ */
+static ArtCache::AddKeyResult
+import_as_is(ArtCache::Manager &cache_manager, const std::string &workdir,
+             const std::string &source_hash,
+             const ArtCache::StreamPrioPair &sp,
+             const uint8_t *data, size_t length)
+{
+    std::vector<std::string> output_files;
+
+    for(const auto &outfmt : Converter::get_output_format_list().get_formats())
+    {
+        output_files.emplace_back(workdir + '/' + outfmt.filename_);
+
+        if(!Converter::Job::write_data_to_file(data, length, output_files.back()))
+            return ArtCache::AddKeyResult::IO_ERROR;
+    }
+
+    std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> pending_stream_keys;
+    pending_stream_keys.emplace_back(ArtCache::StreamPrioPair(sp.stream_key_, sp.priority_),
+                                     ArtCache::AddKeyResult::SOURCE_UNKNOWN);
+
+    switch(cache_manager.update_source(source_hash, std::move(output_files),
+                                       pending_stream_keys))
+    {
+      case ArtCache::UpdateSourceResult::NOT_CHANGED:
+      case ArtCache::UpdateSourceResult::UPDATED_SOURCE_ONLY:
+      case ArtCache::UpdateSourceResult::UPDATED_KEYS_ONLY:
+      case ArtCache::UpdateSourceResult::UPDATED_ALL:
+        return pending_stream_keys.front().second;
+
+      case ArtCache::UpdateSourceResult::IO_ERROR:
+        return ArtCache::AddKeyResult::IO_ERROR;
+
+      case ArtCache::UpdateSourceResult::DISK_FULL:
+        return ArtCache::AddKeyResult::DISK_FULL;
+
+      case ArtCache::UpdateSourceResult::INTERNAL_ERROR:
+        break;
+    }
+
+    return ArtCache::AddKeyResult::INTERNAL_ERROR;
 }
 
 void Converter::Queue::add_to_cache_by_data(ArtCache::Manager &cache_manager,
                                             ArtCache::StreamPrioPair &&sp,
-                                            const uint8_t *data, size_t length)
+                                            std::shared_ptr<const ArtCache::ObjectData> &&data,
+                                            const char *client)
 {
     msg_log_assert(!sp.stream_key_.empty());
     msg_log_assert(sp.priority_ > 0);
     msg_log_assert(data != nullptr);
-    msg_log_assert(length > 0);
+    msg_log_assert(data->size() > 0);
 
-    const auto source_hash_string(compute_data_hash(data, length));
+    const size_t length = data->size();
 
     std::lock_guard<std::mutex> lock(lock_);
+
+    /* jobs cannot be dropped in favor of data which has not been hashed
+     * yet, so only the free space is taken into account */
+    if(queued_bytes_ + intake_bytes_ + length > max_queued_bytes_)
+    {
+        msg_info("Converter queue full, rejecting %zu bytes of image data "
+                 "for key %s, prio %u of client %s",
+                 length, sp.stream_key_.c_str(), sp.priority_,
+                 client_name(client != nullptr ? client : ""));
+
+        /* the key has not been touched, so it must not be deleted */
+        tdbus_art_cache_monitor_emit_failed(dbus_get_artcache_monitor_iface(),
+                                            DBus::hexstring_to_variant(sp.stream_key_),
+                                            sp.priority_,
+                                            monitor_error_queue_full);
+        return;
+    }
+
+    /* lookups report the key as busy until it refers to a source */
+    pending_sources_.add_key(sp.stream_key_, sp.priority_);
+
+    intake_bytes_ += length;
+    intake_.emplace_back(cache_manager, std::move(sp), std::move(data), client);
+    intake_available_.notify_one();
+}
+
+void Converter::Queue::intake_main()
+{
+    std::unique_lock<std::mutex> qlock(lock_);
+
+    while(1)
+    {
+        intake_available_.wait(qlock,
+                               [this] () { return shutdown_request_ || !intake_.empty(); });
+
+        if(shutdown_request_)
+            break;
+
+        DataIntake req(std::move(intake_.front()));
+        intake_.pop_front();
+
+        const std::string stream_key(req.sp_.stream_key_);
+        const uint8_t priority(req.sp_.priority_);
+
+        qlock.unlock();
+        ingest_data(req);
+        pending_sources_.remove_key(stream_key, priority);
+        qlock.lock();
+    }
+
+    if(!intake_.empty())
+        msg_info("Dropping %zu unprocessed images", intake_.size());
+
+    for(const auto &req : intake_)
+        pending_sources_.remove_key(req.sp_.stream_key_, req.sp_.priority_);
+
+    intake_.clear();
+    intake_bytes_ = 0;
+}
+
+void Converter::Queue::ingest_data(DataIntake &req)
+{
+    ArtCache::Manager &cache_manager(req.cache_manager_);
+    ArtCache::StreamPrioPair &sp(req.sp_);
+    const uint8_t *const data = req.data_->data();
+    const size_t length = req.data_->size();
+    const char *const client = req.client_.c_str();
+
+    /* the queue is not locked while the bulk of the work is done */
+    StagedFile staged;
+    const auto source_hash_string(stage_and_hash_data(data, length,
+                                                      staged, temp_dir_));
+
+    std::lock_guard<std::mutex> lock(lock_);
+    intake_bytes_ -= length;
+
     auto addguard(pdata_.earmark_add_source(source_hash_string));
 
     auto result(cache_manager.add_stream_key_for_source(sp, source_hash_string));
@@ -206,20 +782,46 @@ void Converter::Queue::add_to_cache_by_data(ArtCache::Manager &cache_manager,
                 : ArtCache::AddKeyResult::IO_ERROR;
     }
 
+    if(result == ArtCache::AddKeyResult::SOURCE_UNKNOWN &&
+       is_usable_as_is(data, length))
+    {
+        msg_vinfo(MESSAGE_LEVEL_DEBUG,
+                  "Importing source %s without conversion",
+                  source_hash_string.c_str());
+
+        result = import_as_is(cache_manager, workdir, source_hash_string,
+                              sp_copy, data, length);
+        Converter::Job::clean_up(workdir);
+        notify_pending_key_processed(sp_copy, source_hash_string, result,
+                                     cache_manager);
+        return;
+    }
+
     static const std::string temp_filename("original_raw");
 
+    /* check before the data is moved to the working directory */
     if(result == ArtCache::AddKeyResult::SOURCE_UNKNOWN &&
-       !Converter::Job::write_data_to_file(data, length,
-                                           workdir + '/' + temp_filename))
+       !make_room__unlocked(sp.priority_, length))
     {
-        result = ArtCache::AddKeyResult::IO_ERROR;
+        result = ArtCache::AddKeyResult::QUEUE_FULL;
         Converter::Job::clean_up(workdir);
     }
 
     if(result == ArtCache::AddKeyResult::SOURCE_UNKNOWN &&
-       queue(std::move(std::make_shared<Job>(std::move(workdir), temp_filename,
-                                             std::string(source_hash_string),
-                                             std::move(sp), cache_manager))))
+       (!staged.is_open() || !staged.link_to(workdir + '/' + temp_filename)))
+    {
+        result = ArtCache::AddKeyResult::IO_ERROR;
+        Converter::Job::clean_up(workdir);
+    }
+
+    if(result == ArtCache::AddKeyResult::SOURCE_UNKNOWN)
+        result = queue(std::move(std::make_shared<Job>(std::move(workdir), temp_filename,
+                                                       std::string(source_hash_string),
+                                                       std::move(sp), cache_manager,
+                                                       spawner_, fetcher_)),
+                       client, length);
+
+    if(result == ArtCache::AddKeyResult::SOURCE_PENDING)
     {
         tdbus_art_cache_monitor_emit_associated(dbus_get_artcache_monitor_iface(),
                                                 DBus::hexstring_to_variant(sp_copy.stream_key_),
@@ -230,11 +832,88 @@ void Converter::Queue::add_to_cache_by_data(ArtCache::Manager &cache_manager,
     notify_pending_key_processed(sp_copy, source_hash_string, result, cache_manager);
 }
 
-bool Converter::Queue::is_source_pending(const std::string &source_hash,
-                                         bool exclude_current) const
+void Converter::Queue::notify_key_unlinked__unlocked(const ArtCache::StreamPrioPair &stream_key,
+                                                     const std::string &source_hash)
 {
-    std::lock_guard<std::mutex> lock(lock_);
-    return is_source_pending__unlocked(source_hash, exclude_current);
+    const auto queued(jobs_by_source_.find(source_hash));
+
+    if(queued != jobs_by_source_.end())
+    {
+        if(!queued->second->remove_pending_key(stream_key))
+            return;
+
+        const auto client(clients_.find(queued->second->schedule_.client_));
+        const auto it(client != clients_.end()
+                      ? client->second.jobs_.find(queued->second)
+                      : JobSet::iterator());
+
+        if(client == clients_.end() || it == client->second.jobs_.end())
+        {
+            MSG_BUG("Obsolete job for source %s not found", source_hash.c_str());
+            return;
+        }
+
+        msg_vinfo(MESSAGE_LEVEL_DIAG, "Dropping obsolete job for source %s",
+                  source_hash.c_str());
+
+        /* there are no keys left to report the result to */
+        drop_job__unlocked(client, it, ArtCache::AddKeyResult::NOT_CHANGED);
+        return;
+    }
+
+    const auto *running(find_running_job__unlocked(source_hash));
+
+    if(running != nullptr && (*running)->remove_pending_key(stream_key))
+    {
+        msg_vinfo(MESSAGE_LEVEL_DIAG, "Canceling obsolete job for source %s",
+                  source_hash.c_str());
+        (*running)->cancel();
+    }
+}
+
+void Converter::Queue::notify_key_deleted(const ArtCache::StreamPrioPair &stream_key,
+                                          const std::string &source_hash)
+{
+    std::lock_guard<std::mutex> lock(deleted_keys_lock_);
+    deleted_keys_.emplace_back(ArtCache::StreamPrioPair(stream_key.stream_key_,
+                                                        stream_key.priority_),
+                               source_hash);
+}
+
+/*!
+ * Carry out notifications passed to #Converter::Queue::notify_key_deleted().
+ */
+void Converter::Queue::process_deleted_keys__unlocked()
+{
+    std::vector<std::pair<ArtCache::StreamPrioPair, std::string>> keys;
+
+    {
+        std::lock_guard<std::mutex> lock(deleted_keys_lock_);
+        keys.swap(deleted_keys_);
+    }
+
+    for(const auto &key : keys)
+        notify_key_unlinked__unlocked(key.first, key.second);
+}
+
+bool Converter::Queue::is_stream_key_pending(const std::string &stream_key,
+                                             uint8_t priority) const
+{
+    return pending_sources_.contains_key(stream_key, priority);
+}
+
+bool Converter::Queue::is_source_pending(const std::string &source_hash) const
+{
+    return pending_sources_.contains(source_hash);
+}
+
+const std::shared_ptr<Converter::Job> *
+Converter::Queue::find_running_job__unlocked(const std::string &source_hash) const
+{
+    const auto it(std::find_if(running_jobs_.begin(), running_jobs_.end(),
+                               [&source_hash] (const auto &j) { return j->source_hash_ == source_hash; }));
+
+    return it != running_jobs_.end() ? &*it : nullptr;
 }
 
 bool Converter::Queue::is_source_pending__unlocked(const std::string &source_hash,
@@ -246,33 +925,79 @@ bool Converter::Queue::is_source_pending__unlocked(const std::string &source_has
            source_hash == *pdata_.adding_source_hash_)
             return true;
 
-        if(running_job_ != nullptr && running_job_->source_hash_ == source_hash)
+        if(find_running_job__unlocked(source_hash) != nullptr)
             return true;
     }
 
-    return std::any_of(jobs_.begin(), jobs_.end(),
-                       [&source_hash] (const auto &j) { return j->source_hash_ == source_hash; });
+    return jobs_by_source_.find(source_hash) != jobs_by_source_.end();
 }
 
 bool Converter::Queue::add_key_to_pending_source(const ArtCache::StreamPrioPair &stream_key,
                                                  const std::string &source_hash)
 {
-    if(running_job_ != nullptr && running_job_->source_hash_ == source_hash)
-    {
-        running_job_->add_pending_key(stream_key);
+    const auto *running(find_running_job__unlocked(source_hash));
+
+    if(running != nullptr && (*running)->add_pending_key(stream_key))
         return true;
-    }
 
-    const auto &it(std::find_if(jobs_.begin(), jobs_.end(),
-                                [&source_hash] (const auto &j) { return j->source_hash_ == source_hash; }));
+    const auto it(jobs_by_source_.find(source_hash));
 
-    if(it == jobs_.end())
+    if(it == jobs_by_source_.end() || !it->second->add_pending_key(stream_key))
         return false;
 
-    (*it)->add_pending_key(stream_key);
+    if(stream_key.priority_ > it->second->schedule_.priority_)
+        reschedule__unlocked(it->second,
+                             [&stream_key] (JobSchedule &s) { s.priority_ = stream_key.priority_; });
+
     return true;
 }
 
+void Converter::Queue::promote_pending_source(const std::string &source_hash)
+{
+    pending_sources_.demand(source_hash);
+}
+
+/*!
+ * Carry out requests passed to #Converter::Queue::promote_pending_source().
+ */
+void Converter::Queue::promote_demanded__unlocked()
+{
+    for(const auto &source_hash : pending_sources_.take_demanded())
+    {
+        const auto it(jobs_by_source_.find(source_hash));
+
+        if(it != jobs_by_source_.end())
+        {
+            msg_vinfo(MESSAGE_LEVEL_DIAG, "Promote queued job for source %s",
+                      source_hash.c_str());
+
+            const uint64_t demand = next_sequence_++;
+            reschedule__unlocked(it->second,
+                                 [demand] (JobSchedule &s) { s.demand_ = demand; });
+            continue;
+        }
+
+        /* job is in progress, move it to the front of its next stage */
+        for(auto &st : stages_)
+        {
+            const auto job(std::find_if(st.jobs_.begin(), st.jobs_.end(),
+                                        [&source_hash] (const auto &j) { return j->source_hash_ == source_hash; }));
+
+            if(job == st.jobs_.end())
+                continue;
+
+            if(job != st.jobs_.begin())
+            {
+                msg_vinfo(MESSAGE_LEVEL_DIAG, "Promote job in progress for source %s",
+                          source_hash.c_str());
+                std::rotate(st.jobs_.begin(), job, std::next(job));
+            }
+
+            break;
+        }
+    }
+}
+
 void Converter::Queue::notify_pending_key_processed(const ArtCache::StreamPrioPair &stream_key,
                                                     const std::string &source_hash,
                                                     ArtCache::AddKeyResult result,
@@ -321,6 +1046,10 @@ void Converter::Queue::notify_pending_key_processed(const ArtCache::StreamPrioPa
         error_code = ArtCache::MonitorError::Code::DOWNLOAD_ERROR;
         break;
 
+      case ArtCache::AddKeyResult::QUEUE_FULL:
+        error_code = monitor_error_queue_full;
+        break;
+
       case ArtCache::AddKeyResult::IO_ERROR:
         error_code = ArtCache::MonitorError::Code::IO_FAILURE;
         break;
@@ -341,15 +1070,130 @@ void Converter::Queue::notify_pending_key_processed(const ArtCache::StreamPrioPa
                                         stream_key.priority_, error_code);
 }
 
-bool Converter::Queue::queue(std::shared_ptr<Converter::Job> &&job)
+/*!
+ * Remove job which has not been started from the queue, report failure.
+ */
+void Converter::Queue::drop_job__unlocked(std::map<std::string, Client>::iterator client,
+                                          JobSet::iterator it,
+                                          ArtCache::AddKeyResult result)
+{
+    auto job(*it);
+
+    client->second.jobs_.erase(it);
+    --queued_jobs_;
+    queued_bytes_ -= job->schedule_.temp_bytes_;
+    jobs_by_source_.erase(job->source_hash_);
+    pending_sources_.remove(job->source_hash_);
+
+    if(client->second.jobs_.empty() && client->second.in_progress_ == 0)
+        clients_.erase(client);
+
+    job->abandon(result, *this);
+}
+
+/*!
+ * Make sure there is space in the queue for another job.
+ *
+ * If the queue is full, then the least important queued job is dropped.
+ * These are jobs no client is waiting for, lowest image priority first,
+ * oldest first. Jobs with higher image priority than the new job are never
+ * dropped in favor of the new job.
+ *
+ * \returns
+ *     True if the new job may be queued, false if it must be rejected.
+ */
+bool Converter::Queue::make_room__unlocked(uint8_t priority, size_t temp_bytes)
+{
+    if(temp_bytes > max_queued_bytes_)
+        return false;
+
+    while(queued_jobs_ >= max_queued_jobs_ ||
+          queued_bytes_ + temp_bytes > max_queued_bytes_)
+    {
+        /* dropping jobs without data does not help against too much data */
+        const bool need_bytes = queued_jobs_ < max_queued_jobs_;
+
+        std::map<std::string, Client>::iterator victim_client(clients_.end());
+        JobSet::iterator victim;
+
+        for(auto c = clients_.begin(); c != clients_.end(); ++c)
+        {
+            for(auto j = c->second.jobs_.begin(); j != c->second.jobs_.end(); ++j)
+            {
+                const auto &s((*j)->schedule_);
+
+                if(s.demand_ > 0 || s.priority_ > priority ||
+                   (need_bytes && s.temp_bytes_ == 0))
+                    continue;
+
+                if(victim_client == clients_.end() ||
+                   s.priority_ < (*victim)->schedule_.priority_ ||
+                   (s.priority_ == (*victim)->schedule_.priority_ &&
+                    s.sequence_ < (*victim)->schedule_.sequence_))
+                {
+                    victim_client = c;
+                    victim = j;
+                }
+            }
+        }
+
+        if(victim_client == clients_.end())
+            return false;
+
+        msg_info("Converter queue full, dropping job for source %s of client %s",
+                 (*victim)->source_hash_.c_str(),
+                 client_name(victim_client->first));
+
+        drop_job__unlocked(victim_client, victim,
+                           ArtCache::AddKeyResult::QUEUE_FULL);
+    }
+
+    return true;
+}
+
+/*!
+ * Put new job into its client's queue.
+ *
+ * Room must have been made by #Converter::Queue::make_room__unlocked()
+ * before.
+ *
+ * \returns
+ *     #ArtCache::AddKeyResult::SOURCE_PENDING on success, an error code
+ *     otherwise.
+ */
+ArtCache::AddKeyResult
+Converter::Queue::queue(std::shared_ptr<Converter::Job> &&job,
+                        const char *client, size_t temp_bytes)
 {
     msg_log_assert(job != nullptr);
     msg_log_assert(job->get_state() == Job::State::DOWNLOAD_IDLE ||
-                   job->get_state() == Job::State::CONVERT_IDLE);
+                   job->get_state() == Job::State::DECODE_IDLE);
     msg_log_assert(pdata_.adding_source_hash_ != nullptr);
 
-    jobs_.emplace_back(std::move(job));
-    job_available_.notify_one();
+    if(!jobs_by_source_.emplace(job->source_hash_, job).second)
+    {
+        MSG_BUG("Source %s queued twice", job->source_hash_.c_str());
+        return ArtCache::AddKeyResult::INTERNAL_ERROR;
+    }
 
-    return true;
+    pending_sources_.add(job->source_hash_);
+
+    Stage stage;
+    job->get_next_stage(stage);
+
+    job->schedule_.sequence_ = next_sequence_++;
+    job->schedule_.client_ = client != nullptr ? client : "";
+    job->schedule_.temp_bytes_ = temp_bytes;
+
+    const auto c(clients_.emplace(job->schedule_.client_, Client()).first);
+    c->second.jobs_.insert(std::move(job));
+    ++queued_jobs_;
+    queued_bytes_ += temp_bytes;
+
+    msg_vinfo(MESSAGE_LEVEL_DEBUG, "Client %s: %zu queued, %zu in progress",
+              client_name(c->first), c->second.jobs_.size(),
+              c->second.in_progress_);
+    stages_[size_t(stage)].job_available_.notify_one();
+
+    return ArtCache::AddKeyResult::SOURCE_PENDING;
 }
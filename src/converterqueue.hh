@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -22,20 +22,86 @@
 #ifndef CONVERTERQUEUE_HH
 #define CONVERTERQUEUE_HH
 
+#include <array>
 #include <mutex>
 #include <condition_variable>
 #include <deque>
+#include <map>
+#include <set>
+#include <vector>
+#include <unordered_map>
 #include <atomic>
 #include <thread>
+#include <memory>
 
 #include "artcache.hh"
 #include "cachetypes.hh"
 #include "pending.hh"
 #include "formats.hh"
+#include "imageconvert.hh"
+#include "spawnhelper.hh"
+#include "fetcher.hh"
 
 namespace Converter
 {
 
+/*!
+ * Sources the converter queue is working on, as seen by cache lookups.
+ *
+ * The cache manager asks for pending sources while holding its own lock,
+ * but the queue calls into the cache manager while holding the queue lock.
+ * Lookups therefore must not take the queue lock. The information they
+ * need is kept here behind a lock of its own, which is never held while
+ * taking any other lock.
+ */
+class PendingSources
+{
+  private:
+    mutable std::mutex lock_;
+
+    /* number of reasons for each source to be considered pending */
+    std::unordered_map<std::string, unsigned int> sources_;
+
+    /* sources clients are waiting for, most recent request last */
+    std::vector<std::string> demanded_;
+
+    /* stream keys of image data passed in, but not hashed yet */
+    std::map<std::pair<std::string, uint8_t>, unsigned int> keys_;
+
+  public:
+    PendingSources(const PendingSources &) = delete;
+    PendingSources &operator=(const PendingSources &) = delete;
+
+    explicit PendingSources() {}
+
+    void add(const std::string &source_hash);
+    void remove(const std::string &source_hash);
+    bool contains(const std::string &source_hash) const;
+
+    /*!
+     * Remember that a client is waiting for given source.
+     *
+     * The request is carried out by the queue next time it is looking for
+     * work, see #Converter::PendingSources::take_demanded().
+     */
+    void demand(const std::string &source_hash);
+    std::vector<std::string> take_demanded();
+
+    void add_key(const std::string &stream_key, uint8_t priority);
+    void remove_key(const std::string &stream_key, uint8_t priority);
+
+    /*!
+     * Check if image data for given stream key is about to be added.
+     *
+     * \param stream_key
+     *     The stream key to check.
+     *
+     * \param priority
+     *     Priority of the stream key, or 0 for any priority.
+     */
+    bool contains_key(const std::string &stream_key, uint8_t priority) const;
+};
+
 class PendingData
 {
   public:
@@ -43,30 +109,47 @@ class PendingData
     {
       private:
         const std::string *&string_ptr_;
+        PendingSources &sources_;
 
       public:
         Guard(const Guard &) = delete;
         Guard(Guard &&) = default;
         Guard &operator=(const Guard &) = delete;
 
-        explicit Guard(const std::string *&sptr): string_ptr_(sptr) {}
-        ~Guard() { string_ptr_ = nullptr; }
+        explicit Guard(const std::string *&sptr, PendingSources &sources):
+            string_ptr_(sptr),
+            sources_(sources)
+        {}
+
+        ~Guard()
+        {
+            if(string_ptr_ != nullptr)
+                sources_.remove(*string_ptr_);
+
+            string_ptr_ = nullptr;
+        }
     };
 
     /* set while a possibly new entry is about to be added to the cache */
     const std::string *adding_source_hash_;
 
+  private:
+    PendingSources &sources_;
+
+  public:
     PendingData(const PendingData &) = delete;
     PendingData &operator=(const PendingData &) = delete;
 
-    explicit PendingData():
-        adding_source_hash_(nullptr)
+    explicit PendingData(PendingSources &sources):
+        adding_source_hash_(nullptr),
+        sources_(sources)
     {}
 
     Guard earmark_add_source(const std::string &source_hash)
     {
         adding_source_hash_ = &source_hash;
-        return Guard(adding_source_hash_);
+        sources_.add(source_hash);
+        return Guard(adding_source_hash_, sources_);
     }
 };
 
@@ -76,6 +159,9 @@ class DownloadData
     const std::string source_uri_;
     const std::string &output_file_name_;
 
+    /* hash of the downloaded data, computed while downloading */
+    std::string content_hash_;
+
     DownloadData(const DownloadData &) = delete;
     DownloadData(DownloadData &&) = default;
     DownloadData &operator=(const DownloadData &) = delete;
@@ -111,15 +197,84 @@ class ConvertData
     {}
 };
 
+/*!
+ * Pipeline stages a job passes through.
+ *
+ * Each stage has its own worker threads so that different jobs can be in
+ * different stages at the same time.
+ */
+enum class Stage
+{
+    FETCH,
+    DECODE,
+    ENCODE,
+    IMPORT,
+
+    LAST_STAGE = IMPORT,
+};
+
+/*!
+ * Scheduling attributes of a job waiting in #Converter::Queue.
+ *
+ * Protected by the queue's lock, not by the job's lock.
+ */
+class JobSchedule
+{
+  public:
+    /*! Sequence number of the most recent demand by a client, 0 if none. */
+    uint64_t demand_;
+
+    /*! Highest priority of all keys attached to the job. */
+    uint8_t priority_;
+
+    /*! Order of arrival. */
+    uint64_t sequence_;
+
+    /*! D-Bus name of the client which has added the job. */
+    std::string client_;
+
+    /*! Size of input data stored in the temporary directory while queued. */
+    size_t temp_bytes_;
+
+    explicit JobSchedule(uint8_t priority):
+        demand_(0),
+        priority_(priority),
+        sequence_(0),
+        temp_bytes_(0)
+    {}
+
+    /*!
+     * Strict weak ordering, jobs to be executed first are less.
+     *
+     * Jobs clients are waiting for come first, most recently demanded job
+     * first. Jobs of higher image priority come next, and remaining ties are
+     * broken by order of arrival.
+     */
+    bool goes_before(const JobSchedule &other) const
+    {
+        if(demand_ != other.demand_)
+            return demand_ > other.demand_;
+
+        if(priority_ != other.priority_)
+            return priority_ > other.priority_;
+
+        return sequence_ < other.sequence_;
+    }
+};
+
 class Job
 {
   public:
     enum class State
     {
         DOWNLOAD_IDLE,
-        DOWNLOADING_AND_CONVERTING,
-        CONVERT_IDLE,
-        CONVERTING,
+        DOWNLOADING,
+        DECODE_IDLE,
+        DECODING,
+        ENCODE_IDLE,
+        ENCODING,
+        IMPORT_IDLE,
+        IMPORTING,
         DONE_OK,
         DONE_ERROR,
     };
@@ -133,22 +288,35 @@ class Job
         INPUT_ERROR,
         CONVERSION_ERROR,
         INTERNAL_ERROR,
+        CANCELED,
     };
 
     const std::string source_hash_;
 
+    /*! Managed by #Converter::Queue. */
+    JobSchedule schedule_;
+
   private:
+    /* never held while calling into the cache manager, which calls back into
+     * the job while holding its own lock */
     mutable std::mutex lock_;
 
     State state_;
 
     ArtCache::Manager &cache_manager_;
+    const SpawnHelper &spawner_;
+    const Fetcher &fetcher_;
     std::vector<std::pair<ArtCache::StreamPrioPair, ArtCache::AddKeyResult>> pending_stream_keys_;
 
     const std::string temp_file_name_;
     DownloadData download_data_;
     ConvertData convert_data_;
-    const std::string script_name_;
+
+    /* decoded and scaled images, one per output format */
+    std::vector<RGBAImage> renditions_;
+
+    /* terminates external tools, skips remaining stages */
+    SpawnCancel cancel_;
 
   public:
     Job(const Job &) = delete;
@@ -160,15 +328,18 @@ class Job
     explicit Job(std::string &&temp_dir, const std::string &temp_file_name,
                  const char *uri, std::string &&source_hash,
                  ArtCache::StreamPrioPair &&first_pending_key,
-                 ArtCache::Manager &cache_manager):
+                 ArtCache::Manager &cache_manager, const SpawnHelper &spawner,
+                 const Fetcher &fetcher):
         source_hash_(std::move(source_hash)),
+        schedule_(first_pending_key.priority_),
         state_(State::DOWNLOAD_IDLE),
         cache_manager_(cache_manager),
+        spawner_(spawner),
+        fetcher_(fetcher),
         temp_file_name_(temp_file_name),
         download_data_(uri, temp_file_name_),
         convert_data_(temp_file_name_, std::move(temp_dir),
-                      get_output_format_list().get_formats()),
-        script_name_(convert_data_.output_directory_ + "/job.sh")
+                      get_output_format_list().get_formats())
     {
         pending_stream_keys_.emplace_back(std::move(std::make_pair(std::move(first_pending_key),
                                                                    ArtCache::AddKeyResult::SOURCE_UNKNOWN)));
@@ -180,15 +351,18 @@ class Job
     explicit Job(std::string &&temp_dir, const std::string &temp_file_name,
                  std::string &&source_hash,
                  ArtCache::StreamPrioPair &&first_pending_key,
-                 ArtCache::Manager &cache_manager):
+                 ArtCache::Manager &cache_manager, const SpawnHelper &spawner,
+                 const Fetcher &fetcher):
         source_hash_(std::move(source_hash)),
-        state_(State::CONVERT_IDLE),
+        schedule_(first_pending_key.priority_),
+        state_(State::DECODE_IDLE),
         cache_manager_(cache_manager),
+        spawner_(spawner),
+        fetcher_(fetcher),
         temp_file_name_(temp_file_name),
         download_data_(temp_file_name_),
         convert_data_(temp_file_name_, std::move(temp_dir),
-                      get_output_format_list().get_formats()),
-        script_name_(convert_data_.output_directory_ + "/job.sh")
+                      get_output_format_list().get_formats())
     {
         pending_stream_keys_.emplace_back(std::move(std::make_pair(std::move(first_pending_key),
                                                                    ArtCache::AddKeyResult::SOURCE_UNKNOWN)));
@@ -196,14 +370,72 @@ class Job
 
     State get_state() const;
 
-    void add_pending_key(const ArtCache::StreamPrioPair &sp);
+    /*!
+     * Pipeline stage the job is waiting for.
+     *
+     * \returns
+     *     False if the job is done or busy, true if \p stage has been set.
+     */
+    bool get_next_stage(Stage &stage) const;
+
+    /*!
+     * Add key which should refer to the job's source once it is complete.
+     *
+     * \returns
+     *     False if the job is done already, so that the key has not been
+     *     added.
+     */
+    bool add_pending_key(const ArtCache::StreamPrioPair &sp);
+
+    /*!
+     * Remove key which does not refer to the job's source any more.
+     *
+     * \returns
+     *     True if the job has no pending keys left, i.e., if there is no
+     *     point in executing it.
+     */
+    bool remove_pending_key(const ArtCache::StreamPrioPair &sp);
+
+    /*!
+     * Abort job as soon as possible.
+     *
+     * External tools run by the job are terminated, and the job fails when
+     * it is executed next. This function is thread-safe and does not block.
+     */
+    void cancel() { cancel_.trigger(); }
 
+    /*!
+     * Execute the stage the job is waiting for.
+     *
+     * The job is moved to the next idle state, or to one of the done states
+     * after the last stage or in case of any error.
+     */
     void execute();
     void finalize(ArtCache::PendingIface &pending);
 
+    /*!
+     * Give up on a job which has not been started.
+     *
+     * All pending keys are reported as failed with \p result, and temporary
+     * files are removed.
+     */
+    void abandon(ArtCache::AddKeyResult result, ArtCache::PendingIface &pending);
+
   private:
     Result do_execute(std::unique_lock<std::mutex> &lock);
 
+    Result fetch();
+    Result link_to_cached_content(std::unique_lock<std::mutex> &lock,
+                                  bool &is_linked);
+    Result decode(State &next_state);
+    Result encode();
+    Result import(std::unique_lock<std::mutex> &lock);
+
+    template <typename F>
+    bool link_pending_keys(std::unique_lock<std::mutex> &lock,
+                           const std::string &source_hash, Result &result,
+                           const F &first_round);
+
   public:
     static Result clean_up(const std::string &workdir);
     static bool write_data_to_file(const uint8_t *data, size_t length,
@@ -213,41 +445,228 @@ class Job
 class Queue: public ArtCache::PendingIface
 {
   private:
+    /* taken before the cache manager lock, never after it; cache lookups
+     * use #Converter::Queue::pending_sources_ instead */
     mutable std::mutex lock_;
 
-    std::condition_variable job_available_;
-    std::deque<std::shared_ptr<Job>> jobs_;
+    class ScheduleOrder
+    {
+      public:
+        bool operator()(const std::shared_ptr<Job> &a,
+                        const std::shared_ptr<Job> &b) const
+        {
+            return a->schedule_.goes_before(b->schedule_);
+        }
+    };
+
+    using JobSet = std::set<std::shared_ptr<Job>, ScheduleOrder>;
+
+    class Client
+    {
+      public:
+        /* new jobs, waiting for their first stage, in order of execution */
+        JobSet jobs_;
+
+        /* jobs taken from the queue by the workers, up to finalization */
+        size_t in_progress_;
+
+        Client(const Client &) = delete;
+        Client(Client &&) = default;
+        Client &operator=(const Client &) = delete;
+
+        explicit Client(): in_progress_(0) {}
+    };
+
+    /* new jobs of each client, removed when the client has no more jobs */
+    std::map<std::string, Client> clients_;
+
+    /* source of sequence numbers for #Converter::JobSchedule */
+    uint64_t next_sequence_;
+
+    /* admission control for #Converter::Queue::clients_ */
+    const size_t max_queued_jobs_;
+    const size_t max_queued_bytes_;
+    size_t queued_jobs_;
+    size_t queued_bytes_;
+
+    /* all jobs in #Converter::Queue::clients_, indexed by source hash */
+    std::unordered_map<std::string, std::shared_ptr<Job>> jobs_by_source_;
+
+    /* sources of queued and running jobs, and the source being added */
+    PendingSources pending_sources_;
+
+    /* keys deleted from the cache, possibly without holding the queue lock,
+     * see #Converter::Queue::notify_key_deleted() */
+    std::mutex deleted_keys_lock_;
+    std::vector<std::pair<ArtCache::StreamPrioPair, std::string>> deleted_keys_;
+
     std::atomic<bool> shutdown_request_;
 
-    std::shared_ptr<Job> running_job_;
-    std::thread worker_;
+    /* jobs taken from the queue by the workers, up to finalization */
+    std::vector<std::shared_ptr<Job>> running_jobs_;
+
+    class PipelineStage
+    {
+      public:
+        /* jobs which have passed the previous stage, bounded in size */
+        std::deque<std::shared_ptr<Job>> jobs_;
+
+        /* client whose new job has been taken last for this stage */
+        std::string last_client_;
+
+        std::condition_variable job_available_;
+        std::condition_variable space_available_;
+    };
+
+    std::array<PipelineStage, size_t(Stage::LAST_STAGE) + 1> stages_;
+
+    const unsigned int number_of_workers_;
+    std::vector<std::thread> workers_;
+
+    SpawnHelper spawner_;
+    Fetcher fetcher_;
 
     const std::string temp_dir_;
     PendingData pdata_;
 
+    class DataIntake
+    {
+      public:
+        ArtCache::Manager &cache_manager_;
+        ArtCache::StreamPrioPair sp_;
+        std::shared_ptr<const ArtCache::ObjectData> data_;
+        std::string client_;
+
+        DataIntake(const DataIntake &) = delete;
+        DataIntake(DataIntake &&) = default;
+        DataIntake &operator=(const DataIntake &) = delete;
+
+        explicit DataIntake(ArtCache::Manager &cache_manager,
+                            ArtCache::StreamPrioPair &&sp,
+                            std::shared_ptr<const ArtCache::ObjectData> &&data,
+                            const char *client):
+            cache_manager_(cache_manager),
+            sp_(std::move(sp)),
+            data_(std::move(data)),
+            client_(client)
+        {}
+    };
+
+    /* image data passed in by clients, hashed and stored by intake thread;
+     * counted against #Converter::Queue::max_queued_bytes_ */
+    std::deque<DataIntake> intake_;
+    size_t intake_bytes_;
+    std::condition_variable intake_available_;
+    std::thread intake_thread_;
+
   public:
     Queue(const Queue &) = delete;
     Queue &operator=(const Queue &) = delete;
 
-    explicit Queue(const char *cache_root):
+    /*!
+     * Constructor.
+     *
+     * \param cache_root
+     *     Path to cache root, temporary files are put into a subdirectory.
+     *
+     * \param number_of_workers
+     *     Number of jobs executed in parallel in each of the fetch, decode,
+     *     and encode stages, also the number of jobs which may wait between
+     *     two stages. Values less than 1 are treated as 1.
+     *
+     * \param max_queued_jobs
+     *     Maximum number of jobs waiting to be started. Values less than 1
+     *     are treated as 1.
+     *
+     * \param max_queued_bytes
+     *     Maximum number of bytes of image data stored in the temporary
+     *     directory for jobs waiting to be started.
+     */
+    explicit Queue(const char *cache_root, unsigned int number_of_workers,
+                   size_t max_queued_jobs, size_t max_queued_bytes):
+        next_sequence_(1),
+        max_queued_jobs_(max_queued_jobs > 0 ? max_queued_jobs : 1),
+        max_queued_bytes_(max_queued_bytes),
+        queued_jobs_(0),
+        queued_bytes_(0),
         shutdown_request_(false),
-        running_job_(nullptr),
-        temp_dir_(std::string(cache_root) + "/.tmp")
+        number_of_workers_(number_of_workers > 0 ? number_of_workers : 1),
+        temp_dir_(std::string(cache_root) + "/.tmp"),
+        pdata_(pending_sources_),
+        intake_bytes_(0)
     {}
 
     void init();
     void shutdown();
 
+    /*!
+     * Add image to cache, download and convert it if necessary.
+     *
+     * \param cache_manager
+     *     The cache to add the image to.
+     *
+     * \param sp
+     *     Stream key and image priority.
+     *
+     * \param uri
+     *     Where to download the image from.
+     *
+     * \param client
+     *     D-Bus name of the client which has requested the image. Jobs of
+     *     different clients are served in a round-robin fashion, so that a
+     *     client adding many images does not delay images added by others.
+     */
     void add_to_cache_by_uri(ArtCache::Manager &cache_manager,
-                             ArtCache::StreamPrioPair &&sp, const char *uri);
+                             ArtCache::StreamPrioPair &&sp, const char *uri,
+                             const char *client);
+
+    /*!
+     * Add image to cache, convert it if necessary.
+     *
+     * This function does not block. The data is hashed and written to the
+     * temporary directory in a single pass by a background thread, and
+     * only if its source is not known yet is it moved to the job's working
+     * directory. The stream key is associated with the image only after
+     * the data has been hashed, but it is marked pending right away, so
+     * lookups of a key not in the cache report it as busy until then.
+     *
+     * Data waiting to be processed counts against the maximum number of
+     * queued bytes. If there is not enough room for \p data, then the
+     * image is rejected right away.
+     *
+     * \param cache_manager
+     *     The cache to add the image to.
+     *
+     * \param sp
+     *     Stream key and image priority.
+     *
+     * \param data
+     *     Image data, referenced until it has been processed.
+     *
+     * \param client
+     *     D-Bus name of the client which has sent the image.
+     */
     void add_to_cache_by_data(ArtCache::Manager &cache_manager,
                               ArtCache::StreamPrioPair &&sp,
-                              const uint8_t *data, size_t length);
+                              std::shared_ptr<const ArtCache::ObjectData> &&data,
+                              const char *client);
 
-    bool is_source_pending(const std::string &source_hash, bool exclude_current) const override;
+    /*!
+     * Log number of queued and running jobs per client.
+     */
+    void dump_client_statistics() const;
+
+    bool is_source_pending(const std::string &source_hash) const override;
+    bool is_stream_key_pending(const std::string &stream_key,
+                               uint8_t priority) const override;
     bool is_source_pending__unlocked(const std::string &source_hash, bool exclude_current) const override;
     bool add_key_to_pending_source(const ArtCache::StreamPrioPair &stream_key,
                                    const std::string &source_hash) override;
+    void promote_pending_source(const std::string &source_hash) override;
+    void notify_key_unlinked__unlocked(const ArtCache::StreamPrioPair &stream_key,
+                                       const std::string &source_hash) override;
+    void notify_key_deleted(const ArtCache::StreamPrioPair &stream_key,
+                            const std::string &source_hash) override;
 
     // cppcheck-suppress functionStatic
     void notify_pending_key_processed(const ArtCache::StreamPrioPair &stream_key,
@@ -256,9 +675,27 @@ class Queue: public ArtCache::PendingIface
                                       ArtCache::Manager &cache_manager) override;
 
   private:
-    bool queue(std::shared_ptr<Job> &&job);
-
-    void worker_main();
+    bool make_room__unlocked(uint8_t priority, size_t temp_bytes);
+    ArtCache::AddKeyResult queue(std::shared_ptr<Job> &&job, const char *client,
+                                 size_t temp_bytes);
+    void drop_job__unlocked(std::map<std::string, Client>::iterator client,
+                            JobSet::iterator it, ArtCache::AddKeyResult result);
+
+    const std::shared_ptr<Job> *find_running_job__unlocked(const std::string &source_hash) const;
+
+    template <typename F>
+    void reschedule__unlocked(const std::shared_ptr<Job> &job, const F &modify);
+    void promote_demanded__unlocked();
+    void process_deleted_keys__unlocked();
+
+    std::shared_ptr<Job> take_job__unlocked(Stage stage);
+    void job_finished__unlocked(const std::shared_ptr<Job> &job);
+    bool pass_job_on__unlocked(std::shared_ptr<Job> &&job, Stage stage,
+                               std::unique_lock<std::mutex> &qlock);
+
+    void worker_main(Stage stage);
+    void intake_main();
+    void ingest_data(DataIntake &req);
 };
 
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2021, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2021, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -26,6 +26,10 @@
 #include <cstring>
 #include <cerrno>
 
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD
+#include <gio/gunixfdlist.h>
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD */
+
 #include "dbus_handlers.h"
 #include "dbus_handlers.hh"
 #include "de_tahifi_artcache_errors.hh"
@@ -97,6 +101,68 @@ GVariant *DBus::hexstring_to_variant(const std::string &str)
     }
 }
 
+static void release_object_data(gpointer user_data)
+{
+    delete static_cast<std::shared_ptr<const ArtCache::ObjectData> *>(user_data);
+}
+
+/*!
+ * Wrap object data into a \c GVariant without copying it.
+ *
+ * The returned variant holds a reference to the object data, so the data
+ * stays valid until the variant has been sent and freed, regardless of the
+ * lifetime of \p obj.
+ */
+static GVariant *object_data_to_variant(const ArtCache::Object &obj)
+{
+    auto *ref = new std::shared_ptr<const ArtCache::ObjectData>(obj.share_data());
+    GBytes *bytes = g_bytes_new_with_free_func(obj.data(), obj.size(),
+                                               release_object_data, ref);
+    GVariant *result = g_variant_new_from_bytes(G_VARIANT_TYPE("ay"), bytes, TRUE);
+    g_bytes_unref(bytes);
+
+    return result;
+}
+
+/*!
+ * Image data received over D-Bus, referenced without copying it.
+ *
+ * Holds a reference to the \c GVariant so that the data can be processed
+ * after the D-Bus method handler has returned.
+ */
+class VariantObjectData: public ArtCache::ObjectData
+{
+  private:
+    GVariant *variant_;
+    const uint8_t *data_;
+    size_t size_;
+
+  public:
+    VariantObjectData(const VariantObjectData &) = delete;
+    VariantObjectData &operator=(const VariantObjectData &) = delete;
+
+    explicit VariantObjectData(GVariant *variant, gconstpointer data, gsize size):
+        variant_(g_variant_ref(variant)),
+        data_(static_cast<const uint8_t *>(data)),
+        size_(size)
+    {}
+
+    ~VariantObjectData() override { g_variant_unref(variant_); }
+
+    const uint8_t *data() const override { return data_; }
+    size_t size() const override { return size_; }
+};
+
+/*
+ * Name of the client which has called a method, saved before the invocation
+ * object is consumed by completing the call.
+ */
+static std::string get_client_name(GDBusMethodInvocation *invocation)
+{
+    const char *sender = g_dbus_method_invocation_get_sender(invocation);
+    return sender != nullptr ? sender : "";
+}
+
 static bool check_priority(GDBusMethodInvocation *invocation,
                            guchar image_priority)
 {
@@ -177,6 +243,62 @@ static void enter_artcache_read_handler(GDBusMethodInvocation *invocation)
               g_dbus_method_invocation_get_method_name(invocation));
 }
 
+static ArtCache::ReadError::Code
+lookup_result_to_read_error(const ArtCache::LookupResult result,
+                            const std::unique_ptr<ArtCache::Object> &obj,
+                            const std::string &key_string)
+{
+    switch(result)
+    {
+      case ArtCache::LookupResult::FOUND:
+        msg_log_assert(obj != nullptr);
+        return (obj->empty()
+                ? ArtCache::ReadError::Code::OK
+                : ArtCache::ReadError::Code::UNCACHED);
+
+      case ArtCache::LookupResult::KEY_UNKNOWN:
+        msg_log_assert(obj == nullptr);
+        return ArtCache::ReadError::Code::KEY_UNKNOWN;
+
+      case ArtCache::LookupResult::PENDING:
+        msg_log_assert(obj == nullptr);
+        return ArtCache::ReadError::Code::BUSY;
+
+      case ArtCache::LookupResult::FORMAT_NOT_SUPPORTED:
+        msg_log_assert(obj == nullptr);
+        return ArtCache::ReadError::Code::FORMAT_NOT_SUPPORTED;
+
+      case ArtCache::LookupResult::ORPHANED:
+        msg_log_assert(obj == nullptr);
+        msg_info("Orphaned key %s", key_string.c_str());
+        return ArtCache::ReadError::Code::KEY_UNKNOWN;
+
+      case ArtCache::LookupResult::IO_ERROR:
+        msg_log_assert(obj == nullptr);
+        return ArtCache::ReadError::Code::IO_FAILURE;
+    }
+
+    return ArtCache::ReadError::Code::INTERNAL;
+}
+
+static void object_to_variants(const std::unique_ptr<ArtCache::Object> &obj,
+                               GVariant *&hash_variant, GVariant *&data_variant)
+{
+    if(obj == nullptr || obj->empty())
+    {
+        static const std::string empty;
+        hash_variant = DBus::hexstring_to_variant(empty);
+        data_variant = DBus::hexstring_to_variant(empty);
+    }
+    else
+    {
+        msg_log_assert(!obj->hash_.empty());
+
+        hash_variant = DBus::hexstring_to_variant(obj->hash_);
+        data_variant = object_data_to_variant(*obj);
+    }
+}
+
 gboolean dbusmethod_cache_get_scaled_image(tdbusArtCacheRead *object,
                                            GDBusMethodInvocation *invocation,
                                            GVariant *stream_key, const char *format,
@@ -215,76 +337,208 @@ gboolean dbusmethod_cache_get_scaled_image(tdbusArtCacheRead *object,
                                   static_cast<const uint8_t *>(object_hash_bytes),
                                   object_hash_length);
 
-    auto error_code = ArtCache::ReadError::Code::INTERNAL;
-    guchar priority = 0;
-
     std::unique_ptr<ArtCache::Object> obj;
 
-    switch(data->cache_manager_.lookup(key_string, object_hash_string,
-                                       format, obj))
-    {
-      case ArtCache::LookupResult::FOUND:
-        msg_log_assert(obj != nullptr);
-        error_code = (obj->data().empty()
-                      ? ArtCache::ReadError::Code::OK
-                      : ArtCache::ReadError::Code::UNCACHED);
-        priority = obj->priority_;
-        break;
+    const auto error_code =
+        lookup_result_to_read_error(data->cache_manager_.lookup(key_string,
+                                                                object_hash_string,
+                                                                format, obj),
+                                    obj, key_string);
+    const guchar priority = (obj != nullptr) ? obj->priority_ : 0;
 
-      case ArtCache::LookupResult::KEY_UNKNOWN:
-        msg_log_assert(obj == nullptr);
-        error_code = ArtCache::ReadError::Code::KEY_UNKNOWN;
-        break;
+    GVariant *hash_variant;
+    GVariant *data_variant;
+    object_to_variants(obj, hash_variant, data_variant);
 
-      case ArtCache::LookupResult::PENDING:
-        msg_log_assert(obj == nullptr);
-        error_code = ArtCache::ReadError::Code::BUSY;
-        break;
+    tdbus_art_cache_read_complete_get_scaled_image_data(object, invocation,
+                                                        error_code, priority,
+                                                        hash_variant,
+                                                        data_variant);
 
-      case ArtCache::LookupResult::FORMAT_NOT_SUPPORTED:
-        msg_log_assert(obj == nullptr);
-        error_code = ArtCache::ReadError::Code::FORMAT_NOT_SUPPORTED;
-        break;
+    return TRUE;
+}
 
-      case ArtCache::LookupResult::ORPHANED:
-        msg_log_assert(obj == nullptr);
-        msg_info("Orphaned key %s", key_string.c_str());
-        error_code = ArtCache::ReadError::Code::KEY_UNKNOWN;
-        break;
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD
+gboolean dbusmethod_cache_get_scaled_image_fd(tdbusArtCacheRead *object,
+                                              GDBusMethodInvocation *invocation,
+                                              GUnixFDList *fd_list,
+                                              GVariant *stream_key,
+                                              const char *format,
+                                              GVariant *hash, gpointer user_data)
+{
+    enter_artcache_read_handler(invocation);
 
-      case ArtCache::LookupResult::IO_ERROR:
-        msg_log_assert(obj == nullptr);
-        error_code = ArtCache::ReadError::Code::IO_FAILURE;
-        break;
-    }
+    gconstpointer stream_key_bytes;
+    gsize stream_key_length;
+
+    if(!check_key_param(invocation, stream_key,
+                        stream_key_bytes, stream_key_length))
+        return TRUE;
+
+    gconstpointer object_hash_bytes;
+    gsize object_hash_length;
+
+    if(!check_object_hash_param(invocation, hash,
+                                object_hash_bytes, object_hash_length))
+        return TRUE;
+
+    auto *data = static_cast<DBus::SignalData *>(user_data);
+    msg_log_assert(data != nullptr);
+
+    std::string key_string;
+    DBus::binary_to_hexstring(key_string,
+                              static_cast<const uint8_t *>(stream_key_bytes),
+                              stream_key_length);
+
+    std::string object_hash_string;
+
+    if(object_hash_length > 0)
+        DBus::binary_to_hexstring(object_hash_string,
+                                  static_cast<const uint8_t *>(object_hash_bytes),
+                                  object_hash_length);
+
+    std::unique_ptr<ArtCache::Object> obj;
+    int fd = -1;
+
+    const auto result = data->cache_manager_.lookup_fd(key_string,
+                                                       object_hash_string,
+                                                       format, obj, fd);
+    auto error_code = lookup_result_to_read_error(result, obj, key_string);
+
+    if(result == ArtCache::LookupResult::FOUND && fd >= 0)
+        error_code = ArtCache::ReadError::Code::UNCACHED;
+
+    const guchar priority = (obj != nullptr) ? obj->priority_ : 0;
 
     GVariant *hash_variant;
-    GVariant *data_variant;
+    GUnixFDList *out_fd_list = nullptr;
+    gint fd_index = -1;
 
-    if(obj == nullptr || obj->data().empty())
+    if(fd < 0)
     {
         static const std::string empty;
         hash_variant = DBus::hexstring_to_variant(empty);
-        data_variant = DBus::hexstring_to_variant(empty);
     }
     else
     {
+        msg_log_assert(obj != nullptr);
         msg_log_assert(!obj->hash_.empty());
 
         hash_variant = DBus::hexstring_to_variant(obj->hash_);
-        data_variant = g_variant_new_fixed_array(G_VARIANT_TYPE_BYTE,
-                                                 obj->data().data(),
-                                                 obj->data().size(),
-                                                 sizeof(uint8_t));
+
+        /* the list takes ownership of the file descriptor */
+        out_fd_list = g_unix_fd_list_new_from_array(&fd, 1);
+        fd_index = 0;
     }
 
-    tdbus_art_cache_read_complete_get_scaled_image_data(object, invocation,
-                                                        error_code, priority,
-                                                        hash_variant,
-                                                        data_variant);
+    tdbus_art_cache_read_complete_get_scaled_image_fd(object, invocation,
+                                                      out_fd_list,
+                                                      error_code, priority,
+                                                      hash_variant,
+                                                      g_variant_new_handle(fd_index));
+
+    if(out_fd_list != nullptr)
+        g_object_unref(out_fd_list);
+
+    return TRUE;
+}
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD */
+
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA
+gboolean dbusmethod_cache_get_scaled_images(tdbusArtCacheRead *object,
+                                            GDBusMethodInvocation *invocation,
+                                            GVariant *requests,
+                                            gpointer user_data)
+{
+    enter_artcache_read_handler(invocation);
+
+    static constexpr size_t MAXIMUM_BATCH_SIZE = 256;
+
+    if(g_variant_n_children(requests) > MAXIMUM_BATCH_SIZE)
+    {
+        g_dbus_method_invocation_return_error(invocation,
+                                              G_DBUS_ERROR, G_DBUS_ERROR_INVALID_ARGS,
+                                              "Too many requests (maximum is %zu)",
+                                              MAXIMUM_BATCH_SIZE);
+        return TRUE;
+    }
+
+    std::vector<ArtCache::LookupRequest> lookups;
+    lookups.reserve(g_variant_n_children(requests));
+
+    GVariantIter iter;
+    g_variant_iter_init(&iter, requests);
+
+    GVariant *stream_key;
+    const gchar *format;
+    GVariant *hash;
+
+    while(g_variant_iter_next(&iter, "(@ay&s@ay)", &stream_key, &format, &hash))
+    {
+        gconstpointer stream_key_bytes;
+        gsize stream_key_length;
+        gconstpointer object_hash_bytes;
+        gsize object_hash_length;
+
+        const bool params_ok =
+            check_key_param(invocation, stream_key,
+                            stream_key_bytes, stream_key_length) &&
+            check_object_hash_param(invocation, hash,
+                                    object_hash_bytes, object_hash_length);
+
+        if(params_ok)
+        {
+            std::string key_string;
+            DBus::binary_to_hexstring(key_string,
+                                      static_cast<const uint8_t *>(stream_key_bytes),
+                                      stream_key_length);
+
+            std::string object_hash_string;
+
+            if(object_hash_length > 0)
+                DBus::binary_to_hexstring(object_hash_string,
+                                          static_cast<const uint8_t *>(object_hash_bytes),
+                                          object_hash_length);
+
+            lookups.emplace_back(std::move(key_string),
+                                 std::move(object_hash_string), format);
+        }
+
+        g_variant_unref(stream_key);
+        g_variant_unref(hash);
+
+        if(!params_ok)
+            return TRUE;
+    }
+
+    auto *data = static_cast<DBus::SignalData *>(user_data);
+    msg_log_assert(data != nullptr);
+
+    data->cache_manager_.lookup(lookups);
+
+    GVariantBuilder builder;
+    g_variant_builder_init(&builder, G_VARIANT_TYPE("a(yyayay)"));
+
+    for(const auto &req : lookups)
+    {
+        GVariant *hash_variant;
+        GVariant *data_variant;
+        object_to_variants(req.obj_, hash_variant, data_variant);
+
+        g_variant_builder_add(&builder, "(yy@ay@ay)",
+                              guchar(lookup_result_to_read_error(req.result_,
+                                                                 req.obj_,
+                                                                 req.stream_key_)),
+                              guchar(req.obj_ != nullptr ? req.obj_->priority_ : 0),
+                              hash_variant, data_variant);
+    }
+
+    tdbus_art_cache_read_complete_get_scaled_images_data(object, invocation,
+                                                         g_variant_builder_end(&builder));
 
     return TRUE;
 }
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA */
 
 static void enter_artcache_write_handler(GDBusMethodInvocation *invocation)
 {
@@ -320,6 +574,7 @@ gboolean dbusmethod_cache_add_by_uri(tdbusArtCacheWrite *object,
                         stream_key_bytes, stream_key_length))
         return TRUE;
 
+    const auto client(get_client_name(invocation));
     tdbus_art_cache_write_complete_add_image_by_uri(object, invocation);
 
     auto *data = static_cast<DBus::SignalData *>(user_data);
@@ -333,7 +588,7 @@ gboolean dbusmethod_cache_add_by_uri(tdbusArtCacheWrite *object,
     data->image_converter_queue_.add_to_cache_by_uri(
         data->cache_manager_,
         std::move(ArtCache::StreamPrioPair(std::move(key), image_priority)),
-        image_uri);
+        image_uri, client.c_str());
 
     return TRUE;
 }
@@ -367,6 +622,7 @@ gboolean dbusmethod_cache_add_by_data(tdbusArtCacheWrite *object,
                         stream_key_bytes, stream_key_length))
         return TRUE;
 
+    const auto client(get_client_name(invocation));
     tdbus_art_cache_write_complete_add_image_by_data(object, invocation);
 
     auto *data = static_cast<DBus::SignalData *>(user_data);
@@ -380,8 +636,8 @@ gboolean dbusmethod_cache_add_by_data(tdbusArtCacheWrite *object,
     data->image_converter_queue_.add_to_cache_by_data(
         data->cache_manager_,
         std::move(ArtCache::StreamPrioPair(std::move(key), image_priority)),
-        static_cast<const uint8_t *>(image_bytes),
-        image_length);
+        std::make_shared<VariantObjectData>(image_data, image_bytes, image_length),
+        client.c_str());
 
     return TRUE;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -40,6 +40,20 @@ gboolean dbusmethod_cache_get_scaled_image(tdbusArtCacheRead *object,
                                            GDBusMethodInvocation *invocation,
                                            GVariant *stream_key, const char *format,
                                            GVariant *hash, gpointer user_data);
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD
+gboolean dbusmethod_cache_get_scaled_image_fd(tdbusArtCacheRead *object,
+                                              GDBusMethodInvocation *invocation,
+                                              GUnixFDList *fd_list,
+                                              GVariant *stream_key,
+                                              const char *format,
+                                              GVariant *hash, gpointer user_data);
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD */
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA
+gboolean dbusmethod_cache_get_scaled_images(tdbusArtCacheRead *object,
+                                            GDBusMethodInvocation *invocation,
+                                            GVariant *requests,
+                                            gpointer user_data);
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA */
 
 gboolean dbusmethod_cache_add_by_uri(tdbusArtCacheWrite *object,
                                      GDBusMethodInvocation *invocation,
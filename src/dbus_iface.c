@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020, 2022  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2022, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -87,6 +87,14 @@ static void bus_acquired(GDBusConnection *connection,
 
     g_signal_connect(data->artcache_read_iface, "handle-get-scaled-image-data",
                      G_CALLBACK(dbusmethod_cache_get_scaled_image), data->handler_data);
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD
+    g_signal_connect(data->artcache_read_iface, "handle-get-scaled-image-fd",
+                     G_CALLBACK(dbusmethod_cache_get_scaled_image_fd), data->handler_data);
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGE_FD */
+#if HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA
+    g_signal_connect(data->artcache_read_iface, "handle-get-scaled-images-data",
+                     G_CALLBACK(dbusmethod_cache_get_scaled_images), data->handler_data);
+#endif /* HAVE_DBUS_METHOD_GET_SCALED_IMAGES_DATA */
 
     g_signal_connect(data->artcache_write_iface, "handle-add-image-by-uri",
                      G_CALLBACK(dbusmethod_cache_add_by_uri), data->handler_data);
@@ -0,0 +1,372 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <chrono>
+#include <curl/curl.h>
+
+#include "fetcher.hh"
+#include "spawnhelper.hh"
+#include "messages.h"
+
+const char *Converter::fetch_error_to_string(FetchError error)
+{
+    static const std::array<const char *const,
+                            size_t(FetchError::LAST_FETCH_ERROR) + 1> names
+    {
+        "OK",
+        "INVALID_URI",
+        "UNSUPPORTED_PROTOCOL",
+        "RESOLVE_FAILED",
+        "CONNECT_FAILED",
+        "TLS_FAILED",
+        "TIMEOUT",
+        "NETWORK_ERROR",
+        "PROTOCOL_ERROR",
+        "HTTP_STATUS",
+        "TOO_LARGE",
+        "EMPTY_BODY",
+        "WRITE_FAILED",
+        "CANCELED",
+        "INTERNAL_ERROR",
+    };
+
+    return names[size_t(error)];
+}
+
+using ShareLocks = std::array<std::mutex, 8>;
+
+static void lock_share(CURL *, curl_lock_data data,
+                       curl_lock_access, void *userptr)
+{
+    auto &locks(*static_cast<ShareLocks *>(userptr));
+    locks[size_t(data) % locks.size()].lock();
+}
+
+static void unlock_share(CURL *, curl_lock_data data, void *userptr)
+{
+    auto &locks(*static_cast<ShareLocks *>(userptr));
+    locks[size_t(data) % locks.size()].unlock();
+}
+
+bool Converter::Fetcher::init()
+{
+    if(share_ != nullptr)
+        return true;
+
+    const CURLcode ret = curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    if(ret != CURLE_OK)
+    {
+        msg_error(0, LOG_ERR, "Failed initializing HTTP library: %s",
+                  curl_easy_strerror(ret));
+        return false;
+    }
+
+    CURLSH *share = curl_share_init();
+
+    if(share == nullptr)
+    {
+        msg_error(0, LOG_ERR, "Failed creating HTTP connection cache");
+        curl_global_cleanup();
+        return false;
+    }
+
+    curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lock_share);
+    curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlock_share);
+    curl_share_setopt(share, CURLSHOPT_USERDATA, &share_locks_);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+    share_ = share;
+
+    return true;
+}
+
+void Converter::Fetcher::shutdown()
+{
+    if(share_ == nullptr)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(idle_handles_lock_);
+
+        for(void *handle : idle_handles_)
+            curl_easy_cleanup(static_cast<CURL *>(handle));
+
+        idle_handles_.clear();
+    }
+
+    curl_share_cleanup(static_cast<CURLSH *>(share_));
+    share_ = nullptr;
+    curl_global_cleanup();
+}
+
+/*
+ * Connections of a handle survive curl_easy_reset(), so a handle taken from
+ * the pool may already be connected to the server.
+ */
+void *Converter::Fetcher::take_handle() const
+{
+    {
+        std::lock_guard<std::mutex> lock(idle_handles_lock_);
+
+        if(!idle_handles_.empty())
+        {
+            CURL *curl = static_cast<CURL *>(idle_handles_.back());
+            idle_handles_.pop_back();
+            curl_easy_reset(curl);
+            return curl;
+        }
+    }
+
+    return curl_easy_init();
+}
+
+void Converter::Fetcher::put_handle(void *handle) const
+{
+    /* handles must not be attached to the share when it is cleaned up */
+    curl_easy_setopt(static_cast<CURL *>(handle), CURLOPT_SHARE, nullptr);
+
+    std::lock_guard<std::mutex> lock(idle_handles_lock_);
+    idle_handles_.push_back(handle);
+}
+
+/*
+ * State of a single transfer, passed to the library callbacks.
+ */
+class Transfer
+{
+  public:
+    Converter::FetchSink &sink_;
+    const Converter::SpawnCancel *const cancel_;
+    const size_t max_body_bytes_;
+
+    size_t body_bytes_;
+    bool is_too_large_;
+    bool is_sink_failed_;
+
+    Transfer(const Transfer &) = delete;
+    Transfer &operator=(const Transfer &) = delete;
+
+    explicit Transfer(Converter::FetchSink &sink,
+                      const Converter::SpawnCancel *cancel,
+                      size_t max_body_bytes):
+        sink_(sink),
+        cancel_(cancel),
+        max_body_bytes_(max_body_bytes),
+        body_bytes_(0),
+        is_too_large_(false),
+        is_sink_failed_(false)
+    {}
+};
+
+static size_t write_body(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    auto &xfer(*static_cast<Transfer *>(userdata));
+    const size_t length = size * nmemb;
+
+    /* the server may have lied about the length, or not sent any */
+    if(xfer.max_body_bytes_ > 0 &&
+       length > xfer.max_body_bytes_ - xfer.body_bytes_)
+    {
+        xfer.is_too_large_ = true;
+        return 0;
+    }
+
+    if(!xfer.sink_.write(reinterpret_cast<const uint8_t *>(ptr), length))
+    {
+        xfer.is_sink_failed_ = true;
+        return 0;
+    }
+
+    xfer.body_bytes_ += length;
+
+    return length;
+}
+
+static int check_progress(void *clientp, curl_off_t, curl_off_t,
+                          curl_off_t, curl_off_t)
+{
+    const auto &xfer(*static_cast<const Transfer *>(clientp));
+    return xfer.cancel_ != nullptr && xfer.cancel_->is_triggered() ? 1 : 0;
+}
+
+static Converter::FetchError map_curl_error(CURLcode code,
+                                            const Transfer &xfer)
+{
+    switch(code)
+    {
+      case CURLE_OK:
+        return xfer.body_bytes_ > 0
+            ? Converter::FetchError::OK
+            : Converter::FetchError::EMPTY_BODY;
+
+      case CURLE_URL_MALFORMAT:
+        return Converter::FetchError::INVALID_URI;
+
+      case CURLE_UNSUPPORTED_PROTOCOL:
+        return Converter::FetchError::UNSUPPORTED_PROTOCOL;
+
+      case CURLE_COULDNT_RESOLVE_PROXY:
+      case CURLE_COULDNT_RESOLVE_HOST:
+        return Converter::FetchError::RESOLVE_FAILED;
+
+      case CURLE_COULDNT_CONNECT:
+        return Converter::FetchError::CONNECT_FAILED;
+
+      case CURLE_SSL_CONNECT_ERROR:
+      case CURLE_PEER_FAILED_VERIFICATION:
+      case CURLE_SSL_CERTPROBLEM:
+      case CURLE_SSL_CIPHER:
+      case CURLE_SSL_CACERT_BADFILE:
+      case CURLE_SSL_ISSUER_ERROR:
+        return Converter::FetchError::TLS_FAILED;
+
+      case CURLE_OPERATION_TIMEDOUT:
+        return Converter::FetchError::TIMEOUT;
+
+      case CURLE_SEND_ERROR:
+      case CURLE_RECV_ERROR:
+      case CURLE_PARTIAL_FILE:
+      case CURLE_GOT_NOTHING:
+        return Converter::FetchError::NETWORK_ERROR;
+
+      case CURLE_HTTP_RETURNED_ERROR:
+        return Converter::FetchError::HTTP_STATUS;
+
+      case CURLE_FILESIZE_EXCEEDED:
+        return Converter::FetchError::TOO_LARGE;
+
+      case CURLE_WRITE_ERROR:
+        if(xfer.is_too_large_)
+            return Converter::FetchError::TOO_LARGE;
+
+        if(xfer.is_sink_failed_)
+            return Converter::FetchError::WRITE_FAILED;
+
+        break;
+
+      case CURLE_ABORTED_BY_CALLBACK:
+        return Converter::FetchError::CANCELED;
+
+      case CURLE_OUT_OF_MEMORY:
+      case CURLE_FAILED_INIT:
+        return Converter::FetchError::INTERNAL_ERROR;
+
+      default:
+        break;
+    }
+
+    return Converter::FetchError::PROTOCOL_ERROR;
+}
+
+bool Converter::Fetcher::fetch(const std::string &uri, FetchSink &sink,
+                               FetchResult &result,
+                               const SpawnCancel *cancel) const
+{
+    result.error_ = FetchError::INTERNAL_ERROR;
+    result.http_status_ = 0;
+    result.body_bytes_ = 0;
+    result.elapsed_us_ = 0;
+    result.detail_.clear();
+
+    if(cancel != nullptr && cancel->is_triggered())
+    {
+        result.error_ = FetchError::CANCELED;
+        return false;
+    }
+
+    if(share_ == nullptr)
+    {
+        result.detail_ = "HTTP library not initialized";
+        return false;
+    }
+
+    CURL *curl = static_cast<CURL *>(take_handle());
+
+    if(curl == nullptr)
+    {
+        result.detail_ = "Failed creating transfer";
+        return false;
+    }
+
+    Transfer xfer(sink, cancel, limits_.max_body_bytes_);
+    char error_buffer[CURL_ERROR_SIZE];
+    error_buffer[0] = '\0';
+
+    curl_easy_setopt(curl, CURLOPT_URL, uri.c_str());
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, error_buffer);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, PACKAGE_NAME "/" PACKAGE_VERSION);
+#if LIBCURL_VERSION_NUM >= 0x075500
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "http,https");
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS_STR, "http,https");
+#else /* LIBCURL_VERSION_NUM < 0x075500 */
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS, long(CURLPROTO_HTTP | CURLPROTO_HTTPS));
+    curl_easy_setopt(curl, CURLOPT_REDIR_PROTOCOLS, long(CURLPROTO_HTTP | CURLPROTO_HTTPS));
+#endif /* LIBCURL_VERSION_NUM */
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, long(limits_.max_redirects_));
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, long(limits_.connect_timeout_ms_));
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, long(limits_.total_timeout_ms_));
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, long(limits_.low_speed_bytes_per_s_));
+    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, long(limits_.low_speed_time_s_));
+
+    /* rejects bodies of known size early, the write callback catches the
+     * others */
+    if(limits_.max_body_bytes_ > 0)
+        curl_easy_setopt(curl, CURLOPT_MAXFILESIZE_LARGE,
+                         curl_off_t(limits_.max_body_bytes_));
+
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_body);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &xfer);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, check_progress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &xfer);
+
+    if(share_ != nullptr)
+        curl_easy_setopt(curl, CURLOPT_SHARE, share_);
+
+    const auto start(std::chrono::steady_clock::now());
+    const CURLcode code = curl_easy_perform(curl);
+
+    result.elapsed_us_ =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    result.body_bytes_ = xfer.body_bytes_;
+    result.error_ = map_curl_error(code, xfer);
+
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.http_status_);
+
+    if(result.error_ != FetchError::OK)
+        result.detail_ = error_buffer[0] != '\0'
+            ? error_buffer
+            : curl_easy_strerror(code);
+
+    put_handle(curl);
+
+    return result.error_ == FetchError::OK;
+}
@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef FETCHER_HH
+#define FETCHER_HH
+
+#include <string>
+#include <mutex>
+#include <array>
+#include <vector>
+#include <cinttypes>
+
+namespace Converter
+{
+
+class SpawnCancel;
+
+/*!
+ * Reasons for failed downloads.
+ */
+enum class FetchError
+{
+    OK,
+    INVALID_URI,
+    UNSUPPORTED_PROTOCOL,
+    RESOLVE_FAILED,
+    CONNECT_FAILED,
+    TLS_FAILED,
+    TIMEOUT,
+    NETWORK_ERROR,
+    PROTOCOL_ERROR,
+    HTTP_STATUS,
+    TOO_LARGE,
+    EMPTY_BODY,
+    WRITE_FAILED,
+    CANCELED,
+    INTERNAL_ERROR,
+
+    LAST_FETCH_ERROR = INTERNAL_ERROR,
+};
+
+const char *fetch_error_to_string(FetchError error);
+
+/*!
+ * Limits enforced on each download.
+ */
+class FetchLimits
+{
+  public:
+    /*! Downloads of larger bodies are aborted, 0 for no limit. */
+    size_t max_body_bytes_;
+
+    /*! Maximum time for establishing the connection, including TLS. */
+    unsigned int connect_timeout_ms_;
+
+    /*! Maximum time for the whole transfer, including redirects. */
+    unsigned int total_timeout_ms_;
+
+    /*! Abort if the transfer is slower than this for \c low_speed_time_s_. */
+    unsigned int low_speed_bytes_per_s_;
+    unsigned int low_speed_time_s_;
+
+    /*! Maximum number of redirects to follow. */
+    unsigned int max_redirects_;
+
+    explicit FetchLimits(size_t max_body_bytes = 20U * 1024U * 1024U,
+                         unsigned int total_timeout_ms = 60U * 1000U):
+        max_body_bytes_(max_body_bytes),
+        connect_timeout_ms_(10U * 1000U),
+        total_timeout_ms_(total_timeout_ms),
+        low_speed_bytes_per_s_(512),
+        low_speed_time_s_(15),
+        max_redirects_(5)
+    {}
+};
+
+/*!
+ * Outcome of a download.
+ */
+class FetchResult
+{
+  public:
+    FetchError error_;
+
+    /*! Final HTTP status code, 0 if no response has been received. */
+    long http_status_;
+
+    /*! Number of body bytes passed to the sink. */
+    size_t body_bytes_;
+
+    /*! Time from start of the request to the end of the transfer. */
+    uint64_t elapsed_us_;
+
+    /*! Human-readable details about the error, possibly empty. */
+    std::string detail_;
+
+    FetchResult(const FetchResult &) = delete;
+    FetchResult &operator=(const FetchResult &) = delete;
+
+    explicit FetchResult():
+        error_(FetchError::INTERNAL_ERROR),
+        http_status_(0),
+        body_bytes_(0),
+        elapsed_us_(0)
+    {}
+};
+
+/*!
+ * Destination of downloaded data.
+ */
+class FetchSink
+{
+  protected:
+    explicit FetchSink() {}
+
+  public:
+    FetchSink(const FetchSink &) = delete;
+    FetchSink &operator=(const FetchSink &) = delete;
+
+    virtual ~FetchSink() {}
+
+    /*!
+     * Data received from the server, in order.
+     *
+     * \returns
+     *     False to abort the download with #Converter::FetchError::WRITE_FAILED.
+     */
+    virtual bool write(const uint8_t *data, size_t length) = 0;
+};
+
+/*!
+ * In-process HTTP(S) downloader.
+ *
+ * Downloads are streamed into a #Converter::FetchSink so that the data can
+ * be hashed and stored while it is being received. Transfer handles are
+ * kept in a pool and reused, so that images stored on the same server are
+ * fetched over already established connections. DNS lookups and TLS
+ * sessions are shared between all downloads.
+ *
+ * Only HTTP and HTTPS are supported, also for redirects.
+ */
+class Fetcher
+{
+  private:
+    /* DNS and TLS session cache shared by all transfers, one lock for each
+     * kind of shared data */
+    void *share_;
+    std::array<std::mutex, 8> share_locks_;
+
+    /* transfer handles not in use, each with its own connection cache */
+    mutable std::mutex idle_handles_lock_;
+    mutable std::vector<void *> idle_handles_;
+
+    const FetchLimits limits_;
+
+  public:
+    Fetcher(const Fetcher &) = delete;
+    Fetcher &operator=(const Fetcher &) = delete;
+
+    explicit Fetcher(const FetchLimits &limits = FetchLimits()):
+        share_(nullptr),
+        limits_(limits)
+    {}
+
+    ~Fetcher() { shutdown(); }
+
+    /*!
+     * Initialize the HTTP library.
+     *
+     * Must be called before any threads are started. Downloads fail with
+     * #Converter::FetchError::INTERNAL_ERROR until then.
+     */
+    bool init();
+    void shutdown();
+
+    const FetchLimits &get_limits() const { return limits_; }
+
+    /*!
+     * Download resource and pass its body to given sink.
+     *
+     * This function is thread-safe.
+     *
+     * \param uri
+     *     HTTP or HTTPS URI of the resource.
+     *
+     * \param sink
+     *     Where to pass the data to.
+     *
+     * \param[out] result
+     *     Error class, HTTP status, and statistics.
+     *
+     * \param cancel
+     *     Optional cancellation flag for aborting the download early.
+     *
+     * \returns
+     *     True if the whole, non-empty body has been passed to \p sink.
+     */
+    bool fetch(const std::string &uri, FetchSink &sink, FetchResult &result,
+               const SpawnCancel *cancel = nullptr) const;
+
+  private:
+    void *take_handle() const;
+    void put_handle(void *handle) const;
+};
+
+}
+
+#endif /* !FETCHER_HH */
@@ -0,0 +1,531 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <csetjmp>
+
+#include <jpeglib.h>
+#include <png.h>
+
+#include "imageconvert.hh"
+#include "resample.hh"
+#include "messages.h"
+
+/*
+ * Images with more pixels are rejected to avoid excessive memory usage
+ * (about 96 MiB for the decoded RGBA data).
+ */
+static constexpr size_t max_input_pixels = 24U * 1000U * 1000U;
+
+static bool check_input_size(unsigned int width, unsigned int height)
+{
+    if(width > 0 && height > 0 &&
+       size_t(width) * size_t(height) <= max_input_pixels)
+        return true;
+
+    msg_error(0, LOG_NOTICE, "Rejecting input image of size %ux%u",
+              width, height);
+
+    return false;
+}
+
+class JPEGErrorManager
+{
+  public:
+    struct jpeg_error_mgr pub_;
+    jmp_buf setjmp_buffer_;
+};
+
+static void jpeg_error_exit(j_common_ptr cinfo)
+{
+    auto *const err = reinterpret_cast<JPEGErrorManager *>(cinfo->err);
+
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    msg_error(0, LOG_NOTICE, "JPEG decoder: %s", buffer);
+
+    longjmp(err->setjmp_buffer_, 1);
+}
+
+static void jpeg_output_message(j_common_ptr cinfo)
+{
+    char buffer[JMSG_LENGTH_MAX];
+    (*cinfo->err->format_message)(cinfo, buffer);
+    msg_vinfo(MESSAGE_LEVEL_DIAG, "JPEG decoder: %s", buffer);
+}
+
+/*
+ * Let libjpeg scale down in DCT domain as far as possible.
+ *
+ * The smallest of the scaling factors 1/8, 1/4, and 1/2 is chosen which
+ * still yields an image not smaller than the image fitted into the bounding
+ * box. This saves most of the decoding time and memory for large pictures.
+ */
+static void choose_jpeg_scale(struct jpeg_decompress_struct &cinfo,
+                              unsigned int fit_width, unsigned int fit_height)
+{
+    unsigned int target_width;
+    unsigned int target_height;
+
+    Converter::fit_dimensions(cinfo.image_width, cinfo.image_height,
+                              fit_width, fit_height,
+                              target_width, target_height);
+
+    static const unsigned int denominators[] = { 8, 4, 2, };
+
+    cinfo.scale_num = 1;
+
+    for(const auto denom : denominators)
+    {
+        cinfo.scale_denom = denom;
+        jpeg_calc_output_dimensions(&cinfo);
+
+        if(cinfo.output_width >= target_width &&
+           cinfo.output_height >= target_height)
+            return;
+    }
+
+    cinfo.scale_denom = 1;
+}
+
+/*
+ * Note that there must be no objects with non-trivial destructors created
+ * in this function after the call of setjmp().
+ */
+static Converter::ImageResult
+decode_jpeg(const uint8_t *data, size_t length, Converter::RGBAImage &image,
+            unsigned int fit_width, unsigned int fit_height,
+            std::vector<uint8_t> &rowbuffer)
+{
+    struct jpeg_decompress_struct cinfo;
+    JPEGErrorManager jerr;
+
+    cinfo.err = jpeg_std_error(&jerr.pub_);
+    jerr.pub_.error_exit = jpeg_error_exit;
+    jerr.pub_.output_message = jpeg_output_message;
+
+    if(setjmp(jerr.setjmp_buffer_))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        image = Converter::RGBAImage();
+        return Converter::ImageResult::INPUT_ERROR;
+    }
+
+    jpeg_create_decompress(&cinfo);
+    jpeg_mem_src(&cinfo, const_cast<unsigned char *>(data), length);
+    jpeg_read_header(&cinfo, TRUE);
+
+    if(cinfo.jpeg_color_space == JCS_CMYK || cinfo.jpeg_color_space == JCS_YCCK)
+    {
+        /* leave these to the experts */
+        jpeg_destroy_decompress(&cinfo);
+        return Converter::ImageResult::UNSUPPORTED;
+    }
+
+    if(!check_input_size(cinfo.image_width, cinfo.image_height))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return Converter::ImageResult::INPUT_ERROR;
+    }
+
+    cinfo.out_color_space = JCS_RGB;
+
+    if(fit_width > 0 && fit_height > 0)
+        choose_jpeg_scale(cinfo, fit_width, fit_height);
+
+    jpeg_start_decompress(&cinfo);
+
+    image.set_size(cinfo.output_width, cinfo.output_height);
+    rowbuffer.resize(size_t(cinfo.output_width) * 3);
+
+    while(cinfo.output_scanline < cinfo.output_height)
+    {
+        uint8_t *dest = image.row(cinfo.output_scanline);
+        JSAMPROW row = rowbuffer.data();
+
+        jpeg_read_scanlines(&cinfo, &row, 1);
+
+        for(unsigned int x = 0; x < cinfo.output_width; ++x)
+        {
+            *dest++ = row[0];
+            *dest++ = row[1];
+            *dest++ = row[2];
+            *dest++ = UINT8_MAX;
+            row += 3;
+        }
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    return Converter::ImageResult::OK;
+}
+
+static Converter::ImageResult
+decode_png(const uint8_t *data, size_t length, Converter::RGBAImage &image)
+{
+    png_image png;
+
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if(!png_image_begin_read_from_memory(&png, data, length))
+    {
+        msg_error(0, LOG_NOTICE, "PNG decoder: %s", png.message);
+        return Converter::ImageResult::INPUT_ERROR;
+    }
+
+    if(!check_input_size(png.width, png.height))
+    {
+        png_image_free(&png);
+        return Converter::ImageResult::INPUT_ERROR;
+    }
+
+    png.format = PNG_FORMAT_RGBA;
+    image.set_size(png.width, png.height);
+
+    if(!png_image_finish_read(&png, nullptr, image.pixels_.data(), 0, nullptr))
+    {
+        msg_error(0, LOG_NOTICE, "PNG decoder: %s", png.message);
+        image = Converter::RGBAImage();
+        return Converter::ImageResult::INPUT_ERROR;
+    }
+
+    return Converter::ImageResult::OK;
+}
+
+Converter::ImageResult
+Converter::decode_image(const uint8_t *data, size_t length, RGBAImage &image,
+                        unsigned int fit_width, unsigned int fit_height)
+{
+    static const uint8_t jpeg_magic[] = { 0xff, 0xd8, 0xff, };
+    static const uint8_t png_magic[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', };
+
+    image = RGBAImage();
+
+    if(length > sizeof(jpeg_magic) &&
+       memcmp(data, jpeg_magic, sizeof(jpeg_magic)) == 0)
+    {
+        std::vector<uint8_t> rowbuffer;
+        return decode_jpeg(data, length, image, fit_width, fit_height,
+                           rowbuffer);
+    }
+
+    if(length > sizeof(png_magic) &&
+       memcmp(data, png_magic, sizeof(png_magic)) == 0)
+        return decode_png(data, length, image);
+
+    return ImageResult::UNSUPPORTED;
+}
+
+static uint32_t read_be32(const uint8_t *p)
+{
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+}
+
+Converter::ImageResult
+Converter::inspect_png(const uint8_t *data, size_t length, PNGInfo &info)
+{
+    static const uint8_t png_magic[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n', };
+    static constexpr size_t chunk_overhead = 12;
+
+    if(length < sizeof(png_magic) ||
+       memcmp(data, png_magic, sizeof(png_magic)) != 0)
+        return ImageResult::UNSUPPORTED;
+
+    bool have_ihdr = false;
+    bool have_idat = false;
+    size_t pos = sizeof(png_magic);
+
+    while(length - pos >= chunk_overhead)
+    {
+        const uint32_t chunk_length = read_be32(&data[pos]);
+        const uint8_t *const type = &data[pos + 4];
+        const uint8_t *const payload = &data[pos + 8];
+
+        if(chunk_length > 0x7fffffffU ||
+           chunk_length > length - pos - chunk_overhead)
+            break;
+
+        pos += chunk_overhead + chunk_length;
+
+        if(!have_ihdr)
+        {
+            if(memcmp(type, "IHDR", 4) != 0 || chunk_length != 13)
+                break;
+
+            have_ihdr = true;
+            info.width_ = read_be32(&payload[0]);
+            info.height_ = read_be32(&payload[4]);
+            info.bit_depth_ = payload[8];
+            info.color_type_ = payload[9];
+            info.is_interlaced_ = payload[12] != 0;
+
+            if(info.width_ == 0 || info.height_ == 0)
+                break;
+        }
+        else if(memcmp(type, "PLTE", 4) == 0)
+        {
+            if(chunk_length == 0 || chunk_length % 3 != 0 || chunk_length > 256 * 3)
+                break;
+
+            info.palette_entries_ = chunk_length / 3;
+        }
+        else if(memcmp(type, "IDAT", 4) == 0)
+            have_idat = true;
+        else if(memcmp(type, "IEND", 4) == 0)
+        {
+            if(!have_idat)
+                break;
+
+            return ImageResult::OK;
+        }
+    }
+
+    msg_error(0, LOG_NOTICE, "Broken PNG data");
+
+    return ImageResult::INPUT_ERROR;
+}
+
+bool Converter::is_png_usable_as_is(const PNGInfo &info,
+                                    unsigned int max_width,
+                                    unsigned int max_height,
+                                    size_t max_colors)
+{
+    static constexpr uint8_t png_color_type_palette = 3;
+
+    if(info.color_type_ != png_color_type_palette || info.is_interlaced_ ||
+       info.palette_entries_ == 0 || info.palette_entries_ > max_colors)
+        return false;
+
+    unsigned int width;
+    unsigned int height;
+
+    fit_dimensions(info.width_, info.height_, max_width, max_height,
+                   width, height);
+
+    return width == info.width_ && height == info.height_;
+}
+
+bool Converter::parse_dimensions(const std::string &dimensions,
+                                 unsigned int &width, unsigned int &height)
+{
+    const char *const str = dimensions.c_str();
+    char *endptr = nullptr;
+
+    const unsigned long w = strtoul(str, &endptr, 10);
+    if(endptr == str || *endptr != 'x' || w == 0 || w > UINT16_MAX)
+        return false;
+
+    const char *const hstr = endptr + 1;
+    const unsigned long h = strtoul(hstr, &endptr, 10);
+    if(endptr == hstr || *endptr != '\0' || h == 0 || h > UINT16_MAX)
+        return false;
+
+    width = w;
+    height = h;
+
+    return true;
+}
+
+void Converter::resize_to_fit(const RGBAImage &src,
+                              unsigned int max_width, unsigned int max_height,
+                              RGBAImage &dest)
+{
+    unsigned int width;
+    unsigned int height;
+
+    fit_dimensions(src.width_, src.height_, max_width, max_height,
+                   width, height);
+    resample(src, width, height, dest);
+}
+
+void Converter::resize_to_fit(const RGBAImage &src,
+                              unsigned int original_width,
+                              unsigned int original_height,
+                              unsigned int max_width, unsigned int max_height,
+                              RGBAImage &dest)
+{
+    unsigned int width;
+    unsigned int height;
+
+    fit_dimensions(original_width, original_height, max_width, max_height,
+                   width, height);
+    resample(src, width, height, dest);
+}
+
+static bool box_contains(const std::pair<unsigned int, unsigned int> &outer,
+                         const std::pair<unsigned int, unsigned int> &inner)
+{
+    return outer.first >= inner.first && outer.second >= inner.second;
+}
+
+static size_t box_area(const std::pair<unsigned int, unsigned int> &box)
+{
+    return size_t(box.first) * size_t(box.second);
+}
+
+std::vector<Converter::RenditionStep>
+Converter::plan_renditions(const std::vector<std::pair<unsigned int, unsigned int>> &boxes)
+{
+    std::vector<size_t> order(boxes.size());
+
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(),
+                     [&boxes] (size_t a, size_t b)
+                     {
+                         return box_area(boxes[a]) > box_area(boxes[b]);
+                     });
+
+    std::vector<RenditionStep> steps;
+
+    for(const size_t idx : order)
+    {
+        int source = -1;
+
+        /* steps are sorted by area, so the last match is the smallest one */
+        for(size_t s = 0; s < steps.size(); ++s)
+            if(box_contains(boxes[steps[s].box_index_], boxes[idx]))
+                source = s;
+
+        steps.emplace_back(idx, source);
+    }
+
+    return steps;
+}
+
+static void png_write_to_vector(png_structp png_ptr, png_bytep data, png_size_t length)
+{
+    auto *const out = static_cast<std::vector<uint8_t> *>(png_get_io_ptr(png_ptr));
+    out->insert(out->end(), data, data + length);
+}
+
+static void png_flush_nothing(png_structp) {}
+
+static void png_error_to_log(png_structp png_ptr, png_const_charp message)
+{
+    msg_error(0, LOG_ERR, "PNG encoder: %s", message);
+    png_longjmp(png_ptr, 1);
+}
+
+static void png_warning_to_log(png_structp, png_const_charp message)
+{
+    msg_vinfo(MESSAGE_LEVEL_DIAG, "PNG encoder: %s", message);
+}
+
+/*
+ * Note that there must be no objects with non-trivial destructors created
+ * in this function after the call of setjmp().
+ */
+static Converter::ImageResult
+write_palette_png(const Converter::IndexedImage &image,
+                  const png_color *palette, const png_byte *trans, int num_trans,
+                  png_bytepp rows, std::vector<uint8_t> &png)
+{
+    png_structp png_ptr =
+        png_create_write_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                png_error_to_log, png_warning_to_log);
+    if(png_ptr == nullptr)
+        return Converter::ImageResult::INTERNAL_ERROR;
+
+    png_infop info_ptr = png_create_info_struct(png_ptr);
+    if(info_ptr == nullptr)
+    {
+        png_destroy_write_struct(&png_ptr, nullptr);
+        return Converter::ImageResult::INTERNAL_ERROR;
+    }
+
+    if(setjmp(png_jmpbuf(png_ptr)))
+    {
+        png_destroy_write_struct(&png_ptr, &info_ptr);
+        png.clear();
+        return Converter::ImageResult::INTERNAL_ERROR;
+    }
+
+    png_set_write_fn(png_ptr, &png, png_write_to_vector, png_flush_nothing);
+    png_set_IHDR(png_ptr, info_ptr, image.width_, image.height_, 8,
+                 PNG_COLOR_TYPE_PALETTE, PNG_INTERLACE_NONE,
+                 PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
+    png_set_PLTE(png_ptr, info_ptr, palette, image.palette_.size());
+
+    if(num_trans > 0)
+        png_set_tRNS(png_ptr, info_ptr, trans, num_trans, nullptr);
+
+    /* filters do not help with palette images; small pictures are cheap to
+     * compress, so use best compression */
+    png_set_filter(png_ptr, PNG_FILTER_TYPE_BASE, PNG_FILTER_NONE);
+    png_set_compression_level(png_ptr, 9);
+
+    png_write_info(png_ptr, info_ptr);
+    png_write_image(png_ptr, rows);
+    png_write_end(png_ptr, nullptr);
+    png_destroy_write_struct(&png_ptr, &info_ptr);
+
+    return Converter::ImageResult::OK;
+}
+
+Converter::ImageResult
+Converter::encode_png(const IndexedImage &image, std::vector<uint8_t> &png)
+{
+    png.clear();
+
+    if(image.width_ == 0 || image.height_ == 0 || image.palette_.empty() ||
+       image.palette_.size() > 256 ||
+       image.indices_.size() != size_t(image.width_) * image.height_)
+    {
+        MSG_BUG("Cannot encode PNG from invalid image data");
+        return ImageResult::INTERNAL_ERROR;
+    }
+
+    png_color palette[256];
+    png_byte trans[256];
+    int num_trans = 0;
+
+    for(size_t i = 0; i < image.palette_.size(); ++i)
+    {
+        const auto &entry(image.palette_[i]);
+
+        palette[i].red = entry[0];
+        palette[i].green = entry[1];
+        palette[i].blue = entry[2];
+        trans[i] = entry[3];
+
+        if(entry[3] < UINT8_MAX)
+            num_trans = i + 1;
+    }
+
+    std::vector<png_bytep> rows(image.height_);
+
+    for(unsigned int y = 0; y < image.height_; ++y)
+        rows[y] = const_cast<png_bytep>(&image.indices_[size_t(y) * image.width_]);
+
+    return write_palette_png(image, palette, trans, num_trans, rows.data(), png);
+}
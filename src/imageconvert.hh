@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef IMAGECONVERT_HH
+#define IMAGECONVERT_HH
+
+#include <array>
+#include <vector>
+#include <string>
+#include <utility>
+#include <cinttypes>
+
+/*!
+ * \addtogroup image_conversion In-process image conversion
+ *
+ * Decoding, scaling, color reduction, and encoding of images without
+ * spawning external tools.
+ *
+ * Only common input formats are handled here. Anything else is reported as
+ * unsupported so that the caller can fall back to external tools.
+ */
+/*!@{*/
+
+namespace Converter
+{
+
+/*!
+ * Image with 8 bit RGBA pixels (non-premultiplied), stored row by row
+ * without padding.
+ */
+class RGBAImage
+{
+  public:
+    unsigned int width_;
+    unsigned int height_;
+    std::vector<uint8_t> pixels_;
+
+    RGBAImage(const RGBAImage &) = delete;
+    RGBAImage(RGBAImage &&) = default;
+    RGBAImage &operator=(const RGBAImage &) = delete;
+    RGBAImage &operator=(RGBAImage &&) = default;
+
+    explicit RGBAImage():
+        width_(0),
+        height_(0)
+    {}
+
+    void set_size(unsigned int width, unsigned int height)
+    {
+        width_ = width;
+        height_ = height;
+        pixels_.resize(size_t(width) * size_t(height) * 4);
+    }
+
+    bool empty() const { return pixels_.empty(); }
+
+    uint8_t *row(unsigned int y) { return &pixels_[size_t(y) * width_ * 4]; }
+    const uint8_t *row(unsigned int y) const { return &pixels_[size_t(y) * width_ * 4]; }
+};
+
+/*!
+ * Image with up to 256 RGBA palette entries and one index byte per pixel.
+ */
+class IndexedImage
+{
+  public:
+    unsigned int width_;
+    unsigned int height_;
+    std::vector<std::array<uint8_t, 4>> palette_;
+    std::vector<uint8_t> indices_;
+
+    IndexedImage(const IndexedImage &) = delete;
+    IndexedImage &operator=(const IndexedImage &) = delete;
+
+    explicit IndexedImage():
+        width_(0),
+        height_(0)
+    {}
+};
+
+enum class ImageResult
+{
+    OK,
+    UNSUPPORTED,
+    INPUT_ERROR,
+    INTERNAL_ERROR,
+};
+
+/*!
+ * Decode JPEG or PNG data to RGBA.
+ *
+ * \param data, length
+ *     Encoded image data.
+ *
+ * \param[out] image
+ *     Decoded image.
+ *
+ * \param fit_width, fit_height
+ *     If both are non-zero, then the image is going to be scaled to fit into
+ *     a bounding box of this size. The decoder may return a smaller image
+ *     than stored in \p data in this case, but never smaller than required
+ *     to fill the box (as computed by #Converter::fit_dimensions()). Only
+ *     JPEG images are reduced while decoding.
+ *
+ * \returns
+ *     #Converter::ImageResult::UNSUPPORTED if the data is in some format
+ *     not handled by this function, #Converter::ImageResult::INPUT_ERROR if
+ *     the data is broken or the image is too large.
+ */
+ImageResult decode_image(const uint8_t *data, size_t length, RGBAImage &image,
+                         unsigned int fit_width = 0,
+                         unsigned int fit_height = 0);
+
+/*!
+ * Properties of a PNG image as stored in its header chunks.
+ */
+class PNGInfo
+{
+  public:
+    unsigned int width_;
+    unsigned int height_;
+    uint8_t bit_depth_;
+    uint8_t color_type_;
+    bool is_interlaced_;
+    size_t palette_entries_;
+
+    PNGInfo(const PNGInfo &) = delete;
+    PNGInfo &operator=(const PNGInfo &) = delete;
+
+    explicit PNGInfo():
+        width_(0),
+        height_(0),
+        bit_depth_(0),
+        color_type_(0),
+        is_interlaced_(false),
+        palette_entries_(0)
+    {}
+};
+
+/*!
+ * Inspect PNG data without decoding the image.
+ *
+ * The chunk structure is followed up to the \c IEND chunk. Neither the
+ * checksums nor the compressed image data are verified.
+ *
+ * \returns
+ *     #Converter::ImageResult::UNSUPPORTED if the data is not a PNG,
+ *     #Converter::ImageResult::INPUT_ERROR if the chunk structure is broken.
+ */
+ImageResult inspect_png(const uint8_t *data, size_t length, PNGInfo &info);
+
+/*!
+ * Whether or not a PNG may be used in place of a converted image.
+ *
+ * This is the case for non-interlaced palette images with at most
+ * \p max_colors palette entries, and which have exactly the size they would
+ * be scaled to by #Converter::resize_to_fit() for the given bounding box.
+ */
+bool is_png_usable_as_is(const PNGInfo &info,
+                         unsigned int max_width, unsigned int max_height,
+                         size_t max_colors);
+
+/*!
+ * Parse dimensions given as "<width>x<height>", as used in output formats.
+ */
+bool parse_dimensions(const std::string &dimensions,
+                      unsigned int &width, unsigned int &height);
+
+/*!
+ * Scale image so that it fits into given bounding box, keeping aspect ratio.
+ *
+ * The image is enlarged if it is smaller than the bounding box, as done by
+ * the \c -resize option of ImageMagick.
+ */
+void resize_to_fit(const RGBAImage &src,
+                   unsigned int max_width, unsigned int max_height,
+                   RGBAImage &dest);
+
+/*!
+ * Scale rendition of an image so that it fits into given bounding box.
+ *
+ * Same as #Converter::resize_to_fit(), but the size of the result is
+ * computed from the size of the original image, not from the size of
+ * \p src. This allows deriving renditions from larger renditions of the same
+ * image without accumulating rounding errors in the output size.
+ */
+void resize_to_fit(const RGBAImage &src,
+                   unsigned int original_width, unsigned int original_height,
+                   unsigned int max_width, unsigned int max_height,
+                   RGBAImage &dest);
+
+/*!
+ * One step of producing several renditions of an image.
+ */
+class RenditionStep
+{
+  public:
+    /*! Index of the bounding box the rendition is produced for. */
+    size_t box_index_;
+
+    /*!
+     * Index of the earlier step whose result is the input for this step, or
+     * -1 if the original image must be used.
+     */
+    int source_step_;
+
+    explicit RenditionStep(size_t box_index, int source_step):
+        box_index_(box_index),
+        source_step_(source_step)
+    {}
+};
+
+/*!
+ * Plan downscale pyramid for producing renditions for several bounding boxes
+ * from a single decoded image.
+ *
+ * The steps are ordered from the largest to the smallest bounding box. Each
+ * rendition is derived from the smallest earlier rendition whose bounding
+ * box contains the rendition's bounding box, or from the original image if
+ * there is none.
+ */
+std::vector<RenditionStep>
+plan_renditions(const std::vector<std::pair<unsigned int, unsigned int>> &boxes);
+
+/*!
+ * Encode indexed image as palette PNG.
+ */
+ImageResult encode_png(const IndexedImage &image, std::vector<uint8_t> &png);
+
+}
+
+/*!@}*/
+
+#endif /* !IMAGECONVERT_HH */
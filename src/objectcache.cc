@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include "objectcache.hh"
+#include "messages.h"
+
+std::shared_ptr<const ArtCache::ObjectData>
+ArtCache::ObjectMemoryCache::lookup(const std::string &object_hash)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if(!is_enabled())
+        return nullptr;
+
+    const auto it(entries_.find(object_hash));
+
+    if(it == entries_.end())
+    {
+        ++misses_;
+        return nullptr;
+    }
+
+    ++hits_;
+    lru_.splice(lru_.begin(), lru_, it->second);
+
+    return it->second->second;
+}
+
+void ArtCache::ObjectMemoryCache::insert(const std::string &object_hash,
+                                         std::shared_ptr<const ObjectData> objdata)
+{
+    if(objdata == nullptr || !is_cacheable(objdata->size()))
+        return;
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    const auto it(entries_.find(object_hash));
+
+    if(it != entries_.end())
+    {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return;
+    }
+
+    evict__unlocked(objdata->size());
+
+    bytes_used_ += objdata->size();
+    lru_.emplace_front(object_hash, std::move(objdata));
+    entries_.emplace(object_hash, lru_.begin());
+}
+
+void ArtCache::ObjectMemoryCache::remove(const std::string &object_hash)
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    const auto it(entries_.find(object_hash));
+
+    if(it == entries_.end())
+        return;
+
+    bytes_used_ -= it->second->second->size();
+    lru_.erase(it->second);
+    entries_.erase(it);
+}
+
+void ArtCache::ObjectMemoryCache::clear()
+{
+    std::lock_guard<std::mutex> lock(lock_);
+
+    entries_.clear();
+    lru_.clear();
+    bytes_used_ = 0;
+}
+
+void ArtCache::ObjectMemoryCache::evict__unlocked(size_t required_bytes)
+{
+    while(!lru_.empty() && bytes_used_ + required_bytes > budget_)
+    {
+        const auto &victim(lru_.back());
+
+        bytes_used_ -= victim.second->size();
+        entries_.erase(victim.first);
+        lru_.pop_back();
+    }
+}
+
+size_t ArtCache::ObjectMemoryCache::get_bytes_used() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return bytes_used_;
+}
+
+size_t ArtCache::ObjectMemoryCache::get_number_of_objects() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return entries_.size();
+}
+
+size_t ArtCache::ObjectMemoryCache::get_hits() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return hits_;
+}
+
+size_t ArtCache::ObjectMemoryCache::get_misses() const
+{
+    std::lock_guard<std::mutex> lock(lock_);
+    return misses_;
+}
+
+void ArtCache::ObjectMemoryCache::dump(const char *what) const
+{
+    if(!is_enabled())
+        return;
+
+    std::lock_guard<std::mutex> lock(lock_);
+
+    msg_vinfo(MESSAGE_LEVEL_INFO_MIN,
+              "%s: %zu objects, %zu of %zu bytes used, %zu hits, %zu misses",
+              what, entries_.size(), bytes_used_, budget_, hits_, misses_);
+}
@@ -0,0 +1,142 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef OBJECTCACHE_HH
+#define OBJECTCACHE_HH
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+
+#include "cachetypes.hh"
+
+/*!
+ * \addtogroup cache
+ */
+/*!@{*/
+
+namespace ArtCache
+{
+
+/*!
+ * Object data held in a private buffer.
+ */
+class BufferedObjectData: public ObjectData
+{
+  private:
+    const std::vector<uint8_t> data_;
+
+  public:
+    explicit BufferedObjectData(const uint8_t *objdata, size_t length):
+        data_(objdata, objdata + length)
+    {}
+
+    const uint8_t *data() const override { return data_.data(); }
+    size_t size() const override { return data_.size(); }
+};
+
+/*!
+ * Least recently used objects kept in RAM, limited by a byte budget.
+ *
+ * Entries are keyed by object hash. Since objects are immutable, entries
+ * never become stale; they only need to be removed when the object is
+ * removed from the cache.
+ *
+ * The cache has its own lock so that it can be used while the lock of the
+ * #ArtCache::Manager is only held for reading.
+ */
+class ObjectMemoryCache
+{
+  private:
+    using Entry = std::pair<std::string, std::shared_ptr<const ObjectData>>;
+
+    mutable std::mutex lock_;
+
+    const size_t budget_;
+    size_t bytes_used_;
+
+    /*! Entries in LRU order, most recently used first. */
+    std::list<Entry> lru_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> entries_;
+
+    size_t hits_;
+    size_t misses_;
+
+  public:
+    ObjectMemoryCache(const ObjectMemoryCache &) = delete;
+    ObjectMemoryCache &operator=(const ObjectMemoryCache &) = delete;
+
+    /*!
+     * Constructor.
+     *
+     * \param budget
+     *     Maximum number of object bytes to keep in RAM. Pass 0 to disable
+     *     the cache.
+     */
+    explicit ObjectMemoryCache(size_t budget):
+        budget_(budget),
+        bytes_used_(0),
+        hits_(0),
+        misses_(0)
+    {}
+
+    bool is_enabled() const { return budget_ > 0; }
+
+    /*!
+     * Whether or not an object of given size would be kept in cache.
+     */
+    bool is_cacheable(size_t size) const { return size > 0 && size <= budget_; }
+
+    /*!
+     * Find object data, mark as most recently used on hit.
+     *
+     * \returns
+     *     The object data, or \c nullptr if the object is not in cache.
+     */
+    std::shared_ptr<const ObjectData> lookup(const std::string &object_hash);
+
+    /*!
+     * Insert object data, evict least recently used objects as needed.
+     */
+    void insert(const std::string &object_hash,
+                std::shared_ptr<const ObjectData> objdata);
+
+    void remove(const std::string &object_hash);
+    void clear();
+
+    size_t get_budget() const { return budget_; }
+    size_t get_bytes_used() const;
+    size_t get_number_of_objects() const;
+    size_t get_hits() const;
+    size_t get_misses() const;
+
+    void dump(const char *what) const;
+
+  private:
+    void evict__unlocked(size_t required_bytes);
+};
+
+}
+
+/*!@}*/
+
+#endif /* !OBJECTCACHE_HH */
@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -38,6 +38,7 @@ enum class AddKeyResult
     REPLACED,
     SOURCE_PENDING,
     SOURCE_UNKNOWN,
+    QUEUE_FULL,
     IO_ERROR,
     DISK_FULL,
     INTERNAL_ERROR,
@@ -54,12 +55,60 @@ class PendingIface
 
     virtual ~PendingIface() {}
 
-    virtual bool is_source_pending(const std::string &source_hash,
-                                   bool exclude_current = false) const = 0;
+    /*!
+     * Check if given source is being added, queued, or in progress.
+     *
+     * Unlike the other functions, this function is called by cache lookups
+     * while the lock of the implementation is not held, and it must not take
+     * it. See also #ArtCache::PendingIface::promote_pending_source().
+     */
+    virtual bool is_source_pending(const std::string &source_hash) const = 0;
+
+    /*!
+     * Check if image data for given stream key has been passed in, but is
+     * not associated with a source yet.
+     *
+     * Called by cache lookups under the same conditions as
+     * #ArtCache::PendingIface::is_source_pending(). A \p priority of 0
+     * matches any priority.
+     */
+    virtual bool is_stream_key_pending(const std::string &stream_key,
+                                       uint8_t priority) const = 0;
+
     virtual bool is_source_pending__unlocked(const std::string &source_hash,
                                              bool exclude_current = false) const = 0;
     virtual bool add_key_to_pending_source(const ArtCache::StreamPrioPair &stream_key,
                                            const std::string &source_hash) = 0;
+
+    /*!
+     * A client is waiting for the given source, process it as soon as
+     * possible.
+     *
+     * Called by cache lookups, so this function must not take the lock of
+     * the implementation either.
+     */
+    virtual void promote_pending_source(const std::string &source_hash) = 0;
+
+    /*!
+     * Stream key does not refer to given source any more.
+     *
+     * Processing of the source may be stopped if no other stream key is
+     * waiting for it. Called while the lock of the implementation is held.
+     */
+    virtual void notify_key_unlinked__unlocked(const ArtCache::StreamPrioPair &stream_key,
+                                               const std::string &source_hash) = 0;
+
+    /*!
+     * Stream key has been deleted from the cache.
+     *
+     * Like #ArtCache::PendingIface::notify_key_unlinked__unlocked(), but
+     * called no matter if the lock of the implementation is held or not.
+     * The implementation must not take its lock, but may defer processing
+     * until it holds the lock anyway.
+     */
+    virtual void notify_key_deleted(const ArtCache::StreamPrioPair &stream_key,
+                                    const std::string &source_hash) = 0;
+
     virtual void notify_pending_key_processed(const ArtCache::StreamPrioPair &stream_key,
                                               const std::string &source_hash,
                                               ArtCache::AddKeyResult result,
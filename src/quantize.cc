@@ -0,0 +1,449 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <unordered_map>
+
+#include "quantize.hh"
+
+using Palette = std::vector<std::array<uint8_t, 4>>;
+
+static constexpr uint8_t transparency_threshold = 128;
+
+/*
+ * Error diffused to neighbors is limited so that dithering noise stays low
+ * in small pictures, where single stray dots are easily visible.
+ */
+static constexpr int32_t max_diffused_error = 48;
+
+static constexpr unsigned int histogram_bits = 5;
+static constexpr unsigned int histogram_shift = 8 - histogram_bits;
+static constexpr size_t histogram_size = size_t(1) << (3 * histogram_bits);
+
+static inline size_t histogram_index(const uint8_t *rgb)
+{
+    return (size_t(rgb[0] >> histogram_shift) << (2 * histogram_bits)) |
+           (size_t(rgb[1] >> histogram_shift) << histogram_bits) |
+           size_t(rgb[2] >> histogram_shift);
+}
+
+static inline uint32_t pack_rgb(const uint8_t *rgb)
+{
+    return (uint32_t(rgb[0]) << 16) | (uint32_t(rgb[1]) << 8) | rgb[2];
+}
+
+static inline bool is_transparent(const uint8_t *p)
+{
+    return p[3] < transparency_threshold;
+}
+
+class HistogramBin
+{
+  public:
+    uint32_t count_;
+    uint64_t sum_[3];
+};
+
+/*
+ * Non-empty histogram bin, represented by the mean of its colors.
+ */
+class ColorCount
+{
+  public:
+    std::array<uint8_t, 3> rgb_;
+    uint32_t count_;
+    uint64_t sum_[3];
+
+    explicit ColorCount(const HistogramBin &bin):
+        count_(bin.count_),
+        sum_{bin.sum_[0], bin.sum_[1], bin.sum_[2]}
+    {
+        for(unsigned int ch = 0; ch < 3; ++ch)
+            rgb_[ch] = uint8_t((sum_[ch] + count_ / 2) / count_);
+    }
+};
+
+/*
+ * Range of colors in color vector, split along its widest channel.
+ */
+class ColorBox
+{
+  public:
+    size_t begin_;
+    size_t end_;
+    unsigned int widest_channel_;
+    unsigned int range_;
+
+    explicit ColorBox(const std::vector<ColorCount> &colors,
+                      size_t begin, size_t end):
+        begin_(begin),
+        end_(end),
+        widest_channel_(0),
+        range_(0)
+    {
+        std::array<uint8_t, 3> lo{UINT8_MAX, UINT8_MAX, UINT8_MAX};
+        std::array<uint8_t, 3> hi{0, 0, 0};
+
+        for(size_t i = begin_; i < end_; ++i)
+        {
+            for(unsigned int ch = 0; ch < 3; ++ch)
+            {
+                lo[ch] = std::min(lo[ch], colors[i].rgb_[ch]);
+                hi[ch] = std::max(hi[ch], colors[i].rgb_[ch]);
+            }
+        }
+
+        for(unsigned int ch = 0; ch < 3; ++ch)
+        {
+            if(unsigned(hi[ch] - lo[ch]) > range_)
+            {
+                range_ = hi[ch] - lo[ch];
+                widest_channel_ = ch;
+            }
+        }
+    }
+
+    bool can_split() const { return end_ - begin_ > 1; }
+};
+
+static size_t split_box(std::vector<ColorCount> &colors, const ColorBox &box)
+{
+    const unsigned int ch = box.widest_channel_;
+
+    std::sort(colors.begin() + box.begin_, colors.begin() + box.end_,
+              [ch] (const ColorCount &a, const ColorCount &b) { return a.rgb_[ch] < b.rgb_[ch]; });
+
+    size_t total = 0;
+    for(size_t i = box.begin_; i < box.end_; ++i)
+        total += colors[i].count_;
+
+    size_t sum = 0;
+    size_t split = box.begin_ + 1;
+
+    for(size_t i = box.begin_; i < box.end_ - 1; ++i)
+    {
+        sum += colors[i].count_;
+        split = i + 1;
+
+        if(sum * 2 >= total)
+            break;
+    }
+
+    return split;
+}
+
+static std::array<uint8_t, 4>
+average_color(const std::vector<ColorCount> &colors, const ColorBox &box)
+{
+    uint64_t sum[3] = { 0, 0, 0, };
+    uint64_t total = 0;
+
+    for(size_t i = box.begin_; i < box.end_; ++i)
+    {
+        for(unsigned int ch = 0; ch < 3; ++ch)
+            sum[ch] += colors[i].sum_[ch];
+
+        total += colors[i].count_;
+    }
+
+    return {uint8_t((sum[0] + total / 2) / total),
+            uint8_t((sum[1] + total / 2) / total),
+            uint8_t((sum[2] + total / 2) / total),
+            UINT8_MAX};
+}
+
+static void median_cut(std::vector<ColorCount> &colors, size_t max_colors,
+                       Palette &palette)
+{
+    if(colors.empty())
+        return;
+
+    std::vector<ColorBox> boxes;
+    boxes.emplace_back(colors, 0, colors.size());
+
+    while(boxes.size() < max_colors)
+    {
+        auto it(std::max_element(boxes.begin(), boxes.end(),
+                                 [] (const ColorBox &a, const ColorBox &b)
+                                 {
+                                     return (a.can_split() ? a.range_ + 1 : 0) <
+                                            (b.can_split() ? b.range_ + 1 : 0);
+                                 }));
+
+        if(!it->can_split())
+            break;
+
+        const ColorBox box(*it);
+        const size_t split = split_box(colors, box);
+
+        *it = ColorBox(colors, box.begin_, split);
+        boxes.emplace_back(colors, split, box.end_);
+    }
+
+    for(const auto &box : boxes)
+        palette.push_back(average_color(colors, box));
+}
+
+static uint8_t find_nearest(const Palette &palette, size_t first,
+                            const uint8_t *rgb)
+{
+    size_t best = first;
+    int best_distance = INT32_MAX;
+
+    for(size_t i = first; i < palette.size(); ++i)
+    {
+        const int dr = int(palette[i][0]) - rgb[0];
+        const int dg = int(palette[i][1]) - rgb[1];
+        const int db = int(palette[i][2]) - rgb[2];
+        const int distance = dr * dr + dg * dg + db * db;
+
+        if(distance < best_distance)
+        {
+            best = i;
+            best_distance = distance;
+        }
+    }
+
+    return uint8_t(best);
+}
+
+/*
+ * Nearest palette entry per histogram bin, computed on demand.
+ */
+class InverseColormap
+{
+  private:
+    const Palette &palette_;
+    const size_t first_;
+    std::vector<int16_t> cache_;
+
+  public:
+    InverseColormap(const InverseColormap &) = delete;
+    InverseColormap &operator=(const InverseColormap &) = delete;
+
+    explicit InverseColormap(const Palette &palette, size_t first):
+        palette_(palette),
+        first_(first),
+        cache_(histogram_size, -1)
+    {}
+
+    uint8_t lookup(const uint8_t *rgb)
+    {
+        auto &entry(cache_[histogram_index(rgb)]);
+
+        if(entry < 0)
+        {
+            static constexpr uint8_t half_bin = 1U << (histogram_shift - 1);
+            const uint8_t center[3] =
+            {
+                uint8_t((rgb[0] & ~((1U << histogram_shift) - 1)) | half_bin),
+                uint8_t((rgb[1] & ~((1U << histogram_shift) - 1)) | half_bin),
+                uint8_t((rgb[2] & ~((1U << histogram_shift) - 1)) | half_bin),
+            };
+
+            entry = find_nearest(palette_, first_, center);
+        }
+
+        return uint8_t(entry);
+    }
+};
+
+static inline int32_t divide_by_16(int32_t e)
+{
+    return e >= 0 ? (e + 8) / 16 : -((8 - e) / 16);
+}
+
+static inline uint8_t clamp_to_u8(int32_t v)
+{
+    return uint8_t(std::max(0, std::min(255, v)));
+}
+
+/*
+ * Floyd-Steinberg error diffusion in serpentine order.
+ *
+ * Errors are kept in two row buffers (current and next row, with one pixel
+ * of padding on both sides) in units of 1/16.
+ */
+static void map_dithered(const Converter::RGBAImage &src, const Palette &palette,
+                         InverseColormap &inverse, Converter::IndexedImage &dest)
+{
+    const unsigned int width = src.width_;
+    std::vector<int32_t> errors_this((size_t(width) + 2) * 3, 0);
+    std::vector<int32_t> errors_next(errors_this.size(), 0);
+
+    for(unsigned int y = 0; y < src.height_; ++y)
+    {
+        const bool forward = (y & 1) == 0;
+        const int dir = forward ? 3 : -3;
+        const uint8_t *const row = src.row(y);
+        uint8_t *const out = &dest.indices_[size_t(y) * width];
+
+        std::fill(errors_next.begin(), errors_next.end(), 0);
+
+        for(unsigned int i = 0; i < width; ++i)
+        {
+            const unsigned int x = forward ? i : width - 1 - i;
+            const uint8_t *const p = row + size_t(x) * 4;
+
+            if(is_transparent(p))
+            {
+                out[x] = 0;
+                continue;
+            }
+
+            const size_t pos = (size_t(x) + 1) * 3;
+            uint8_t color[3];
+
+            for(unsigned int ch = 0; ch < 3; ++ch)
+                color[ch] = clamp_to_u8(p[ch] + divide_by_16(errors_this[pos + ch]));
+
+            const uint8_t idx = inverse.lookup(color);
+            out[x] = idx;
+
+            for(unsigned int ch = 0; ch < 3; ++ch)
+            {
+                const int32_t err =
+                    std::max(-max_diffused_error,
+                             std::min(max_diffused_error,
+                                      int32_t(color[ch]) - int32_t(palette[idx][ch])));
+
+                errors_this[pos + dir + ch] += err * 7;
+                errors_next[pos - dir + ch] += err * 3;
+                errors_next[pos + ch]       += err * 5;
+                errors_next[pos + dir + ch] += err;
+            }
+        }
+
+        std::swap(errors_this, errors_next);
+    }
+}
+
+static void map_nearest(const Converter::RGBAImage &src,
+                        InverseColormap &inverse, Converter::IndexedImage &dest)
+{
+    for(size_t i = 0; i < dest.indices_.size(); ++i)
+    {
+        const uint8_t *const p = &src.pixels_[i * 4];
+        dest.indices_[i] = is_transparent(p) ? 0 : inverse.lookup(p);
+    }
+}
+
+void Converter::quantize(const RGBAImage &src, size_t max_colors,
+                         IndexedImage &dest, Dithering dithering)
+{
+    max_colors = std::max(size_t(2), std::min(max_colors, size_t(256)));
+
+    dest.width_ = src.width_;
+    dest.height_ = src.height_;
+    dest.palette_.clear();
+    dest.indices_.resize(size_t(src.width_) * src.height_);
+
+    std::vector<HistogramBin> histogram(histogram_size, HistogramBin{0, {0, 0, 0}});
+    std::unordered_map<uint32_t, uint8_t> exact_colors;
+    bool have_transparency = false;
+    bool is_lossless = true;
+
+    for(size_t i = 0; i < src.pixels_.size(); i += 4)
+    {
+        const uint8_t *const p = &src.pixels_[i];
+
+        if(is_transparent(p))
+        {
+            have_transparency = true;
+            continue;
+        }
+
+        auto &bin(histogram[histogram_index(p)]);
+        ++bin.count_;
+        bin.sum_[0] += p[0];
+        bin.sum_[1] += p[1];
+        bin.sum_[2] += p[2];
+
+        if(is_lossless)
+        {
+            exact_colors.emplace(pack_rgb(p), 0);
+
+            if(exact_colors.size() > max_colors)
+                is_lossless = false;
+        }
+    }
+
+    if(have_transparency)
+        dest.palette_.push_back({0, 0, 0, 0});
+
+    const size_t first_opaque = dest.palette_.size();
+
+    if(is_lossless && exact_colors.size() + first_opaque > max_colors)
+        is_lossless = false;
+
+    if(is_lossless)
+    {
+        std::vector<uint32_t> sorted;
+        sorted.reserve(exact_colors.size());
+
+        for(const auto &c : exact_colors)
+            sorted.push_back(c.first);
+
+        std::sort(sorted.begin(), sorted.end());
+
+        for(const uint32_t rgb : sorted)
+        {
+            exact_colors[rgb] = uint8_t(dest.palette_.size());
+            dest.palette_.push_back({uint8_t(rgb >> 16), uint8_t(rgb >> 8),
+                                     uint8_t(rgb), UINT8_MAX});
+        }
+
+        for(size_t i = 0; i < dest.indices_.size(); ++i)
+        {
+            const uint8_t *const p = &src.pixels_[i * 4];
+            dest.indices_[i] = is_transparent(p) ? 0 : exact_colors[pack_rgb(p)];
+        }
+
+        return;
+    }
+
+    std::vector<ColorCount> colors;
+
+    for(const auto &bin : histogram)
+    {
+        if(bin.count_ > 0)
+            colors.emplace_back(bin);
+    }
+
+    median_cut(colors, max_colors - first_opaque, dest.palette_);
+
+    InverseColormap inverse(dest.palette_, first_opaque);
+
+    switch(dithering)
+    {
+      case Dithering::NONE:
+        map_nearest(src, inverse, dest);
+        break;
+
+      case Dithering::FLOYD_STEINBERG:
+        map_dithered(src, dest.palette_, inverse, dest);
+        break;
+    }
+}
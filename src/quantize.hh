@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef QUANTIZE_HH
+#define QUANTIZE_HH
+
+#include "imageconvert.hh"
+
+/*!
+ * \addtogroup image_conversion
+ */
+/*!@{*/
+
+namespace Converter
+{
+
+enum class Dithering
+{
+    NONE,
+    FLOYD_STEINBERG,
+};
+
+/*!
+ * Reduce image to at most \p max_colors palette entries.
+ *
+ * Images with few enough colors are converted without loss. Otherwise, the
+ * palette is computed by median cut on a histogram with 5 bits per channel,
+ * and pixels are mapped to the palette with optional error diffusion.
+ *
+ * Pixels which are more than half transparent are mapped to a single fully
+ * transparent palette entry at index 0, all other pixels are treated as
+ * opaque.
+ */
+void quantize(const RGBAImage &src, size_t max_colors, IndexedImage &dest,
+              Dithering dithering = Dithering::FLOYD_STEINBERG);
+
+}
+
+/*!@}*/
+
+#endif /* !QUANTIZE_HH */
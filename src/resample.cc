@@ -0,0 +1,481 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define RESAMPLE_WITH_SSE2 1
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define RESAMPLE_WITH_AVX2 1
+#endif /* __AVX2__ */
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define RESAMPLE_WITH_NEON 1
+#endif
+
+#include "resample.hh"
+
+/*
+ * Vector types used by the kernels.
+ *
+ * A pixel vector holds the four channels of a single premultiplied RGBA
+ * pixel. A row vector is used for processing flat arrays of floats and may
+ * be wider.
+ */
+class ScalarVec4
+{
+  public:
+    static constexpr size_t lanes = 4;
+
+    float v_[4];
+
+    static ScalarVec4 zero()
+    {
+        ScalarVec4 r;
+        r.v_[0] = r.v_[1] = r.v_[2] = r.v_[3] = 0.0F;
+        return r;
+    }
+
+    static ScalarVec4 load(const float *p)
+    {
+        ScalarVec4 r;
+        std::copy(p, p + 4, r.v_);
+        return r;
+    }
+
+    static ScalarVec4 from_pixel(const uint8_t *p)
+    {
+        const float a = p[3] * (1.0F / 255.0F);
+        ScalarVec4 r;
+        r.v_[0] = float(p[0]) * a;
+        r.v_[1] = float(p[1]) * a;
+        r.v_[2] = float(p[2]) * a;
+        r.v_[3] = float(p[3]);
+        return r;
+    }
+
+    void store(float *p) const { std::copy(v_, v_ + 4, p); }
+
+    void add(const ScalarVec4 &x)
+    {
+        for(unsigned int i = 0; i < 4; ++i)
+            v_[i] += x.v_[i];
+    }
+
+    void madd(const ScalarVec4 &x, float w)
+    {
+        for(unsigned int i = 0; i < 4; ++i)
+            v_[i] += x.v_[i] * w;
+    }
+
+    void scale(float f)
+    {
+        for(unsigned int i = 0; i < 4; ++i)
+            v_[i] *= f;
+    }
+};
+
+#if RESAMPLE_WITH_SSE2
+class SSE2Vec4
+{
+  public:
+    static constexpr size_t lanes = 4;
+
+    __m128 v_;
+
+    static SSE2Vec4 zero() { return SSE2Vec4{_mm_setzero_ps()}; }
+    static SSE2Vec4 load(const float *p) { return SSE2Vec4{_mm_loadu_ps(p)}; }
+
+    static SSE2Vec4 from_pixel(const uint8_t *p)
+    {
+        uint32_t u;
+        memcpy(&u, p, sizeof(u));
+
+        const __m128i z = _mm_setzero_si128();
+        __m128i i = _mm_cvtsi32_si128(int(u));
+        i = _mm_unpacklo_epi8(i, z);
+        i = _mm_unpacklo_epi16(i, z);
+
+        const float a = p[3] * (1.0F / 255.0F);
+        return SSE2Vec4{_mm_mul_ps(_mm_cvtepi32_ps(i), _mm_set_ps(1.0F, a, a, a))};
+    }
+
+    void store(float *p) const { _mm_storeu_ps(p, v_); }
+    void add(const SSE2Vec4 &x) { v_ = _mm_add_ps(v_, x.v_); }
+    void madd(const SSE2Vec4 &x, float w) { v_ = _mm_add_ps(v_, _mm_mul_ps(x.v_, _mm_set1_ps(w))); }
+    void scale(float f) { v_ = _mm_mul_ps(v_, _mm_set1_ps(f)); }
+};
+
+using SIMDPixelVec = SSE2Vec4;
+#endif /* RESAMPLE_WITH_SSE2 */
+
+#if RESAMPLE_WITH_AVX2
+class AVX2Vec8
+{
+  public:
+    static constexpr size_t lanes = 8;
+
+    __m256 v_;
+
+    static AVX2Vec8 load(const float *p) { return AVX2Vec8{_mm256_loadu_ps(p)}; }
+    void store(float *p) const { _mm256_storeu_ps(p, v_); }
+    void madd(const AVX2Vec8 &x, float w) { v_ = _mm256_add_ps(v_, _mm256_mul_ps(x.v_, _mm256_set1_ps(w))); }
+};
+
+using SIMDRowVec = AVX2Vec8;
+#elif RESAMPLE_WITH_SSE2
+using SIMDRowVec = SSE2Vec4;
+#endif /* RESAMPLE_WITH_AVX2 */
+
+#if RESAMPLE_WITH_NEON
+class NEONVec4
+{
+  public:
+    static constexpr size_t lanes = 4;
+
+    float32x4_t v_;
+
+    static NEONVec4 zero() { return NEONVec4{vdupq_n_f32(0.0F)}; }
+    static NEONVec4 load(const float *p) { return NEONVec4{vld1q_f32(p)}; }
+
+    static NEONVec4 from_pixel(const uint8_t *p)
+    {
+        uint32_t u;
+        memcpy(&u, p, sizeof(u));
+
+        const uint16x8_t w = vmovl_u8(vcreate_u8(u));
+        const float32x4_t f = vcvtq_f32_u32(vmovl_u16(vget_low_u16(w)));
+
+        const float a = p[3] * (1.0F / 255.0F);
+        float32x4_t m = vdupq_n_f32(a);
+        m = vsetq_lane_f32(1.0F, m, 3);
+
+        return NEONVec4{vmulq_f32(f, m)};
+    }
+
+    void store(float *p) const { vst1q_f32(p, v_); }
+    void add(const NEONVec4 &x) { v_ = vaddq_f32(v_, x.v_); }
+    void madd(const NEONVec4 &x, float w) { v_ = vmlaq_n_f32(v_, x.v_, w); }
+    void scale(float f) { v_ = vmulq_n_f32(v_, f); }
+};
+
+using SIMDPixelVec = NEONVec4;
+using SIMDRowVec = NEONVec4;
+#endif /* RESAMPLE_WITH_NEON */
+
+const char *Converter::get_resample_simd_name()
+{
+#if RESAMPLE_WITH_AVX2
+    return "AVX2";
+#elif RESAMPLE_WITH_SSE2
+    return "SSE2";
+#elif RESAMPLE_WITH_NEON
+    return "NEON";
+#else
+    return "none";
+#endif
+}
+
+void Converter::fit_dimensions(unsigned int src_width, unsigned int src_height,
+                               unsigned int max_width, unsigned int max_height,
+                               unsigned int &width, unsigned int &height)
+{
+    if(src_width == 0 || src_height == 0 || max_width == 0 || max_height == 0)
+    {
+        width = height = 0;
+        return;
+    }
+
+    const double scale = std::min(double(max_width) / src_width,
+                                  double(max_height) / src_height);
+
+    width = std::max(1L, std::min(long(max_width), std::lround(src_width * scale)));
+    height = std::max(1L, std::min(long(max_height), std::lround(src_height * scale)));
+}
+
+/*
+ * Source pixels and their weights contributing to a single target pixel.
+ */
+class Contribution
+{
+  public:
+    unsigned int first_;
+    std::vector<float> weights_;
+};
+
+static constexpr double lanczos_lobes = 3.0;
+
+static double lanczos(double x)
+{
+    if(x == 0.0)
+        return 1.0;
+
+    if(x <= -lanczos_lobes || x >= lanczos_lobes)
+        return 0.0;
+
+    const double px = M_PI * x;
+    return lanczos_lobes * std::sin(px) * std::sin(px / lanczos_lobes) / (px * px);
+}
+
+/*
+ * Lanczos filter weights for scaling \p src_extent pixels to \p dest_size
+ * pixels. The source consists of \p src_count pixels, where the last pixel
+ * may be only partially covered by the extent.
+ */
+static std::vector<Contribution>
+compute_contributions(double src_extent, unsigned int src_count,
+                      unsigned int dest_size)
+{
+    std::vector<Contribution> result(dest_size);
+    const double scale = src_extent / dest_size;
+    const double filter_scale = std::max(1.0, scale);
+    const double support = lanczos_lobes * filter_scale;
+
+    for(unsigned int i = 0; i < dest_size; ++i)
+    {
+        auto &c(result[i]);
+        const double center = (i + 0.5) * scale;
+        const int first = std::max(0, int(std::floor(center - support)));
+        const int last = std::min(int(src_count) - 1, int(std::ceil(center + support)));
+
+        double sum = 0.0;
+        std::vector<double> weights;
+
+        for(int j = first; j <= last; ++j)
+        {
+            const double w = lanczos((j + 0.5 - center) / filter_scale);
+            weights.push_back(w);
+            sum += w;
+        }
+
+        /* skip zero weights at both ends */
+        size_t begin = 0;
+        size_t end = weights.size();
+
+        while(begin + 1 < end && weights[begin] == 0.0)
+            ++begin;
+
+        while(end - 1 > begin && weights[end - 1] == 0.0)
+            --end;
+
+        c.first_ = first + begin;
+
+        for(size_t k = begin; k < end; ++k)
+            c.weights_.push_back(float(weights[k] / sum));
+    }
+
+    return result;
+}
+
+/*
+ * Add premultiplied pixels of a row to accumulators, \p factor adjacent
+ * pixels per accumulator.
+ */
+template <typename PV>
+static void box_accumulate_row(const uint8_t *row, unsigned int width,
+                               unsigned int factor, float *acc)
+{
+    unsigned int x = 0;
+
+    for(float *a = acc; x < width; a += 4)
+    {
+        const unsigned int end = std::min(x + factor, width);
+        PV sum(PV::load(a));
+
+        for(; x < end; ++x)
+            sum.add(PV::from_pixel(row + size_t(x) * 4));
+
+        sum.store(a);
+    }
+}
+
+template <typename PV>
+static void box_normalize_row(float *acc, unsigned int src_width,
+                              unsigned int factor, unsigned int rows)
+{
+    const unsigned int count = (src_width + factor - 1) / factor;
+    const float full = 1.0F / float(factor * rows);
+
+    for(unsigned int i = 0; i < count; ++i)
+    {
+        const unsigned int columns = std::min(factor, src_width - i * factor);
+        PV p(PV::load(acc + size_t(i) * 4));
+
+        p.scale(columns == factor ? full : 1.0F / float(columns * rows));
+        p.store(acc + size_t(i) * 4);
+    }
+}
+
+template <typename PV>
+static void filter_row(const float *in, const std::vector<Contribution> &contrib,
+                       float *out)
+{
+    for(const auto &c : contrib)
+    {
+        const float *p = in + size_t(c.first_) * 4;
+        PV acc(PV::zero());
+
+        for(const float w : c.weights_)
+        {
+            acc.madd(PV::load(p), w);
+            p += 4;
+        }
+
+        acc.store(out);
+        out += 4;
+    }
+}
+
+template <typename RV>
+static void accumulate_rows(float *acc, const float *in, float w, size_t count)
+{
+    size_t i = 0;
+
+    for(; i + RV::lanes <= count; i += RV::lanes)
+    {
+        RV a(RV::load(acc + i));
+        a.madd(RV::load(in + i), w);
+        a.store(acc + i);
+    }
+
+    for(; i < count; ++i)
+        acc[i] += in[i] * w;
+}
+
+static void unpremultiply_row(const float *acc, unsigned int width, uint8_t *out)
+{
+    for(unsigned int x = 0; x < width; ++x)
+    {
+        const float *a = acc + size_t(x) * 4;
+        const float alpha = std::min(255.0F, a[3]);
+
+        if(alpha < 0.5F)
+        {
+            out[0] = out[1] = out[2] = out[3] = 0;
+            out += 4;
+            continue;
+        }
+
+        const float unpremultiply = 255.0F / alpha;
+
+        for(unsigned int ch = 0; ch < 3; ++ch)
+            out[ch] = uint8_t(std::max(0.0F, std::min(255.0F, a[ch] * unpremultiply + 0.5F)));
+
+        out[3] = uint8_t(alpha + 0.5F);
+        out += 4;
+    }
+}
+
+/*
+ * Box reduction by integer factor so that at most 2 to 4 source pixels are
+ * left per target pixel for the Lanczos filter.
+ */
+static unsigned int compute_box_factor(unsigned int src_size, unsigned int dest_size)
+{
+    return std::max(1U, src_size / (dest_size * 2));
+}
+
+template <typename PV, typename RV>
+static void do_resample(const Converter::RGBAImage &src,
+                        unsigned int width, unsigned int height,
+                        Converter::RGBAImage &dest)
+{
+    const unsigned int kx = compute_box_factor(src.width_, width);
+    const unsigned int ky = compute_box_factor(src.height_, height);
+    const unsigned int reduced_width = (src.width_ + kx - 1) / kx;
+    const unsigned int reduced_height = (src.height_ + ky - 1) / ky;
+
+    const auto hcontrib(compute_contributions(double(src.width_) / kx,
+                                              reduced_width, width));
+    const auto vcontrib(compute_contributions(double(src.height_) / ky,
+                                              reduced_height, height));
+
+    /* box reduction and horizontal pass, row by row */
+    std::vector<float> reduced(size_t(reduced_width) * 4);
+    std::vector<float> temp(size_t(width) * reduced_height * 4);
+
+    for(unsigned int ry = 0; ry < reduced_height; ++ry)
+    {
+        const unsigned int y0 = ry * ky;
+        const unsigned int rows = std::min(ky, src.height_ - y0);
+
+        std::fill(reduced.begin(), reduced.end(), 0.0F);
+
+        for(unsigned int y = y0; y < y0 + rows; ++y)
+            box_accumulate_row<PV>(src.row(y), src.width_, kx, reduced.data());
+
+        box_normalize_row<PV>(reduced.data(), src.width_, kx, rows);
+        filter_row<PV>(reduced.data(), hcontrib,
+                       &temp[size_t(ry) * width * 4]);
+    }
+
+    /* vertical pass */
+    dest.set_size(width, height);
+    std::vector<float> acc(size_t(width) * 4);
+
+    for(unsigned int y = 0; y < height; ++y)
+    {
+        const auto &c(vcontrib[y]);
+
+        std::fill(acc.begin(), acc.end(), 0.0F);
+
+        for(size_t k = 0; k < c.weights_.size(); ++k)
+            accumulate_rows<RV>(acc.data(),
+                                &temp[size_t(c.first_ + k) * width * 4],
+                                c.weights_[k], acc.size());
+
+        unpremultiply_row(acc.data(), width, dest.row(y));
+    }
+}
+
+void Converter::resample(const RGBAImage &src,
+                         unsigned int width, unsigned int height,
+                         RGBAImage &dest, ResampleKernel kernel)
+{
+    dest = RGBAImage();
+
+    if(src.empty() || width == 0 || height == 0)
+        return;
+
+    switch(kernel)
+    {
+      case ResampleKernel::SIMD:
+#if RESAMPLE_WITH_SSE2 || RESAMPLE_WITH_NEON
+        do_resample<SIMDPixelVec, SIMDRowVec>(src, width, height, dest);
+        return;
+#else
+        break;
+#endif
+
+      case ResampleKernel::SCALAR:
+        break;
+    }
+
+    do_resample<ScalarVec4, ScalarVec4>(src, width, height, dest);
+}
@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef RESAMPLE_HH
+#define RESAMPLE_HH
+
+#include "imageconvert.hh"
+
+/*!
+ * \addtogroup image_conversion
+ */
+/*!@{*/
+
+namespace Converter
+{
+
+enum class ResampleKernel
+{
+    SCALAR,
+    SIMD,
+};
+
+/*!
+ * Name of the SIMD instruction set used by #Converter::ResampleKernel::SIMD.
+ *
+ * \returns
+ *     "AVX2", "SSE2", "NEON", or "none" if there is no SIMD implementation
+ *     for the target platform (the scalar code is used in this case).
+ */
+const char *get_resample_simd_name();
+
+/*!
+ * Compute size of image scaled to fit into a bounding box.
+ */
+void fit_dimensions(unsigned int src_width, unsigned int src_height,
+                    unsigned int max_width, unsigned int max_height,
+                    unsigned int &width, unsigned int &height);
+
+/*!
+ * Scale image to given size.
+ *
+ * Large reductions are done in two steps. The image is first reduced by an
+ * integer factor by averaging blocks of pixels (box filter), then scaled to
+ * its final size by a Lanczos filter. All filtering is done on premultiplied
+ * alpha.
+ *
+ * Both kernels produce the same results, up to rounding errors.
+ */
+void resample(const RGBAImage &src, unsigned int width, unsigned int height,
+              RGBAImage &dest, ResampleKernel kernel = ResampleKernel::SIMD);
+
+}
+
+/*!@}*/
+
+#endif /* !RESAMPLE_HH */
@@ -0,0 +1,797 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <map>
+#include <algorithm>
+#include <climits>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <poll.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "spawnhelper.hh"
+#include "messages.h"
+
+extern char **environ;
+
+/*
+ * Requests are sent as a single packet containing a #HelperRequest header
+ * followed by the NUL-terminated arguments, with the reply socket attached
+ * as ancillary data.
+ */
+static constexpr size_t max_request_size = 64U * 1024U;
+
+/*
+ * Time a command is given to terminate after \c SIGTERM before it is killed.
+ */
+static constexpr uint64_t kill_grace_us = 2U * 1000U * 1000U;
+
+/*
+ * How often the local fallback checks its child process.
+ */
+static constexpr int local_poll_interval_ms = 20;
+
+class HelperRequest
+{
+  public:
+    uint32_t timeout_ms_;
+};
+
+/*
+ * Sent by the helper process through the reply socket.
+ *
+ * The requester may send a single byte through the reply socket, or close
+ * it, to cancel the command.
+ */
+class HelperReply
+{
+  public:
+    static constexpr uint32_t TIMED_OUT = 1U << 0;
+    static constexpr uint32_t CANCELED  = 1U << 1;
+
+    int32_t error_;
+    int32_t wait_status_;
+    uint64_t spawn_us_;
+    uint64_t run_us_;
+    uint32_t flags_;
+};
+
+static uint64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return uint64_t(ts.tv_sec) * 1000U * 1000U + uint64_t(ts.tv_nsec) / 1000U;
+}
+
+static std::vector<char *> mk_argv(const std::vector<std::string> &args)
+{
+    std::vector<char *> argv;
+
+    for(const auto &a : args)
+        argv.push_back(const_cast<char *>(a.c_str()));
+
+    argv.push_back(nullptr);
+
+    return argv;
+}
+
+/*
+ * Start command with default signal handling and empty signal mask, no
+ * matter what the calling process has set up for itself. The command is
+ * placed into a new process group.
+ */
+static int spawn_command(char *const *argv, pid_t &pid)
+{
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+
+    sigset_t sigs;
+    sigemptyset(&sigs);
+    posix_spawnattr_setsigmask(&attr, &sigs);
+    sigfillset(&sigs);
+    posix_spawnattr_setsigdefault(&attr, &sigs);
+    posix_spawnattr_setpgroup(&attr, 0);
+    posix_spawnattr_setflags(&attr,
+                             POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF |
+                             POSIX_SPAWN_SETPGROUP);
+
+    const int ret = posix_spawnp(&pid, argv[0], nullptr, &attr, argv, environ);
+
+    posix_spawnattr_destroy(&attr);
+
+    return ret;
+}
+
+static void fill_result(Converter::SpawnResult &result, int wait_status,
+                        uint32_t flags)
+{
+    result.timed_out_ = (flags & HelperReply::TIMED_OUT) != 0;
+    result.canceled_ = (flags & HelperReply::CANCELED) != 0;
+
+    if(WIFEXITED(wait_status))
+    {
+        result.exit_code_ = WEXITSTATUS(wait_status);
+        result.signal_ = 0;
+    }
+    else
+    {
+        result.exit_code_ = -1;
+        result.signal_ = WIFSIGNALED(wait_status) ? WTERMSIG(wait_status) : 0;
+    }
+}
+
+static bool send_reply(int reply_fd, int error, int wait_status,
+                       uint64_t spawn_us, uint64_t run_us, uint32_t flags)
+{
+    const HelperReply reply { error, wait_status, spawn_us, run_us, flags };
+
+    ssize_t ret;
+
+    while((ret = send(reply_fd, &reply, sizeof(reply), MSG_NOSIGNAL)) < 0 &&
+          errno == EINTR)
+        ;
+
+    return ret == sizeof(reply);
+}
+
+/*
+ * Receive request from daemon process.
+ *
+ * Returns 0 on EOF, -1 on error (request ignored), 1 if a request has been
+ * received.
+ */
+static int receive_request(int control_fd, std::vector<std::string> &args,
+                           uint32_t &timeout_ms, int &reply_fd)
+{
+    static char buffer[max_request_size];
+
+    union
+    {
+        struct cmsghdr align_;
+        char buf_[CMSG_SPACE(sizeof(int))];
+    }
+    cmsg_buffer;
+
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof(buffer);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buffer.buf_;
+    msg.msg_controllen = sizeof(cmsg_buffer.buf_);
+
+    ssize_t len;
+
+    while((len = recvmsg(control_fd, &msg, MSG_CMSG_CLOEXEC)) < 0 &&
+          errno == EINTR)
+        ;
+
+    if(len == 0)
+        return 0;
+
+    if(len < 0)
+    {
+        msg_error(errno, LOG_ERR, "Converter helper: receive failed");
+        return errno == EAGAIN ? -1 : 0;
+    }
+
+    reply_fd = -1;
+
+    for(struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c))
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS &&
+           c->cmsg_len == CMSG_LEN(sizeof(int)))
+            memcpy(&reply_fd, CMSG_DATA(c), sizeof(int));
+
+    if(reply_fd < 0)
+    {
+        MSG_BUG("Converter helper: request without reply channel");
+        return -1;
+    }
+
+    args.clear();
+
+    if((msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) != 0 ||
+       size_t(len) <= sizeof(HelperRequest) || buffer[len - 1] != '\0')
+    {
+        MSG_BUG("Converter helper: malformed request");
+        send_reply(reply_fd, EINVAL, 0, 0, 0, 0);
+        close(reply_fd);
+        return -1;
+    }
+
+    HelperRequest header;
+    memcpy(&header, buffer, sizeof(header));
+    timeout_ms = header.timeout_ms_;
+
+    for(const char *p = buffer + sizeof(header); p < buffer + len; p += strlen(p) + 1)
+        args.emplace_back(p);
+
+    return 1;
+}
+
+/*
+ * Supervision state of a started command.
+ */
+class RunningCommand
+{
+  public:
+    static constexpr uint64_t KILLED = UINT64_MAX;
+
+    int reply_fd_;
+    bool watch_reply_fd_;
+    uint64_t started_us_;
+    uint64_t spawn_us_;
+
+    /* Send \c SIGTERM at this time, 0 for no deadline */
+    uint64_t deadline_us_;
+
+    /* Send \c SIGKILL at this time, 0 if not terminating yet */
+    uint64_t kill_us_;
+
+    uint32_t flags_;
+
+    explicit RunningCommand(int reply_fd, uint64_t started_us,
+                            uint64_t spawn_us, uint32_t timeout_ms):
+        reply_fd_(reply_fd),
+        watch_reply_fd_(reply_fd >= 0),
+        started_us_(started_us),
+        spawn_us_(spawn_us),
+        deadline_us_(timeout_ms > 0
+                     ? started_us + uint64_t(timeout_ms) * 1000U
+                     : 0),
+        kill_us_(0),
+        flags_(0)
+    {}
+
+    void terminate(pid_t pid, uint32_t reason, uint64_t now)
+    {
+        flags_ |= reason;
+
+        if(kill_us_ != 0)
+            return;
+
+        killpg(pid, SIGTERM);
+        kill_us_ = now + kill_grace_us;
+    }
+
+    /*
+     * Terminate or kill command if its time is up.
+     *
+     * Returns the time of the next action to be taken for this command, or
+     * #KILLED if there is nothing left to do.
+     */
+    uint64_t process_deadline(pid_t pid, uint64_t now)
+    {
+        if(kill_us_ == 0)
+        {
+            if(deadline_us_ == 0)
+                return KILLED;
+
+            if(now < deadline_us_)
+                return deadline_us_;
+
+            terminate(pid, HelperReply::TIMED_OUT, now);
+        }
+
+        if(kill_us_ == KILLED)
+            return KILLED;
+
+        if(now < kill_us_)
+            return kill_us_;
+
+        killpg(pid, SIGKILL);
+        kill_us_ = KILLED;
+
+        return KILLED;
+    }
+};
+
+static int to_poll_timeout(uint64_t next_us, uint64_t now)
+{
+    if(next_us == RunningCommand::KILLED)
+        return -1;
+
+    return int(std::min<uint64_t>((next_us - now + 999U) / 1000U, INT_MAX));
+}
+
+/*
+ * Enforce deadlines of all running commands.
+ *
+ * Returns the timeout to be passed to \c poll(2).
+ */
+static int process_deadlines(std::map<pid_t, RunningCommand> &running)
+{
+    const uint64_t now = now_us();
+    uint64_t next_us = RunningCommand::KILLED;
+
+    for(auto &it : running)
+        next_us = std::min(next_us, it.second.process_deadline(it.first, now));
+
+    return to_poll_timeout(next_us, now);
+}
+
+static void reap_children(std::map<pid_t, RunningCommand> &running)
+{
+    int status;
+    pid_t pid;
+
+    while((pid = waitpid(-1, &status, WNOHANG)) > 0)
+    {
+        const auto it(running.find(pid));
+
+        if(it == running.end())
+            continue;
+
+        send_reply(it->second.reply_fd_, 0, status, it->second.spawn_us_,
+                   now_us() - it->second.started_us_, it->second.flags_);
+        close(it->second.reply_fd_);
+        running.erase(it);
+    }
+}
+
+/*
+ * Requester has sent a cancel request or has gone away.
+ */
+static void handle_cancel(pid_t pid, std::map<pid_t, RunningCommand> &running)
+{
+    const auto it(running.find(pid));
+
+    if(it == running.end())
+        return;
+
+    char dummy;
+    while(recv(it->second.reply_fd_, &dummy, sizeof(dummy), MSG_DONTWAIT) < 0 &&
+          errno == EINTR)
+        ;
+
+    it->second.watch_reply_fd_ = false;
+    it->second.terminate(pid, HelperReply::CANCELED, now_us());
+}
+
+/*
+ * Main loop of the helper process.
+ *
+ * Requests are read from the control socket, child termination is
+ * reported through a signalfd, and cancel requests are read from the reply
+ * sockets. Deadlines are enforced through the \c poll(2) timeout. The loop
+ * ends when the daemon closes the control socket or dies, in which case all
+ * commands still running are killed.
+ */
+static void helper_main(int control_fd)
+{
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+
+    const int sfd = signalfd(-1, &mask, SFD_CLOEXEC);
+
+    if(sfd < 0)
+    {
+        msg_error(errno, LOG_ERR, "Converter helper: signalfd() failed");
+        return;
+    }
+
+    std::map<pid_t, RunningCommand> running;
+    std::vector<std::string> args;
+    std::vector<struct pollfd> fds;
+    std::vector<pid_t> fd_owners;
+
+    while(1)
+    {
+        const int timeout = process_deadlines(running);
+
+        fds.clear();
+        fd_owners.clear();
+        fds.push_back({control_fd, POLLIN, 0});
+        fds.push_back({sfd, POLLIN, 0});
+
+        for(const auto &it : running)
+        {
+            if(it.second.watch_reply_fd_)
+            {
+                fds.push_back({it.second.reply_fd_, POLLIN, 0});
+                fd_owners.push_back(it.first);
+            }
+        }
+
+        if(poll(fds.data(), fds.size(), timeout) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            msg_error(errno, LOG_ERR, "Converter helper: poll() failed");
+            break;
+        }
+
+        for(size_t i = 0; i < fd_owners.size(); ++i)
+            if(fds[i + 2].revents != 0)
+                handle_cancel(fd_owners[i], running);
+
+        if(fds[1].revents != 0)
+        {
+            struct signalfd_siginfo si;
+
+            while(read(sfd, &si, sizeof(si)) < 0 && errno == EINTR)
+                ;
+
+            reap_children(running);
+        }
+
+        if(fds[0].revents == 0)
+            continue;
+
+        uint32_t timeout_ms;
+        int reply_fd;
+        const int ret = receive_request(control_fd, args, timeout_ms, reply_fd);
+
+        if(ret == 0)
+            break;
+
+        if(ret < 0)
+            continue;
+
+        const auto argv(mk_argv(args));
+        const uint64_t started_us = now_us();
+        pid_t pid;
+        const int err = spawn_command(argv.data(), pid);
+        const uint64_t spawn_us = now_us() - started_us;
+
+        if(err != 0)
+        {
+            send_reply(reply_fd, err, 0, spawn_us, 0, 0);
+            close(reply_fd);
+            continue;
+        }
+
+        running.emplace(pid, RunningCommand(reply_fd, started_us, spawn_us,
+                                            timeout_ms));
+    }
+
+    for(const auto &it : running)
+    {
+        killpg(it.first, SIGKILL);
+        close(it.second.reply_fd_);
+    }
+
+    close(sfd);
+}
+
+Converter::SpawnCancel::SpawnCancel():
+    fd_(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+{
+    if(fd_ < 0)
+        msg_error(errno, LOG_ERR, "Failed creating cancel event");
+}
+
+Converter::SpawnCancel::~SpawnCancel()
+{
+    if(fd_ >= 0)
+        close(fd_);
+}
+
+void Converter::SpawnCancel::trigger()
+{
+    static const uint64_t one = 1;
+
+    if(fd_ >= 0)
+        while(write(fd_, &one, sizeof(one)) < 0 && errno == EINTR)
+            ;
+}
+
+bool Converter::SpawnCancel::is_triggered() const
+{
+    if(fd_ < 0)
+        return false;
+
+    struct pollfd pfd { fd_, POLLIN, 0 };
+
+    return poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN) != 0;
+}
+
+bool Converter::SpawnHelper::start()
+{
+    if(control_fd_ >= 0)
+        return true;
+
+    int fds[2];
+
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed creating converter helper socket");
+        return false;
+    }
+
+    const pid_t pid = fork();
+
+    if(pid < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed forking converter helper");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    if(pid == 0)
+    {
+        close(fds[0]);
+        helper_main(fds[1]);
+        _exit(EXIT_SUCCESS);
+    }
+
+    close(fds[1]);
+    control_fd_ = fds[0];
+    helper_pid_ = pid;
+
+    msg_vinfo(MESSAGE_LEVEL_DIAG, "Started converter helper process %d", pid);
+
+    return true;
+}
+
+void Converter::SpawnHelper::stop()
+{
+    if(control_fd_ >= 0)
+    {
+        close(control_fd_);
+        control_fd_ = -1;
+    }
+
+    if(helper_pid_ > 0)
+    {
+        while(waitpid(helper_pid_, nullptr, 0) < 0 && errno == EINTR)
+            ;
+
+        helper_pid_ = -1;
+    }
+}
+
+/*
+ * Fallback for running commands without helper process.
+ *
+ * There is no \c SIGCHLD notification here (the signal belongs to the
+ * daemon), so the child is polled for as long as a deadline or cancellation
+ * must be enforced.
+ */
+static bool run_locally(const std::vector<std::string> &args,
+                        Converter::SpawnResult &result, uint32_t timeout_ms,
+                        const Converter::SpawnCancel *cancel)
+{
+    const auto argv(mk_argv(args));
+    const uint64_t started_us = now_us();
+    pid_t pid;
+
+    result.error_ = spawn_command(argv.data(), pid);
+    result.spawn_us_ = now_us() - started_us;
+
+    if(result.error_ != 0)
+        return false;
+
+    const bool must_poll = timeout_ms > 0 || cancel != nullptr;
+    RunningCommand cmd(-1, started_us, result.spawn_us_, timeout_ms);
+    int status;
+    pid_t ret;
+
+    while((ret = waitpid(pid, &status, must_poll ? WNOHANG : 0)) <= 0)
+    {
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            result.error_ = errno;
+            return false;
+        }
+
+        const uint64_t now = now_us();
+
+        if(cancel != nullptr && cancel->is_triggered())
+            cmd.terminate(pid, HelperReply::CANCELED, now);
+
+        const int timeout = to_poll_timeout(cmd.process_deadline(pid, now), now);
+        poll(nullptr, 0,
+             timeout < 0 ? local_poll_interval_ms
+                         : std::min(timeout, local_poll_interval_ms));
+    }
+
+    result.run_us_ = now_us() - started_us;
+    fill_result(result, status, cmd.flags_);
+
+    return true;
+}
+
+static bool send_request(int control_fd, const std::string &request,
+                         int reply_fd)
+{
+    union
+    {
+        struct cmsghdr align_;
+        char buf_[CMSG_SPACE(sizeof(int))];
+    }
+    cmsg_buffer;
+
+    memset(&cmsg_buffer, 0, sizeof(cmsg_buffer));
+
+    struct iovec iov;
+    iov.iov_base = const_cast<char *>(request.data());
+    iov.iov_len = request.size();
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cmsg_buffer.buf_;
+    msg.msg_controllen = sizeof(cmsg_buffer.buf_);
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(c), &reply_fd, sizeof(int));
+
+    ssize_t ret;
+
+    while((ret = sendmsg(control_fd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+        ;
+
+    return ret == ssize_t(request.size());
+}
+
+/*
+ * Wait for reply from helper process, forwarding cancellation.
+ */
+static bool wait_for_reply(int reply_fd, const Converter::SpawnCancel *cancel,
+                           HelperReply &reply)
+{
+    bool cancel_sent = cancel == nullptr || cancel->get_fd() < 0;
+
+    while(1)
+    {
+        struct pollfd fds[2];
+        fds[0] = {reply_fd, POLLIN, 0};
+        fds[1] = {cancel_sent ? -1 : cancel->get_fd(), POLLIN, 0};
+
+        if(poll(fds, cancel_sent ? 1 : 2, -1) < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            return false;
+        }
+
+        if(!cancel_sent && fds[1].revents != 0)
+        {
+            static const char cancel_request = 'c';
+            send(reply_fd, &cancel_request, sizeof(cancel_request), MSG_NOSIGNAL);
+            cancel_sent = true;
+        }
+
+        if(fds[0].revents == 0)
+            continue;
+
+        ssize_t len;
+
+        while((len = recv(reply_fd, &reply, sizeof(reply), 0)) < 0 &&
+              errno == EINTR)
+            ;
+
+        return len == sizeof(reply);
+    }
+}
+
+bool Converter::SpawnHelper::run(const std::vector<std::string> &argv,
+                                 SpawnResult &result, unsigned int timeout_ms,
+                                 const SpawnCancel *cancel) const
+{
+    if(argv.empty())
+    {
+        MSG_BUG("Cannot run empty command");
+        result.error_ = EINVAL;
+        return false;
+    }
+
+    if(cancel != nullptr && cancel->is_triggered())
+    {
+        result.canceled_ = true;
+        result.error_ = ECANCELED;
+        return false;
+    }
+
+    if(control_fd_ < 0)
+        return run_locally(argv, result, timeout_ms, cancel);
+
+    const HelperRequest header { timeout_ms };
+    std::string request(reinterpret_cast<const char *>(&header), sizeof(header));
+
+    for(const auto &a : argv)
+    {
+        request += a;
+        request.push_back('\0');
+    }
+
+    if(request.size() > max_request_size)
+    {
+        msg_error(E2BIG, LOG_ERR, "Command too long for converter helper");
+        result.error_ = E2BIG;
+        return false;
+    }
+
+    int fds[2];
+
+    if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0)
+    {
+        msg_error(errno, LOG_ERR, "Failed creating reply socket");
+        result.error_ = errno;
+        return false;
+    }
+
+    const bool sent = send_request(control_fd_, request, fds[1]);
+    close(fds[1]);
+
+    if(!sent)
+    {
+        close(fds[0]);
+        msg_error(errno, LOG_ERR,
+                  "Converter helper not available, running \"%s\" directly",
+                  argv[0].c_str());
+        return run_locally(argv, result, timeout_ms, cancel);
+    }
+
+    HelperReply reply;
+    const bool have_reply = wait_for_reply(fds[0], cancel, reply);
+
+    close(fds[0]);
+
+    if(!have_reply)
+    {
+        msg_error(0, LOG_ERR, "No reply from converter helper for \"%s\"",
+                  argv[0].c_str());
+        result.error_ = ECHILD;
+        return false;
+    }
+
+    result.error_ = reply.error_;
+    result.spawn_us_ = reply.spawn_us_;
+    result.run_us_ = reply.run_us_;
+
+    if(result.error_ != 0)
+        return false;
+
+    fill_result(result, reply.wait_status_, reply.flags_);
+
+    return true;
+}
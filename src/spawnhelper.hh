@@ -0,0 +1,183 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef SPAWNHELPER_HH
+#define SPAWNHELPER_HH
+
+#include <string>
+#include <vector>
+#include <cinttypes>
+#include <sys/types.h>
+
+namespace Converter
+{
+
+/*!
+ * Outcome of running an external command.
+ */
+class SpawnResult
+{
+  public:
+    /*! Error code if the command could not be started, 0 otherwise. */
+    int error_;
+
+    /*! Exit code of the command, -1 if it has not terminated normally. */
+    int exit_code_;
+
+    /*! Signal which has terminated the command, 0 if none. */
+    int signal_;
+
+    /*! Time it took to start the process, in microseconds. */
+    uint64_t spawn_us_;
+
+    /*! Time from process start to its termination, in microseconds. */
+    uint64_t run_us_;
+
+    /*! True if the command has been terminated because of its deadline. */
+    bool timed_out_;
+
+    /*! True if the command has been terminated on request. */
+    bool canceled_;
+
+    SpawnResult(const SpawnResult &) = delete;
+    SpawnResult &operator=(const SpawnResult &) = delete;
+
+    explicit SpawnResult():
+        error_(0),
+        exit_code_(-1),
+        signal_(0),
+        spawn_us_(0),
+        run_us_(0),
+        timed_out_(false),
+        canceled_(false)
+    {}
+
+    bool succeeded() const
+    {
+        return error_ == 0 && exit_code_ == 0 && !timed_out_ && !canceled_;
+    }
+};
+
+/*!
+ * Cancellation flag for commands run by #Converter::SpawnHelper.
+ *
+ * The flag can be raised from any thread. Commands which are running while
+ * the flag is raised are terminated, commands started while the flag is
+ * raised are not started at all.
+ */
+class SpawnCancel
+{
+  private:
+    int fd_;
+
+  public:
+    SpawnCancel(const SpawnCancel &) = delete;
+    SpawnCancel &operator=(const SpawnCancel &) = delete;
+
+    explicit SpawnCancel();
+    ~SpawnCancel();
+
+    void trigger();
+    bool is_triggered() const;
+
+    int get_fd() const { return fd_; }
+};
+
+/*!
+ * Long-lived helper process for running external commands.
+ *
+ * Starting processes from the multi-threaded daemon is expensive and
+ * fragile, so commands are passed to a small helper process which is forked
+ * early while the daemon is still single-threaded. The helper starts the
+ * commands using \c posix_spawn(3), without any shell, and reports exit
+ * status and timings back to the caller.
+ *
+ * Each request carries its own reply channel, so that any number of threads
+ * can run commands concurrently. The helper supervises all commands in a
+ * single event loop. Commands which exceed their deadline or which are
+ * canceled are sent \c SIGTERM, followed by \c SIGKILL if they do not
+ * terminate in time. Each command runs in its own process group so that
+ * these signals also reach any processes it has started.
+ */
+class SpawnHelper
+{
+  private:
+    int control_fd_;
+    pid_t helper_pid_;
+
+  public:
+    SpawnHelper(const SpawnHelper &) = delete;
+    SpawnHelper &operator=(const SpawnHelper &) = delete;
+
+    explicit SpawnHelper():
+        control_fd_(-1),
+        helper_pid_(-1)
+    {}
+
+    ~SpawnHelper() { stop(); }
+
+    /*!
+     * Fork the helper process.
+     *
+     * Must be called before any threads are started.
+     */
+    bool start();
+
+    /*!
+     * Stop the helper process.
+     *
+     * Commands which are still running are killed by the helper process.
+     */
+    void stop();
+
+    bool is_running() const { return control_fd_ >= 0; }
+
+    /*!
+     * Run command and wait for its termination.
+     *
+     * This function is thread-safe. If the helper process is not running,
+     * then the command is started directly from the calling process.
+     *
+     * \param argv
+     *     Command and its arguments. The command is searched in \c PATH.
+     *
+     * \param[out] result
+     *     Exit status and timings.
+     *
+     * \param timeout_ms
+     *     Terminate the command if it is still running after this many
+     *     milliseconds. Pass 0 for no deadline.
+     *
+     * \param cancel
+     *     Optional cancellation flag for terminating the command early.
+     *
+     * \returns
+     *     True if the command has been run (check \p result for its exit
+     *     status), false if it could not be started.
+     */
+    bool run(const std::vector<std::string> &argv, SpawnResult &result,
+             unsigned int timeout_ms = 0,
+             const SpawnCancel *cancel = nullptr) const;
+};
+
+}
+
+#endif /* !SPAWNHELPER_HH */
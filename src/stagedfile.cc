@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "stagedfile.hh"
+#include "messages.h"
+
+/*
+ * File systems without \c O_TMPFILE support fail with one of these.
+ */
+static bool is_tmpfile_unsupported(int error)
+{
+    return error == EOPNOTSUPP || error == EISDIR || error == EINVAL;
+}
+
+bool Converter::StagedFile::create(const std::string &directory)
+{
+    discard();
+
+#ifdef O_TMPFILE
+    fd_ = open(directory.c_str(), O_TMPFILE | O_WRONLY | O_CLOEXEC, 0644);
+
+    if(fd_ >= 0)
+        return true;
+
+    if(!is_tmpfile_unsupported(errno))
+    {
+        msg_error(errno, LOG_ERR,
+                  "Failed creating temporary file in \"%s\"", directory.c_str());
+        return false;
+    }
+#endif /* O_TMPFILE */
+
+    temp_path_ = directory + "/.staged.XXXXXX";
+    fd_ = mkostemp(&temp_path_[0], O_CLOEXEC);
+
+    if(fd_ < 0)
+    {
+        msg_error(errno, LOG_ERR,
+                  "Failed creating temporary file \"%s\"", temp_path_.c_str());
+        temp_path_.clear();
+        return false;
+    }
+
+    if(fchmod(fd_, 0644) < 0)
+        msg_error(errno, LOG_NOTICE,
+                  "Failed setting mode of \"%s\"", temp_path_.c_str());
+
+    return true;
+}
+
+bool Converter::StagedFile::write(const uint8_t *data, size_t length)
+{
+    if(fd_ < 0)
+    {
+        MSG_BUG("Write to staged file which is not open");
+        return false;
+    }
+
+    while(length > 0)
+    {
+        const ssize_t ret = ::write(fd_, data, length);
+
+        if(ret < 0)
+        {
+            if(errno == EINTR)
+                continue;
+
+            msg_error(errno, LOG_ERR, "Failed writing staged file");
+            return false;
+        }
+
+        data += ret;
+        length -= ret;
+    }
+
+    return true;
+}
+
+bool Converter::StagedFile::link_to(const std::string &path)
+{
+    if(fd_ < 0)
+    {
+        MSG_BUG("Link staged file which is not open");
+        return false;
+    }
+
+    bool ok;
+
+    if(temp_path_.empty())
+    {
+        /* linkat(2) with AT_EMPTY_PATH requires special privileges, going
+         * through procfs does not */
+        char proc_path[64];
+        snprintf(proc_path, sizeof(proc_path), "/proc/self/fd/%d", fd_);
+
+        ok = linkat(AT_FDCWD, proc_path, AT_FDCWD, path.c_str(),
+                    AT_SYMLINK_FOLLOW) == 0;
+    }
+    else
+    {
+        ok = rename(temp_path_.c_str(), path.c_str()) == 0;
+
+        if(ok)
+            temp_path_.clear();
+    }
+
+    if(!ok)
+        msg_error(errno, LOG_ERR, "Failed linking staged file to \"%s\"",
+                  path.c_str());
+
+    discard();
+
+    return ok;
+}
+
+void Converter::StagedFile::discard()
+{
+    if(fd_ >= 0)
+    {
+        close(fd_);
+        fd_ = -1;
+    }
+
+    if(!temp_path_.empty())
+    {
+        unlink(temp_path_.c_str());
+        temp_path_.clear();
+    }
+}
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#ifndef STAGEDFILE_HH
+#define STAGEDFILE_HH
+
+#include <string>
+#include <cinttypes>
+
+namespace Converter
+{
+
+/*!
+ * File which appears in the file system only once it is complete.
+ *
+ * The file is created using \c O_TMPFILE where supported, so that nothing
+ * is left behind if the file is discarded or if the process dies. On file
+ * systems without support for \c O_TMPFILE, a uniquely named file is used
+ * and renamed in the end.
+ */
+class StagedFile
+{
+  private:
+    int fd_;
+
+    /* name of the fallback file, empty if created with \c O_TMPFILE */
+    std::string temp_path_;
+
+  public:
+    StagedFile(const StagedFile &) = delete;
+    StagedFile &operator=(const StagedFile &) = delete;
+
+    explicit StagedFile():
+        fd_(-1)
+    {}
+
+    ~StagedFile() { discard(); }
+
+    /*!
+     * Create anonymous file in given directory.
+     *
+     * The file can only be linked to paths on the same file system as
+     * \p directory.
+     */
+    bool create(const std::string &directory);
+
+    /*!
+     * Append data to file.
+     */
+    bool write(const uint8_t *data, size_t length);
+
+    /*!
+     * Make file visible under given name, then close it.
+     *
+     * The file is discarded in case of failure.
+     */
+    bool link_to(const std::string &path);
+
+    /*!
+     * Close and remove file, if any.
+     */
+    void discard();
+
+    bool is_open() const { return fd_ >= 0; }
+
+    /*!
+     * Whether or not the file has been created using \c O_TMPFILE.
+     */
+    bool is_anonymous() const { return fd_ >= 0 && temp_path_.empty(); }
+};
+
+}
+
+#endif /* !STAGEDFILE_HH */
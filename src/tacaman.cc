@@ -1,5 +1,5 @@
 /*
- * Copyright (C) 2017, 2020  T+A elektroakustik GmbH & Co. KG
+ * Copyright (C) 2017, 2020, 2026  T+A elektroakustik GmbH & Co. KG
  *
  * This file is part of TACAMan.
  *
@@ -24,6 +24,10 @@
 #endif /* HAVE_CONFIG_H */
 
 #include <cstring>
+#include <cerrno>
+#include <limits>
+#include <algorithm>
+#include <thread>
 #include <iostream>
 
 #include <glib-unix.h>
@@ -42,6 +46,10 @@ struct parameters
     bool run_in_foreground;
     bool connect_to_session_dbus;
     const char *cache_root;
+    size_t object_memory_budget;
+    unsigned int number_of_workers;
+    size_t max_queued_jobs;
+    size_t max_queued_bytes;
 };
 
 ssize_t (*os_read)(int fd, void *dest, size_t count) = read;
@@ -76,8 +84,19 @@ static void usage(const char *program_name)
         "  --quiet        Short for \"--verbose quite\".\n"
         "  --fg           Run in foreground, don't run as daemon.\n"
         "  --croot path   Path to cache root.\n"
+        "  --memcache n   Keep up to n bytes of recently used objects in RAM\n"
+        "                 (default: 2097152, 0 disables).\n"
+        "  --workers n    Number of images downloaded, decoded, and encoded\n"
+        "                 in parallel (default: number of CPU cores).\n"
+        "  --max-queued n Maximum number of images waiting for conversion\n"
+        "                 (default: 300).\n"
+        "  --max-queued-bytes n\n"
+        "                 Maximum size of image data waiting for conversion\n"
+        "                 (default: 33554432).\n"
         "  --session-dbus Connect to session D-Bus.\n"
         "  --system-dbus  Connect to system D-Bus.\n"
+        "\n"
+        "Send SIGUSR1 to log the number of queued images per D-Bus client.\n"
         ;
 }
 
@@ -94,6 +113,26 @@ static bool check_argument(int argc, char *argv[], int &i)
     return true;
 }
 
+static bool parse_size(const char *option, const char *arg, size_t &value)
+{
+    char *endptr = nullptr;
+
+    errno = 0;
+    const unsigned long long temp = strtoull(arg, &endptr, 10);
+
+    if(errno != 0 || *arg == '\0' || *arg == '-' || *endptr != '\0' ||
+       temp > std::numeric_limits<size_t>::max())
+    {
+        std::cerr << "Invalid argument \"" << arg << "\" for option "
+                  << option << ".\n";
+        return false;
+    }
+
+    value = temp;
+
+    return true;
+}
+
 static int process_command_line(int argc, char *argv[],
                                 struct parameters *parameters)
 {
@@ -101,6 +140,10 @@ static int process_command_line(int argc, char *argv[],
     parameters->run_in_foreground = false;
     parameters->connect_to_session_dbus = true;
     parameters->cache_root = "/var/local/data/tacaman";
+    parameters->object_memory_budget = 2U * 1024U * 1024U;
+    parameters->number_of_workers = std::max(std::thread::hardware_concurrency(), 1U);
+    parameters->max_queued_jobs = 300;
+    parameters->max_queued_bytes = 32U * 1024U * 1024U;
 
     for(int i = 1; i < argc; ++i)
     {
@@ -140,6 +183,64 @@ static int process_command_line(int argc, char *argv[],
 
             parameters->cache_root = argv[i];
         }
+        else if(strcmp(argv[i], "--memcache") == 0)
+        {
+            if(!check_argument(argc, argv, i))
+                return -1;
+
+            if(!parse_size(argv[i - 1], argv[i],
+                           parameters->object_memory_budget))
+                return -1;
+        }
+        else if(strcmp(argv[i], "--workers") == 0)
+        {
+            if(!check_argument(argc, argv, i))
+                return -1;
+
+            size_t temp;
+
+            if(!parse_size(argv[i - 1], argv[i], temp))
+                return -1;
+
+            if(temp == 0 || temp > std::numeric_limits<unsigned int>::max())
+            {
+                std::cerr << "Invalid number of workers \"" << argv[i]
+                          << "\".\n";
+                return -1;
+            }
+
+            parameters->number_of_workers = temp;
+        }
+        else if(strcmp(argv[i], "--max-queued") == 0)
+        {
+            if(!check_argument(argc, argv, i))
+                return -1;
+
+            if(!parse_size(argv[i - 1], argv[i], parameters->max_queued_jobs))
+                return -1;
+
+            if(parameters->max_queued_jobs == 0)
+            {
+                std::cerr << "Invalid number of queued images \"" << argv[i]
+                          << "\".\n";
+                return -1;
+            }
+        }
+        else if(strcmp(argv[i], "--max-queued-bytes") == 0)
+        {
+            if(!check_argument(argc, argv, i))
+                return -1;
+
+            if(!parse_size(argv[i - 1], argv[i], parameters->max_queued_bytes))
+                return -1;
+
+            if(parameters->max_queued_bytes == 0)
+            {
+                std::cerr << "Invalid number of queued bytes \"" << argv[i]
+                          << "\".\n";
+                return -1;
+            }
+        }
         else if(strcmp(argv[i], "--session-dbus") == 0)
             parameters->connect_to_session_dbus = true;
         else if(strcmp(argv[i], "--system-dbus") == 0)
@@ -192,10 +293,19 @@ static gboolean signal_handler(gpointer user_data)
     return G_SOURCE_REMOVE;
 }
 
-static void connect_unix_signals(GMainLoop *loop)
+static gboolean dump_statistics_handler(gpointer user_data)
+{
+    static_cast<const Converter::Queue *>(user_data)->dump_client_statistics();
+    return G_SOURCE_CONTINUE;
+}
+
+static void connect_unix_signals(GMainLoop *loop,
+                                 const Converter::Queue &converter_queue)
 {
     g_unix_signal_add(SIGINT, signal_handler, loop);
     g_unix_signal_add(SIGTERM, signal_handler, loop);
+    g_unix_signal_add(SIGUSR1, dump_statistics_handler,
+                      const_cast<Converter::Queue *>(&converter_queue));
 }
 
 int main(int argc, char *argv[])
@@ -230,9 +340,13 @@ int main(int argc, char *argv[])
         2 * maximum_number_of_keys * Converter::get_output_format_list().get_formats().size()
     );
 
-    static Converter::Queue converter_queue(parameters.cache_root);
+    static Converter::Queue converter_queue(parameters.cache_root,
+                                            parameters.number_of_workers,
+                                            parameters.max_queued_jobs,
+                                            parameters.max_queued_bytes);
     static ArtCache::Manager cman(parameters.cache_root, limits,
-                                  converter_queue);
+                                  converter_queue,
+                                  parameters.object_memory_budget);
 
     converter_queue.init();
 
@@ -244,7 +358,7 @@ int main(int argc, char *argv[])
     if(dbus_setup(loop, parameters.connect_to_session_dbus, &dbus_signal_data) < 0)
         return EXIT_FAILURE;
 
-    connect_unix_signals(loop);
+    connect_unix_signals(loop, converter_queue);
     g_main_loop_run(loop);
 
     msg_vinfo(MESSAGE_LEVEL_IMPORTANT, "Shutting down");
@@ -0,0 +1,254 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+/*
+ * Benchmark for the resampling kernels.
+ *
+ * Scales a synthetic picture to the size of a cover thumbnail with the
+ * scalar and the SIMD kernel, and with ImageMagick's convert tool if it is
+ * available. Reports time per picture and the PSNR of the results against
+ * the scalar kernel and against convert.
+ *
+ * Usage: bench_resample [width height [iterations [max_size]]]
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <unistd.h>
+
+#include "resample.hh"
+
+using Clock = std::chrono::steady_clock;
+
+static void mk_picture(Converter::RGBAImage &image,
+                       unsigned int width, unsigned int height)
+{
+    image.set_size(width, height);
+
+    for(unsigned int y = 0; y < height; ++y)
+    {
+        uint8_t *p = image.row(y);
+
+        for(unsigned int x = 0; x < width; ++x)
+        {
+            /* smooth gradients with fine details on top */
+            const bool checker = ((x / 3) ^ (y / 3)) & 1;
+            p[0] = uint8_t(255 * x / width);
+            p[1] = uint8_t(255 * y / height);
+            p[2] = checker ? 230 : 20;
+            p[3] = 255;
+            p += 4;
+        }
+    }
+}
+
+static double psnr(const Converter::RGBAImage &a, const Converter::RGBAImage &b)
+{
+    if(a.width_ != b.width_ || a.height_ != b.height_)
+        return -1.0;
+
+    double sum = 0.0;
+    size_t count = 0;
+
+    for(size_t i = 0; i < a.pixels_.size(); i += 4)
+    {
+        for(unsigned int ch = 0; ch < 3; ++ch)
+        {
+            const double d = double(a.pixels_[i + ch]) - double(b.pixels_[i + ch]);
+            sum += d * d;
+            ++count;
+        }
+    }
+
+    if(sum == 0.0)
+        return INFINITY;
+
+    return 10.0 * std::log10(255.0 * 255.0 / (sum / count));
+}
+
+static double run_kernel(const Converter::RGBAImage &src,
+                         unsigned int width, unsigned int height,
+                         unsigned int iterations,
+                         Converter::ResampleKernel kernel,
+                         Converter::RGBAImage &dest)
+{
+    const auto start(Clock::now());
+
+    for(unsigned int i = 0; i < iterations; ++i)
+        Converter::resample(src, width, height, dest, kernel);
+
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+           iterations;
+}
+
+static bool write_pam(const Converter::RGBAImage &image, const std::string &filename)
+{
+    FILE *f = fopen(filename.c_str(), "wb");
+    if(f == nullptr)
+        return false;
+
+    fprintf(f, "P7\nWIDTH %u\nHEIGHT %u\nDEPTH 4\nMAXVAL 255\n"
+            "TUPLTYPE RGB_ALPHA\nENDHDR\n", image.width_, image.height_);
+    const bool ok = fwrite(image.pixels_.data(), 1, image.pixels_.size(), f) ==
+                    image.pixels_.size();
+
+    return fclose(f) == 0 && ok;
+}
+
+static bool read_pam(Converter::RGBAImage &image, const std::string &filename)
+{
+    FILE *f = fopen(filename.c_str(), "rb");
+    if(f == nullptr)
+        return false;
+
+    unsigned int width = 0;
+    unsigned int height = 0;
+    unsigned int depth = 0;
+    char line[128];
+
+    while(fgets(line, sizeof(line), f) != nullptr &&
+          strcmp(line, "ENDHDR\n") != 0)
+    {
+        sscanf(line, "WIDTH %u", &width);
+        sscanf(line, "HEIGHT %u", &height);
+        sscanf(line, "DEPTH %u", &depth);
+    }
+
+    bool ok = width > 0 && height > 0 && (depth == 3 || depth == 4);
+
+    if(ok)
+    {
+        image.set_size(width, height);
+
+        for(size_t i = 0; ok && i < image.pixels_.size(); i += 4)
+        {
+            ok = fread(&image.pixels_[i], 1, depth, f) == depth;
+
+            if(depth == 3)
+                image.pixels_[i + 3] = 255;
+        }
+    }
+
+    fclose(f);
+
+    return ok;
+}
+
+static void run_convert(const Converter::RGBAImage &src,
+                        unsigned int max_size, unsigned int iterations,
+                        const Converter::RGBAImage &reference)
+{
+    if(system("convert -version >/dev/null 2>&1") != 0)
+    {
+        printf("convert:  not available, skipped\n");
+        return;
+    }
+
+    char dir[] = "/tmp/bench_resample.XXXXXX";
+    if(mkdtemp(dir) == nullptr)
+        return;
+
+    const std::string infile(std::string(dir) + "/in.pam");
+    const std::string outfile(std::string(dir) + "/out.pam");
+    const std::string command("convert '" + infile + "' -resize " +
+                              std::to_string(max_size) + 'x' +
+                              std::to_string(max_size) + " '" + outfile + "'");
+
+    if(write_pam(src, infile))
+    {
+        const auto start(Clock::now());
+        bool ok = true;
+
+        for(unsigned int i = 0; ok && i < iterations; ++i)
+            ok = system(command.c_str()) == 0;
+
+        const double ms =
+            std::chrono::duration<double, std::milli>(Clock::now() - start).count() /
+            iterations;
+
+        Converter::RGBAImage result;
+
+        if(ok && read_pam(result, outfile))
+            printf("convert:  %8.2f ms/picture, PSNR vs SIMD %.2f dB\n",
+                   ms, psnr(result, reference));
+        else
+            printf("convert:  failed\n");
+    }
+
+    unlink(infile.c_str());
+    unlink(outfile.c_str());
+    rmdir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+    const unsigned int width = argc > 2 ? atoi(argv[1]) : 1500;
+    const unsigned int height = argc > 2 ? atoi(argv[2]) : 1500;
+    const unsigned int iterations = argc > 3 ? std::max(1, atoi(argv[3])) : 20;
+    const unsigned int max_size = argc > 4 ? atoi(argv[4]) : 120;
+
+    if(width == 0 || height == 0 || max_size == 0)
+    {
+        fprintf(stderr, "Invalid arguments\n");
+        return EXIT_FAILURE;
+    }
+
+    Converter::RGBAImage src;
+    mk_picture(src, width, height);
+
+    unsigned int dest_width;
+    unsigned int dest_height;
+    Converter::fit_dimensions(width, height, max_size, max_size,
+                              dest_width, dest_height);
+
+    printf("Scaling %ux%u to %ux%u, %u iterations\n",
+           width, height, dest_width, dest_height, iterations);
+
+    Converter::RGBAImage scalar;
+    Converter::RGBAImage simd;
+
+    const double scalar_ms =
+        run_kernel(src, dest_width, dest_height, iterations,
+                   Converter::ResampleKernel::SCALAR, scalar);
+    const double simd_ms =
+        run_kernel(src, dest_width, dest_height, iterations,
+                   Converter::ResampleKernel::SIMD, simd);
+
+    const double mpixels = double(width) * height / 1e6;
+
+    printf("scalar:   %8.2f ms/picture, %8.2f Mpixel/s\n",
+           scalar_ms, mpixels / (scalar_ms / 1000.0));
+    printf("SIMD %-4s %8.2f ms/picture, %8.2f Mpixel/s, PSNR vs scalar %.2f dB\n",
+           Converter::get_resample_simd_name(), simd_ms,
+           mpixels / (simd_ms / 1000.0), psnr(simd, scalar));
+
+    run_convert(src, max_size, std::min(iterations, 5U), simd);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include "cacheindex.hh"
+
+/*!
+ * \addtogroup cache_index_tests Unit tests
+ * \ingroup cache
+ *
+ * Cache index unit tests.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("Cache Index");
+
+static const std::string key("64ef367018099de4d4183ffa3bc0848a");
+static const std::string source("e9a3ee7c4f9ff1bba4e1d6b6d8dde8a5");
+static const std::string object("0123456789abcdef0123456789abcdef");
+
+TEST_CASE("Empty index finds nothing")
+{
+    const ArtCache::Index idx;
+
+    CHECK(idx.find_key(key) == nullptr);
+    CHECK(idx.find_source_for_key(key, 100) == nullptr);
+    CHECK(idx.find_source(source) == nullptr);
+    CHECK(idx.find_object_for_format(source, "png@120x120") == nullptr);
+
+    size_t size = 0;
+    CHECK_FALSE(idx.get_object_size(object, size));
+
+    CHECK(idx.get_number_of_stream_keys() == 0);
+    CHECK(idx.get_number_of_sources() == 0);
+    CHECK(idx.get_number_of_objects() == 0);
+}
+
+TEST_CASE("Pending stream key is not linked to any source")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 100);
+
+    const auto *prios = idx.find_key(key);
+    REQUIRE(prios != nullptr);
+    REQUIRE(prios->size() == 1);
+    CHECK(prios->begin()->first == 100);
+
+    const auto *src = idx.find_source_for_key(key, 100);
+    REQUIRE(src != nullptr);
+    CHECK(src->empty());
+
+    CHECK(idx.find_source_for_key(key, 101) == nullptr);
+}
+
+TEST_CASE("Highest priority is last in priority map")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 20);
+    idx.add_key(key, 200);
+    idx.add_key(key, 3);
+
+    const auto *prios = idx.find_key(key);
+    REQUIRE(prios != nullptr);
+    REQUIRE(prios->size() == 3);
+    CHECK(prios->rbegin()->first == 200);
+    CHECK(prios->begin()->first == 3);
+    CHECK(idx.get_number_of_stream_keys() == 1);
+}
+
+TEST_CASE("Full chain from stream key to object")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 50);
+    idx.add_source(source);
+    idx.add_object(object, 4711);
+    idx.set_key_source(key, 50, source);
+    idx.set_source_object(source, "png@120x120", object);
+
+    const auto *src = idx.find_source_for_key(key, 50);
+    REQUIRE(src != nullptr);
+    CHECK(*src == source);
+
+    const auto *obj = idx.find_object_for_format(*src, "png@120x120");
+    REQUIRE(obj != nullptr);
+    CHECK(*obj == object);
+    CHECK(idx.find_object_for_format(*src, "jpg@400x400") == nullptr);
+
+    size_t size = 0;
+    CHECK(idx.get_object_size(*obj, size));
+    CHECK(size == 4711);
+}
+
+TEST_CASE("Adding a key twice keeps its link to the source")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 50);
+    idx.set_key_source(key, 50, source);
+    idx.add_key(key, 50);
+
+    const auto *src = idx.find_source_for_key(key, 50);
+    REQUIRE(src != nullptr);
+    CHECK(*src == source);
+}
+
+TEST_CASE("Re-adding a source drops its formats")
+{
+    ArtCache::Index idx;
+
+    idx.add_source(source);
+    idx.set_source_object(source, "png@120x120", object);
+    REQUIRE(idx.find_object_for_format(source, "png@120x120") != nullptr);
+
+    idx.add_source(source);
+    const auto *formats = idx.find_source(source);
+    REQUIRE(formats != nullptr);
+    CHECK(formats->empty());
+}
+
+TEST_CASE("Removing last priority removes the stream key")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 10);
+    idx.add_key(key, 20);
+
+    idx.remove_key(key, 10);
+    REQUIRE(idx.find_key(key) != nullptr);
+    CHECK(idx.find_key(key)->size() == 1);
+
+    idx.remove_key(key, 20);
+    CHECK(idx.find_key(key) == nullptr);
+    CHECK(idx.get_number_of_stream_keys() == 0);
+
+    /* removing unknown keys is harmless */
+    idx.remove_key(key, 20);
+}
+
+TEST_CASE("Removing stream key removes all of its priorities")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 10);
+    idx.add_key(key, 20);
+    idx.remove_stream_key(key);
+
+    CHECK(idx.find_key(key) == nullptr);
+}
+
+TEST_CASE("Sources and objects can be removed")
+{
+    ArtCache::Index idx;
+
+    idx.add_source(source);
+    idx.add_object(object, 12);
+    CHECK(idx.get_number_of_sources() == 1);
+    CHECK(idx.get_number_of_objects() == 1);
+
+    idx.remove_source(source);
+    idx.remove_object(object);
+
+    CHECK(idx.find_source(source) == nullptr);
+    size_t size = 0;
+    CHECK_FALSE(idx.get_object_size(object, size));
+    CHECK(idx.get_number_of_sources() == 0);
+    CHECK(idx.get_number_of_objects() == 0);
+}
+
+TEST_CASE("Clearing the index removes everything")
+{
+    ArtCache::Index idx;
+
+    idx.add_key(key, 10);
+    idx.add_source(source);
+    idx.add_object(object, 12);
+    idx.clear();
+
+    CHECK(idx.get_number_of_stream_keys() == 0);
+    CHECK(idx.get_number_of_sources() == 0);
+    CHECK(idx.get_number_of_objects() == 0);
+}
+
+TEST_CASE("Empty priority bitmap has no highest priority")
+{
+    const ArtCache::PriorityBitmap bm;
+
+    CHECK(bm.empty());
+    CHECK(bm.highest() == 0);
+    CHECK(bm.next_lower(255) == 0);
+}
+
+TEST_CASE("Priority bitmap finds highest priority across words")
+{
+    ArtCache::PriorityBitmap bm;
+
+    bm.set(1);
+    CHECK(bm.highest() == 1);
+
+    bm.set(63);
+    bm.set(64);
+    CHECK(bm.highest() == 64);
+
+    bm.set(255);
+    CHECK(bm.highest() == 255);
+    CHECK(bm.test(255));
+    CHECK_FALSE(bm.test(254));
+
+    bm.clear(255);
+    CHECK(bm.highest() == 64);
+    CHECK_FALSE(bm.empty());
+}
+
+TEST_CASE("Priority bitmap enumerates priorities in descending order")
+{
+    ArtCache::PriorityBitmap bm;
+
+    bm.set(200);
+    bm.set(128);
+    bm.set(64);
+    bm.set(63);
+    bm.set(2);
+
+    CHECK(bm.next_lower(255) == 200);
+    CHECK(bm.next_lower(200) == 128);
+    CHECK(bm.next_lower(128) == 64);
+    CHECK(bm.next_lower(64) == 63);
+    CHECK(bm.next_lower(63) == 2);
+    CHECK(bm.next_lower(2) == 0);
+    CHECK(bm.next_lower(1) == 0);
+}
+
+TEST_CASE("Index maintains priority bitmap of stream keys")
+{
+    ArtCache::Index idx;
+
+    CHECK(idx.find_priorities(key) == nullptr);
+
+    idx.add_key(key, 20);
+    idx.add_key(key, 100);
+
+    const auto *bm = idx.find_priorities(key);
+    REQUIRE(bm != nullptr);
+    CHECK(bm->highest() == 100);
+    CHECK(bm->next_lower(100) == 20);
+
+    idx.remove_key(key, 100);
+    bm = idx.find_priorities(key);
+    REQUIRE(bm != nullptr);
+    CHECK(bm->highest() == 20);
+
+    idx.remove_key(key, 20);
+    CHECK(idx.find_priorities(key) == nullptr);
+}
+
+TEST_SUITE_END();
+
+/*!@}*/
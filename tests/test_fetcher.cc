@@ -0,0 +1,434 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <cstring>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include "fetcher.hh"
+#include "spawnhelper.hh"
+
+/*!
+ * \addtogroup fetcher_tests Unit tests
+ *
+ * Unit tests for the in-process HTTP downloader.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("HTTP fetcher");
+
+/*
+ * Minimal HTTP/1.1 server on the loopback interface.
+ *
+ * Connections are served one at a time, and are kept open between requests
+ * so that connection reuse can be observed.
+ */
+class HTTPStandIn
+{
+  private:
+    int listen_fd_;
+    uint16_t port_;
+    std::atomic<bool> stop_;
+    std::atomic<unsigned int> connections_;
+    std::thread thread_;
+
+  public:
+    HTTPStandIn(const HTTPStandIn &) = delete;
+    HTTPStandIn &operator=(const HTTPStandIn &) = delete;
+
+    explicit HTTPStandIn():
+        listen_fd_(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)),
+        port_(0),
+        stop_(false),
+        connections_(0)
+    {
+        REQUIRE(listen_fd_ >= 0);
+
+        struct sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        REQUIRE(bind(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                     sizeof(addr)) == 0);
+        REQUIRE(listen(listen_fd_, 4) == 0);
+
+        socklen_t len = sizeof(addr);
+        REQUIRE(getsockname(listen_fd_, reinterpret_cast<struct sockaddr *>(&addr),
+                            &len) == 0);
+        port_ = ntohs(addr.sin_port);
+
+        thread_ = std::thread(&HTTPStandIn::serve, this);
+    }
+
+    ~HTTPStandIn()
+    {
+        stop_ = true;
+        shutdown(listen_fd_, SHUT_RDWR);
+        thread_.join();
+        close(listen_fd_);
+    }
+
+    std::string uri(const char *path) const
+    {
+        return "http://127.0.0.1:" + std::to_string(port_) + path;
+    }
+
+    unsigned int get_number_of_connections() const { return connections_; }
+
+    static std::vector<uint8_t> mk_body(size_t length)
+    {
+        std::vector<uint8_t> result(length);
+
+        for(size_t i = 0; i < length; ++i)
+            result[i] = uint8_t(i * 7 + 3);
+
+        return result;
+    }
+
+  private:
+    void serve()
+    {
+        while(!stop_)
+        {
+            const int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+
+            if(fd < 0)
+                continue;
+
+            ++connections_;
+
+            while(!stop_ && serve_request(fd))
+                ;
+
+            close(fd);
+        }
+    }
+
+    static bool send_all(int fd, const void *data, size_t length)
+    {
+        const auto *ptr = static_cast<const uint8_t *>(data);
+
+        while(length > 0)
+        {
+            const ssize_t ret = send(fd, ptr, length, MSG_NOSIGNAL);
+
+            if(ret <= 0)
+                return false;
+
+            ptr += ret;
+            length -= ret;
+        }
+
+        return true;
+    }
+
+    static bool send_response(int fd, const char *status,
+                              const std::string &headers,
+                              const std::vector<uint8_t> &body)
+    {
+        const std::string head(std::string("HTTP/1.1 ") + status + "\r\n" +
+                               headers + "\r\n");
+        return send_all(fd, head.data(), head.size()) &&
+               send_all(fd, body.data(), body.size());
+    }
+
+    static std::string content_length(size_t length)
+    {
+        return "Content-Length: " + std::to_string(length) + "\r\n";
+    }
+
+    bool serve_request(int fd)
+    {
+        std::string request;
+        char buffer[1024];
+
+        while(request.find("\r\n\r\n") == std::string::npos)
+        {
+            const ssize_t ret = recv(fd, buffer, sizeof(buffer), 0);
+
+            if(ret <= 0)
+                return false;
+
+            request.append(buffer, ret);
+        }
+
+        const size_t path_start = request.find(' ') + 1;
+        const std::string path(request.substr(path_start,
+                                              request.find(' ', path_start) - path_start));
+
+        if(path == "/image")
+        {
+            const auto body(mk_body(1000));
+            return send_response(fd, "200 OK", content_length(body.size()), body);
+        }
+
+        if(path == "/big")
+        {
+            const auto body(mk_body(200 * 1024));
+            return send_response(fd, "200 OK", content_length(body.size()), body);
+        }
+
+        if(path == "/big-unknown-length")
+        {
+            send_response(fd, "200 OK", "Connection: close\r\n", mk_body(200 * 1024));
+            return false;
+        }
+
+        if(path == "/empty")
+            return send_response(fd, "200 OK", content_length(0), {});
+
+        if(path == "/redirect")
+            return send_response(fd, "302 Found",
+                                 "Location: /image\r\n" + content_length(0), {});
+
+        if(path == "/loop")
+            return send_response(fd, "302 Found",
+                                 "Location: /loop\r\n" + content_length(0), {});
+
+        if(path == "/truncated")
+        {
+            send_response(fd, "200 OK", content_length(1000), mk_body(10));
+            return false;
+        }
+
+        if(path == "/slow")
+        {
+            send_response(fd, "200 OK", content_length(1000), {});
+
+            for(int i = 0; i < 50 && !stop_; ++i)
+                std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+            return false;
+        }
+
+        send_response(fd, "404 Not Found", content_length(0), {});
+        return true;
+    }
+};
+
+class BufferSink: public Converter::FetchSink
+{
+  public:
+    std::vector<uint8_t> data_;
+    bool fail_;
+
+    explicit BufferSink(): fail_(false) {}
+
+    bool write(const uint8_t *data, size_t length) override
+    {
+        if(fail_)
+            return false;
+
+        data_.insert(data_.end(), data, data + length);
+        return true;
+    }
+};
+
+class Fixture
+{
+  protected:
+    HTTPStandIn server;
+    Converter::Fetcher fetcher;
+    BufferSink sink;
+    Converter::FetchResult result;
+
+  public:
+    explicit Fixture():
+        fetcher(Converter::FetchLimits(100 * 1024, 500))
+    {
+        REQUIRE(fetcher.init());
+    }
+};
+
+TEST_CASE_FIXTURE(Fixture, "Body is passed to sink")
+{
+    REQUIRE(fetcher.fetch(server.uri("/image"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::OK);
+    CHECK(result.http_status_ == 200);
+    CHECK(result.body_bytes_ == 1000);
+    CHECK(sink.data_ == HTTPStandIn::mk_body(1000));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Connection is reused for subsequent downloads")
+{
+    REQUIRE(fetcher.fetch(server.uri("/image"), sink, result));
+    REQUIRE(fetcher.fetch(server.uri("/image"), sink, result));
+    REQUIRE(fetcher.fetch(server.uri("/image"), sink, result));
+    CHECK(sink.data_.size() == 3000);
+    CHECK(server.get_number_of_connections() == 1);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Redirects are followed")
+{
+    REQUIRE(fetcher.fetch(server.uri("/redirect"), sink, result));
+    CHECK(result.http_status_ == 200);
+    CHECK(sink.data_ == HTTPStandIn::mk_body(1000));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Endless redirects are reported as protocol error")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/loop"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::PROTOCOL_ERROR);
+    CHECK_FALSE(result.detail_.empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "HTTP error status is reported with status code")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/missing"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::HTTP_STATUS);
+    CHECK(result.http_status_ == 404);
+    CHECK(sink.data_.empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Empty body is an error")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/empty"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::EMPTY_BODY);
+    CHECK(result.http_status_ == 200);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Body exceeding size limit is rejected by announced length")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/big"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::TOO_LARGE);
+    CHECK(sink.data_.empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Body exceeding size limit is rejected while downloading")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/big-unknown-length"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::TOO_LARGE);
+    CHECK(sink.data_.size() <= 100 * 1024);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Truncated body is reported as network error")
+{
+    CHECK_FALSE(fetcher.fetch(server.uri("/truncated"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::NETWORK_ERROR);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Stalled download is aborted after timeout")
+{
+    const auto start(std::chrono::steady_clock::now());
+    CHECK_FALSE(fetcher.fetch(server.uri("/slow"), sink, result));
+    const auto elapsed(std::chrono::steady_clock::now() - start);
+
+    CHECK(result.error_ == Converter::FetchError::TIMEOUT);
+    CHECK(elapsed >= std::chrono::milliseconds(450));
+    CHECK(elapsed < std::chrono::milliseconds(900));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Download can be canceled from another thread")
+{
+    Converter::Fetcher slow_fetcher(Converter::FetchLimits(100 * 1024, 10000));
+    Converter::SpawnCancel cancel;
+    bool ok = true;
+
+    REQUIRE(slow_fetcher.init());
+
+    std::thread t([this, &slow_fetcher, &cancel, &ok] ()
+                  {
+                      ok = slow_fetcher.fetch(server.uri("/slow"), sink, result, &cancel);
+                  });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    cancel.trigger();
+    t.join();
+
+    CHECK_FALSE(ok);
+    CHECK(result.error_ == Converter::FetchError::CANCELED);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Download is not started if already canceled")
+{
+    Converter::SpawnCancel cancel;
+
+    cancel.trigger();
+    CHECK_FALSE(fetcher.fetch(server.uri("/image"), sink, result, &cancel));
+    CHECK(result.error_ == Converter::FetchError::CANCELED);
+    CHECK(server.get_number_of_connections() == 0);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Failing sink aborts download")
+{
+    sink.fail_ = true;
+    CHECK_FALSE(fetcher.fetch(server.uri("/image"), sink, result));
+    CHECK(result.error_ == Converter::FetchError::WRITE_FAILED);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Protocols other than HTTP are not supported")
+{
+    CHECK_FALSE(fetcher.fetch("file:///etc/passwd", sink, result));
+    CHECK(result.error_ == Converter::FetchError::UNSUPPORTED_PROTOCOL);
+    CHECK(sink.data_.empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Refused connection is reported")
+{
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    REQUIRE(fd >= 0);
+
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+
+    REQUIRE(bind(fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) == 0);
+    REQUIRE(getsockname(fd, reinterpret_cast<struct sockaddr *>(&addr), &len) == 0);
+    close(fd);
+
+    CHECK_FALSE(fetcher.fetch("http://127.0.0.1:" + std::to_string(ntohs(addr.sin_port)) + "/",
+                              sink, result));
+    CHECK(result.error_ == Converter::FetchError::CONNECT_FAILED);
+}
+
+TEST_CASE("Downloads fail if fetcher has not been initialized")
+{
+    Converter::Fetcher fetcher;
+    BufferSink sink;
+    Converter::FetchResult result;
+
+    CHECK_FALSE(fetcher.fetch("http://127.0.0.1/", sink, result));
+    CHECK(result.error_ == Converter::FetchError::INTERNAL_ERROR);
+}
+
+TEST_CASE("Error classes have names")
+{
+    CHECK(std::string(Converter::fetch_error_to_string(Converter::FetchError::OK)) == "OK");
+    CHECK(std::string(Converter::fetch_error_to_string(Converter::FetchError::TOO_LARGE)) == "TOO_LARGE");
+    CHECK(std::string(Converter::fetch_error_to_string(Converter::FetchError::INTERNAL_ERROR)) == "INTERNAL_ERROR");
+}
+
+TEST_SUITE_END();
+
+/*!@}*/
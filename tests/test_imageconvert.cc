@@ -0,0 +1,631 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <jpeglib.h>
+
+#include "imageconvert.hh"
+#include "resample.hh"
+#include "quantize.hh"
+
+/*!
+ * \addtogroup image_conversion_tests Unit tests
+ * \ingroup image_conversion
+ *
+ * In-process image conversion unit tests.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("Image conversion");
+
+static void fill(Converter::RGBAImage &image,
+                 unsigned int width, unsigned int height,
+                 uint8_t r, uint8_t g, uint8_t b, uint8_t a)
+{
+    image.set_size(width, height);
+
+    for(size_t i = 0; i < image.pixels_.size(); i += 4)
+    {
+        image.pixels_[i + 0] = r;
+        image.pixels_[i + 1] = g;
+        image.pixels_[i + 2] = b;
+        image.pixels_[i + 3] = a;
+    }
+}
+
+static std::vector<uint8_t> mk_jpeg(unsigned int width, unsigned int height,
+                                    uint8_t r, uint8_t g, uint8_t b)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    unsigned char *buffer = nullptr;
+    unsigned long size = 0;
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_mem_dest(&cinfo, &buffer, &size);
+
+    cinfo.image_width = width;
+    cinfo.image_height = height;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 95, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+
+    std::vector<uint8_t> row(width * 3);
+    for(unsigned int x = 0; x < width; ++x)
+    {
+        row[x * 3 + 0] = r;
+        row[x * 3 + 1] = g;
+        row[x * 3 + 2] = b;
+    }
+
+    while(cinfo.next_scanline < cinfo.image_height)
+    {
+        JSAMPROW p = row.data();
+        jpeg_write_scanlines(&cinfo, &p, 1);
+    }
+
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+
+    std::vector<uint8_t> result(buffer, buffer + size);
+    free(buffer);
+
+    return result;
+}
+
+TEST_CASE("Parse output format dimensions")
+{
+    unsigned int w = 0;
+    unsigned int h = 0;
+
+    CHECK(Converter::parse_dimensions("120x120", w, h));
+    CHECK(w == 120);
+    CHECK(h == 120);
+
+    CHECK(Converter::parse_dimensions("400x300", w, h));
+    CHECK(w == 400);
+    CHECK(h == 300);
+
+    CHECK_FALSE(Converter::parse_dimensions("", w, h));
+    CHECK_FALSE(Converter::parse_dimensions("120", w, h));
+    CHECK_FALSE(Converter::parse_dimensions("120x", w, h));
+    CHECK_FALSE(Converter::parse_dimensions("x120", w, h));
+    CHECK_FALSE(Converter::parse_dimensions("0x120", w, h));
+    CHECK_FALSE(Converter::parse_dimensions("120x120!", w, h));
+}
+
+TEST_CASE("Unknown input format is reported as unsupported")
+{
+    static const uint8_t gif[] = "GIF89a\x01\x00\x01\x00";
+    Converter::RGBAImage image;
+
+    CHECK(Converter::decode_image(gif, sizeof(gif), image) ==
+          Converter::ImageResult::UNSUPPORTED);
+    CHECK(image.empty());
+}
+
+TEST_CASE("JPEG input is decoded to RGBA")
+{
+    const auto jpeg(mk_jpeg(64, 32, 200, 100, 50));
+    Converter::RGBAImage image;
+
+    REQUIRE(Converter::decode_image(jpeg.data(), jpeg.size(), image) ==
+            Converter::ImageResult::OK);
+    CHECK(image.width_ == 64);
+    CHECK(image.height_ == 32);
+
+    const uint8_t *p = image.row(16) + 32 * 4;
+    CHECK(std::abs(int(p[0]) - 200) <= 2);
+    CHECK(std::abs(int(p[1]) - 100) <= 2);
+    CHECK(std::abs(int(p[2]) - 50) <= 2);
+    CHECK(p[3] == 255);
+}
+
+TEST_CASE("Large JPEG input is reduced while decoding")
+{
+    const auto jpeg(mk_jpeg(800, 400, 30, 160, 90));
+    Converter::RGBAImage image;
+
+    /* 1/8 would be 100x50, too small for the fitted size of 120x60 */
+    REQUIRE(Converter::decode_image(jpeg.data(), jpeg.size(), image, 120, 120) ==
+            Converter::ImageResult::OK);
+    CHECK(image.width_ == 200);
+    CHECK(image.height_ == 100);
+
+    const uint8_t *p = image.row(50) + 100 * 4;
+    CHECK(std::abs(int(p[0]) - 30) <= 2);
+    CHECK(std::abs(int(p[1]) - 160) <= 2);
+    CHECK(std::abs(int(p[2]) - 90) <= 2);
+
+    REQUIRE(Converter::decode_image(jpeg.data(), jpeg.size(), image, 100, 50) ==
+            Converter::ImageResult::OK);
+    CHECK(image.width_ == 100);
+    CHECK(image.height_ == 50);
+}
+
+TEST_CASE("JPEG input is decoded at full size if bounding box is large")
+{
+    const auto jpeg(mk_jpeg(64, 32, 200, 100, 50));
+    Converter::RGBAImage image;
+
+    REQUIRE(Converter::decode_image(jpeg.data(), jpeg.size(), image, 120, 120) ==
+            Converter::ImageResult::OK);
+    CHECK(image.width_ == 64);
+    CHECK(image.height_ == 32);
+
+    REQUIRE(Converter::decode_image(jpeg.data(), jpeg.size(), image, 40, 40) ==
+            Converter::ImageResult::OK);
+    CHECK(image.width_ == 64);
+    CHECK(image.height_ == 32);
+}
+
+TEST_CASE("Downscaling keeps aspect ratio and color")
+{
+    Converter::RGBAImage src;
+    fill(src, 600, 300, 10, 20, 30, 255);
+
+    Converter::RGBAImage dest;
+    Converter::resize_to_fit(src, 120, 120, dest);
+
+    CHECK(dest.width_ == 120);
+    CHECK(dest.height_ == 60);
+
+    for(size_t i = 0; i < dest.pixels_.size(); i += 4)
+    {
+        REQUIRE(dest.pixels_[i + 0] == 10);
+        REQUIRE(dest.pixels_[i + 1] == 20);
+        REQUIRE(dest.pixels_[i + 2] == 30);
+        REQUIRE(dest.pixels_[i + 3] == 255);
+    }
+}
+
+TEST_CASE("Small images are enlarged to fit bounding box")
+{
+    Converter::RGBAImage src;
+    fill(src, 30, 60, 1, 2, 3, 255);
+
+    Converter::RGBAImage dest;
+    Converter::resize_to_fit(src, 120, 120, dest);
+
+    CHECK(dest.width_ == 60);
+    CHECK(dest.height_ == 120);
+    CHECK(dest.row(119)[59 * 4 + 2] == 3);
+}
+
+TEST_CASE("Downscaling averages over covered area")
+{
+    Converter::RGBAImage src;
+    fill(src, 2, 1, 0, 0, 0, 255);
+    src.pixels_[4] = 200;
+    src.pixels_[5] = 200;
+    src.pixels_[6] = 200;
+
+    Converter::RGBAImage dest;
+    Converter::resize_to_fit(src, 1, 1, dest);
+
+    REQUIRE(dest.width_ == 1);
+    REQUIRE(dest.height_ == 1);
+    CHECK(dest.pixels_[0] == 100);
+    CHECK(dest.pixels_[3] == 255);
+}
+
+TEST_CASE("Transparent pixels do not bleed into opaque neighbors")
+{
+    Converter::RGBAImage src;
+    fill(src, 2, 1, 0, 0, 0, 0);
+    src.pixels_[4] = 200;
+    src.pixels_[5] = 100;
+    src.pixels_[6] = 50;
+    src.pixels_[7] = 255;
+
+    Converter::RGBAImage dest;
+    Converter::resize_to_fit(src, 1, 1, dest);
+
+    REQUIRE(dest.width_ == 1);
+    CHECK(dest.pixels_[0] == 200);
+    CHECK(dest.pixels_[1] == 100);
+    CHECK(dest.pixels_[2] == 50);
+    CHECK(dest.pixels_[3] == 128);
+}
+
+TEST_CASE("Large reductions preserve uniform color")
+{
+    Converter::RGBAImage src;
+    fill(src, 3001, 1999, 250, 5, 128, 255);
+
+    Converter::RGBAImage dest;
+    Converter::resize_to_fit(src, 120, 120, dest);
+
+    CHECK(dest.width_ == 120);
+    CHECK(dest.height_ == 80);
+
+    for(size_t i = 0; i < dest.pixels_.size(); i += 4)
+    {
+        REQUIRE(dest.pixels_[i + 0] == 250);
+        REQUIRE(dest.pixels_[i + 1] == 5);
+        REQUIRE(dest.pixels_[i + 2] == 128);
+        REQUIRE(dest.pixels_[i + 3] == 255);
+    }
+}
+
+TEST_CASE("SIMD and scalar resampling kernels produce same output")
+{
+    Converter::RGBAImage src;
+    src.set_size(997, 641);
+
+    for(unsigned int y = 0; y < src.height_; ++y)
+    {
+        uint8_t *p = src.row(y);
+
+        for(unsigned int x = 0; x < src.width_; ++x)
+        {
+            p[0] = uint8_t(x * 3 + y);
+            p[1] = uint8_t((x ^ y) * 5);
+            p[2] = uint8_t(y * 7);
+            p[3] = uint8_t(x < 100 ? x * 2 : 255);
+            p += 4;
+        }
+    }
+
+    for(const auto size : { 120U, 37U, 1500U, })
+    {
+        unsigned int w;
+        unsigned int h;
+        Converter::fit_dimensions(src.width_, src.height_, size, size, w, h);
+
+        Converter::RGBAImage scalar;
+        Converter::RGBAImage simd;
+        Converter::resample(src, w, h, scalar, Converter::ResampleKernel::SCALAR);
+        Converter::resample(src, w, h, simd, Converter::ResampleKernel::SIMD);
+
+        REQUIRE(scalar.width_ == w);
+        REQUIRE(scalar.height_ == h);
+        REQUIRE(simd.width_ == w);
+        REQUIRE(simd.height_ == h);
+
+        for(size_t i = 0; i < scalar.pixels_.size(); ++i)
+            REQUIRE(std::abs(int(scalar.pixels_[i]) - int(simd.pixels_[i])) <= 1);
+    }
+}
+
+TEST_CASE("Renditions are derived from nearest larger rendition")
+{
+    const std::vector<std::pair<unsigned int, unsigned int>> boxes
+    {
+        {120, 120}, {400, 400}, {200, 50}, {50, 200}, {60, 60},
+    };
+
+    const auto steps(Converter::plan_renditions(boxes));
+
+    REQUIRE(steps.size() == 5);
+    CHECK(steps[0].box_index_ == 1);
+    CHECK(steps[0].source_step_ == -1);
+    CHECK(steps[1].box_index_ == 0);
+    CHECK(steps[1].source_step_ == 0);
+    CHECK(steps[2].box_index_ == 2);
+    CHECK(steps[2].source_step_ == 0);
+    CHECK(steps[3].box_index_ == 3);
+    CHECK(steps[3].source_step_ == 0);
+    CHECK(steps[4].box_index_ == 4);
+    CHECK(steps[4].source_step_ == 1);
+}
+
+TEST_CASE("Rendition derived from larger rendition has size fitted from original")
+{
+    Converter::RGBAImage src;
+    fill(src, 1001, 667, 90, 60, 30, 255);
+
+    Converter::RGBAImage level;
+    Converter::resize_to_fit(src, 360, 360, level);
+    CHECK(level.width_ == 360);
+    CHECK(level.height_ == 240);
+
+    Converter::RGBAImage direct;
+    Converter::RGBAImage derived;
+    Converter::resize_to_fit(src, 121, 121, direct);
+    Converter::resize_to_fit(level, src.width_, src.height_, 121, 121, derived);
+
+    CHECK(derived.width_ == direct.width_);
+    CHECK(derived.height_ == direct.height_);
+
+    const uint8_t *p = derived.row(derived.height_ / 2) + derived.width_ / 2 * 4;
+    CHECK(std::abs(int(p[0]) - 90) <= 1);
+    CHECK(std::abs(int(p[1]) - 60) <= 1);
+    CHECK(std::abs(int(p[2]) - 30) <= 1);
+    CHECK(p[3] == 255);
+}
+
+TEST_CASE("Images with few colors are quantized losslessly")
+{
+    Converter::RGBAImage src;
+    fill(src, 4, 4, 255, 0, 0, 255);
+    src.pixels_[0] = 0;
+    src.pixels_[1] = 255;
+
+    Converter::IndexedImage dest;
+    Converter::quantize(src, 255, dest);
+
+    CHECK(dest.palette_.size() == 2);
+    REQUIRE(dest.indices_.size() == 16);
+
+    const auto &first(dest.palette_[dest.indices_[0]]);
+    CHECK(first[0] == 0);
+    CHECK(first[1] == 255);
+    CHECK(first[2] == 0);
+
+    const auto &last(dest.palette_[dest.indices_[15]]);
+    CHECK(last[0] == 255);
+    CHECK(last[1] == 0);
+    CHECK(last[2] == 0);
+}
+
+TEST_CASE("Images with many colors are reduced to palette size")
+{
+    Converter::RGBAImage src;
+    src.set_size(64, 64);
+
+    for(size_t i = 0; i < src.pixels_.size(); i += 4)
+    {
+        src.pixels_[i + 0] = uint8_t(i * 7);
+        src.pixels_[i + 1] = uint8_t(i * 13);
+        src.pixels_[i + 2] = uint8_t(i / 16);
+        src.pixels_[i + 3] = 255;
+    }
+
+    Converter::IndexedImage dest;
+    Converter::quantize(src, 255, dest);
+
+    CHECK(dest.palette_.size() == 255);
+    REQUIRE(dest.indices_.size() == 64 * 64);
+
+    for(const auto idx : dest.indices_)
+        REQUIRE(idx < dest.palette_.size());
+}
+
+TEST_CASE("Transparent pixels are mapped to transparent palette entry")
+{
+    Converter::RGBAImage src;
+    fill(src, 2, 2, 10, 10, 10, 255);
+    src.pixels_[3] = 0;
+
+    Converter::IndexedImage dest;
+    Converter::quantize(src, 255, dest);
+
+    REQUIRE(dest.palette_.size() == 2);
+    CHECK(dest.palette_[dest.indices_[0]][3] == 0);
+    CHECK(dest.palette_[dest.indices_[1]][3] == 255);
+}
+
+static void fill_gradient(Converter::RGBAImage &image,
+                          unsigned int width, unsigned int height)
+{
+    image.set_size(width, height);
+
+    for(unsigned int y = 0; y < height; ++y)
+    {
+        uint8_t *p = image.row(y);
+
+        for(unsigned int x = 0; x < width; ++x)
+        {
+            p[0] = uint8_t(255 * x / (width - 1));
+            p[1] = uint8_t(255 * y / (height - 1));
+            p[2] = 128;
+            p[3] = 255;
+            p += 4;
+        }
+    }
+}
+
+static unsigned int distance(const uint8_t *pixel,
+                             const std::array<uint8_t, 4> &entry)
+{
+    unsigned int result = 0;
+
+    for(unsigned int ch = 0; ch < 3; ++ch)
+        result += (int(pixel[ch]) - entry[ch]) * (int(pixel[ch]) - entry[ch]);
+
+    return result;
+}
+
+TEST_CASE("Dithering preserves average color of gradient")
+{
+    Converter::RGBAImage src;
+    fill_gradient(src, 120, 120);
+
+    Converter::IndexedImage dest;
+    Converter::quantize(src, 16, dest, Converter::Dithering::FLOYD_STEINBERG);
+
+    REQUIRE(dest.palette_.size() <= 16);
+    REQUIRE(dest.indices_.size() == 120 * 120);
+
+    for(unsigned int ch = 0; ch < 3; ++ch)
+    {
+        double sum_src = 0.0;
+        double sum_dest = 0.0;
+
+        for(size_t i = 0; i < dest.indices_.size(); ++i)
+        {
+            sum_src += src.pixels_[i * 4 + ch];
+            sum_dest += dest.palette_[dest.indices_[i]][ch];
+        }
+
+        CHECK(std::abs(sum_src - sum_dest) / dest.indices_.size() < 2.0);
+    }
+}
+
+TEST_CASE("Pixels are mapped to close palette entry without dithering")
+{
+    Converter::RGBAImage src;
+    fill_gradient(src, 64, 48);
+
+    Converter::IndexedImage dest;
+    Converter::quantize(src, 8, dest, Converter::Dithering::NONE);
+
+    REQUIRE(dest.palette_.size() <= 8);
+    REQUIRE(dest.indices_.size() == 64 * 48);
+
+    for(size_t i = 0; i < dest.indices_.size(); ++i)
+    {
+        const uint8_t *const pixel = &src.pixels_[i * 4];
+        const unsigned int chosen = distance(pixel, dest.palette_[dest.indices_[i]]);
+        unsigned int best = chosen;
+
+        for(const auto &entry : dest.palette_)
+            best = std::min(best, distance(pixel, entry));
+
+        /* colors are looked up by their 5 bit histogram bin, so the chosen
+         * entry may be off by up to the bin diagonal */
+        REQUIRE(std::sqrt(double(chosen)) <= std::sqrt(double(best)) + 14.0);
+    }
+}
+
+TEST_CASE("Encoded PNG decodes to same pixels")
+{
+    Converter::RGBAImage src;
+    fill(src, 3, 2, 40, 80, 120, 255);
+    src.pixels_[3] = 0;
+
+    Converter::IndexedImage indexed;
+    Converter::quantize(src, 255, indexed);
+
+    std::vector<uint8_t> png;
+    REQUIRE(Converter::encode_png(indexed, png) == Converter::ImageResult::OK);
+    REQUIRE(png.size() > 8);
+    CHECK(png[1] == 'P');
+
+    Converter::RGBAImage decoded;
+    REQUIRE(Converter::decode_image(png.data(), png.size(), decoded) ==
+            Converter::ImageResult::OK);
+    CHECK(decoded.width_ == 3);
+    CHECK(decoded.height_ == 2);
+    CHECK(decoded.pixels_[3] == 0);
+    CHECK(decoded.pixels_[4] == 40);
+    CHECK(decoded.pixels_[5] == 80);
+    CHECK(decoded.pixels_[6] == 120);
+    CHECK(decoded.pixels_[7] == 255);
+}
+
+TEST_CASE("Palette PNG of fitting size is usable without conversion")
+{
+    Converter::RGBAImage src;
+    fill(src, 120, 80, 200, 100, 50, 255);
+
+    Converter::IndexedImage indexed;
+    Converter::quantize(src, 255, indexed);
+
+    std::vector<uint8_t> png;
+    REQUIRE(Converter::encode_png(indexed, png) == Converter::ImageResult::OK);
+
+    Converter::PNGInfo info;
+    REQUIRE(Converter::inspect_png(png.data(), png.size(), info) ==
+            Converter::ImageResult::OK);
+    CHECK(info.width_ == 120);
+    CHECK(info.height_ == 80);
+    CHECK(info.color_type_ == 3);
+    CHECK(info.palette_entries_ == 1);
+    CHECK_FALSE(info.is_interlaced_);
+
+    CHECK(Converter::is_png_usable_as_is(info, 120, 120, 255));
+    CHECK(Converter::is_png_usable_as_is(info, 150, 80, 255));
+    CHECK_FALSE(Converter::is_png_usable_as_is(info, 100, 100, 255));
+    CHECK_FALSE(Converter::is_png_usable_as_is(info, 240, 240, 255));
+
+    /* same thing, but not a palette image (checksums are not verified) */
+    png[8 + 8 + 9] = 6;
+    REQUIRE(Converter::inspect_png(png.data(), png.size(), info) ==
+            Converter::ImageResult::OK);
+    CHECK_FALSE(Converter::is_png_usable_as_is(info, 120, 120, 255));
+}
+
+TEST_CASE("Broken or non-PNG data is not usable without conversion")
+{
+    const auto jpeg(mk_jpeg(16, 16, 1, 2, 3));
+    Converter::PNGInfo info;
+
+    CHECK(Converter::inspect_png(jpeg.data(), jpeg.size(), info) ==
+          Converter::ImageResult::UNSUPPORTED);
+
+    Converter::RGBAImage src;
+    fill(src, 16, 16, 1, 2, 3, 255);
+
+    Converter::IndexedImage indexed;
+    Converter::quantize(src, 255, indexed);
+
+    std::vector<uint8_t> png;
+    REQUIRE(Converter::encode_png(indexed, png) == Converter::ImageResult::OK);
+
+    /* cut off IEND chunk */
+    CHECK(Converter::inspect_png(png.data(), png.size() - 12, info) ==
+          Converter::ImageResult::INPUT_ERROR);
+
+    /* chunk length beyond end of data */
+    png[8 + 8 + 13 + 4] = 0x7f;
+    CHECK(Converter::inspect_png(png.data(), png.size(), info) ==
+          Converter::ImageResult::INPUT_ERROR);
+}
+
+TEST_CASE("Encoded PNG is a plain 8 bit palette image")
+{
+    Converter::RGBAImage src;
+    fill(src, 4, 4, 200, 100, 50, 255);
+    src.pixels_[7] = 0;
+
+    Converter::IndexedImage indexed;
+    Converter::quantize(src, 255, indexed);
+
+    std::vector<uint8_t> png;
+    REQUIRE(Converter::encode_png(indexed, png) == Converter::ImageResult::OK);
+    REQUIRE(png.size() > 8 + 8 + 13);
+
+    std::vector<std::string> chunks;
+
+    for(size_t pos = 8; pos + 8 <= png.size();)
+    {
+        const size_t length = (size_t(png[pos]) << 24) | (png[pos + 1] << 16) |
+                              (png[pos + 2] << 8) | png[pos + 3];
+        chunks.emplace_back(reinterpret_cast<const char *>(&png[pos + 4]), 4);
+        pos += 12 + length;
+    }
+
+    const std::vector<std::string> expected{"IHDR", "PLTE", "tRNS", "IDAT", "IEND"};
+    CHECK(chunks == expected);
+
+    /* bit depth and color type in IHDR */
+    CHECK(png[8 + 8 + 8] == 8);
+    CHECK(png[8 + 8 + 9] == 3);
+}
+
+TEST_SUITE_END();
+
+/*!@}*/
@@ -0,0 +1,155 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include "objectcache.hh"
+
+/*!
+ * \addtogroup object_cache_tests Unit tests
+ * \ingroup cache
+ *
+ * Object memory cache unit tests.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("Object Memory Cache");
+
+static std::shared_ptr<const ArtCache::ObjectData> mk_data(size_t length)
+{
+    const std::vector<uint8_t> buffer(length, 0x5a);
+    return std::make_shared<ArtCache::BufferedObjectData>(buffer.data(),
+                                                          buffer.size());
+}
+
+TEST_CASE("Disabled cache stores nothing")
+{
+    ArtCache::ObjectMemoryCache cache(0);
+
+    CHECK_FALSE(cache.is_enabled());
+    CHECK_FALSE(cache.is_cacheable(1));
+
+    cache.insert("a", mk_data(10));
+    CHECK(cache.lookup("a") == nullptr);
+    CHECK(cache.get_number_of_objects() == 0);
+    CHECK(cache.get_misses() == 0);
+}
+
+TEST_CASE("Lookups are counted as hits and misses")
+{
+    ArtCache::ObjectMemoryCache cache(100);
+
+    CHECK(cache.lookup("a") == nullptr);
+    cache.insert("a", mk_data(10));
+
+    const auto data(cache.lookup("a"));
+    REQUIRE(data != nullptr);
+    CHECK(data->size() == 10);
+    CHECK(data->data()[9] == 0x5a);
+
+    CHECK(cache.get_hits() == 1);
+    CHECK(cache.get_misses() == 1);
+    CHECK(cache.get_bytes_used() == 10);
+}
+
+TEST_CASE("Objects larger than budget are not cached")
+{
+    ArtCache::ObjectMemoryCache cache(100);
+
+    CHECK(cache.is_cacheable(100));
+    CHECK_FALSE(cache.is_cacheable(101));
+
+    cache.insert("a", mk_data(101));
+    CHECK(cache.get_number_of_objects() == 0);
+    CHECK(cache.get_bytes_used() == 0);
+}
+
+TEST_CASE("Least recently used objects are evicted to stay within budget")
+{
+    ArtCache::ObjectMemoryCache cache(100);
+
+    cache.insert("a", mk_data(40));
+    cache.insert("b", mk_data(40));
+
+    /* make "a" the most recently used object */
+    CHECK(cache.lookup("a") != nullptr);
+
+    cache.insert("c", mk_data(40));
+
+    CHECK(cache.get_number_of_objects() == 2);
+    CHECK(cache.get_bytes_used() == 80);
+    CHECK(cache.lookup("a") != nullptr);
+    CHECK(cache.lookup("b") == nullptr);
+    CHECK(cache.lookup("c") != nullptr);
+}
+
+TEST_CASE("Evicted data stays valid while referenced")
+{
+    ArtCache::ObjectMemoryCache cache(50);
+
+    cache.insert("a", mk_data(50));
+    const auto data(cache.lookup("a"));
+    REQUIRE(data != nullptr);
+
+    cache.insert("b", mk_data(50));
+    CHECK(cache.lookup("a") == nullptr);
+    CHECK(data->size() == 50);
+    CHECK(data->data()[0] == 0x5a);
+}
+
+TEST_CASE("Inserting known object does not account for it twice")
+{
+    ArtCache::ObjectMemoryCache cache(100);
+
+    cache.insert("a", mk_data(30));
+    cache.insert("a", mk_data(30));
+
+    CHECK(cache.get_number_of_objects() == 1);
+    CHECK(cache.get_bytes_used() == 30);
+}
+
+TEST_CASE("Removed objects are not found anymore")
+{
+    ArtCache::ObjectMemoryCache cache(100);
+
+    cache.insert("a", mk_data(30));
+    cache.insert("b", mk_data(20));
+
+    cache.remove("a");
+    CHECK(cache.lookup("a") == nullptr);
+    CHECK(cache.get_bytes_used() == 20);
+
+    /* removing unknown objects is harmless */
+    cache.remove("a");
+
+    cache.clear();
+    CHECK(cache.lookup("b") == nullptr);
+    CHECK(cache.get_number_of_objects() == 0);
+    CHECK(cache.get_bytes_used() == 0);
+}
+
+TEST_SUITE_END();
+
+/*!@}*/
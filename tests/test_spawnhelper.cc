@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include <chrono>
+#include <thread>
+#include <cerrno>
+#include <csignal>
+
+#include "spawnhelper.hh"
+
+/*!
+ * \addtogroup spawnhelper_tests Unit tests
+ *
+ * Unit tests for the converter helper process.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("Converter helper process");
+
+class Fixture
+{
+  protected:
+    Converter::SpawnHelper helper;
+
+  public:
+    explicit Fixture()
+    {
+        REQUIRE(helper.start());
+        REQUIRE(helper.is_running());
+    }
+};
+
+TEST_CASE_FIXTURE(Fixture, "Successful command is reported as such")
+{
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.run({"true"}, result));
+    CHECK(result.succeeded());
+    CHECK(result.error_ == 0);
+    CHECK(result.exit_code_ == 0);
+    CHECK(result.signal_ == 0);
+    CHECK(result.run_us_ >= result.spawn_us_);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Exit code of failing command is reported")
+{
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.run({"sh", "-c", "exit 3"}, result));
+    CHECK_FALSE(result.succeeded());
+    CHECK(result.exit_code_ == 3);
+    CHECK(result.signal_ == 0);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Arguments are passed without shell interpretation")
+{
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.run({"sh", "-c", "test \"$0\" = \"a 'b' (c)\"", "a 'b' (c)"}, result));
+    CHECK(result.succeeded());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Command killed by signal is reported")
+{
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.run({"sh", "-c", "kill -TERM $$"}, result));
+    CHECK_FALSE(result.succeeded());
+    CHECK(result.exit_code_ == -1);
+    CHECK(result.signal_ == SIGTERM);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Unknown command cannot be started")
+{
+    Converter::SpawnResult result;
+
+    CHECK_FALSE(helper.run({"/nonexistent/command"}, result));
+    CHECK(result.error_ == ENOENT);
+    CHECK_FALSE(result.succeeded());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Commands from several threads run concurrently")
+{
+    static constexpr size_t number_of_threads = 4;
+    bool succeeded[number_of_threads] {};
+    std::vector<std::thread> threads;
+
+    const auto start(std::chrono::steady_clock::now());
+
+    for(size_t i = 0; i < number_of_threads; ++i)
+        threads.emplace_back([this, &succeeded, i] ()
+                             {
+                                 Converter::SpawnResult result;
+                                 succeeded[i] = helper.run({"sleep", "0.3"}, result) &&
+                                                result.succeeded();
+                             });
+
+    for(auto &t : threads)
+        t.join();
+
+    const auto elapsed(std::chrono::steady_clock::now() - start);
+
+    for(const bool s : succeeded)
+        CHECK(s);
+
+    CHECK(elapsed < std::chrono::milliseconds(300 * number_of_threads - 100));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Command exceeding its deadline is terminated")
+{
+    Converter::SpawnResult result;
+
+    const auto start(std::chrono::steady_clock::now());
+    REQUIRE(helper.run({"sleep", "10"}, result, 200));
+    const auto elapsed(std::chrono::steady_clock::now() - start);
+
+    CHECK_FALSE(result.succeeded());
+    CHECK(result.timed_out_);
+    CHECK_FALSE(result.canceled_);
+    CHECK(result.signal_ == SIGTERM);
+    CHECK(elapsed >= std::chrono::milliseconds(200));
+    CHECK(elapsed < std::chrono::seconds(2));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Command finishing before its deadline is not affected")
+{
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.run({"sh", "-c", "exit 0"}, result, 5000));
+    CHECK(result.succeeded());
+    CHECK_FALSE(result.timed_out_);
+}
+
+TEST_CASE_FIXTURE(Fixture, "Command ignoring SIGTERM is killed after grace period")
+{
+    Converter::SpawnResult result;
+
+    const auto start(std::chrono::steady_clock::now());
+    REQUIRE(helper.run({"sh", "-c", "trap '' TERM; while true; do sleep 0.1; done"},
+                       result, 100));
+    const auto elapsed(std::chrono::steady_clock::now() - start);
+
+    CHECK(result.timed_out_);
+    CHECK(result.signal_ == SIGKILL);
+    CHECK(elapsed < std::chrono::seconds(5));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Running command can be canceled from another thread")
+{
+    Converter::SpawnCancel cancel;
+    Converter::SpawnResult result;
+    bool was_run = false;
+
+    std::thread t([this, &cancel, &result, &was_run] ()
+                  {
+                      was_run = helper.run({"sleep", "10"}, result, 0, &cancel);
+                  });
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    cancel.trigger();
+    t.join();
+
+    CHECK(was_run);
+    CHECK(result.canceled_);
+    CHECK_FALSE(result.timed_out_);
+    CHECK_FALSE(result.succeeded());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Command is not started if already canceled")
+{
+    Converter::SpawnCancel cancel;
+    Converter::SpawnResult result;
+
+    cancel.trigger();
+    CHECK(cancel.is_triggered());
+    CHECK_FALSE(helper.run({"true"}, result, 0, &cancel));
+    CHECK(result.canceled_);
+    CHECK(result.error_ == ECANCELED);
+}
+
+TEST_CASE("Commands are run directly if helper is not running")
+{
+    Converter::SpawnHelper helper;
+    Converter::SpawnResult result;
+
+    REQUIRE_FALSE(helper.is_running());
+    REQUIRE(helper.run({"sh", "-c", "exit 5"}, result));
+    CHECK(result.exit_code_ == 5);
+}
+
+TEST_CASE("Commands are run directly after helper has been stopped")
+{
+    Converter::SpawnHelper helper;
+    Converter::SpawnResult result;
+
+    REQUIRE(helper.start());
+    helper.stop();
+    CHECK_FALSE(helper.is_running());
+
+    REQUIRE(helper.run({"true"}, result));
+    CHECK(result.succeeded());
+}
+
+TEST_CASE("Deadline is enforced when running commands directly")
+{
+    Converter::SpawnHelper helper;
+    Converter::SpawnResult result;
+
+    REQUIRE_FALSE(helper.is_running());
+    REQUIRE(helper.run({"sleep", "10"}, result, 100));
+    CHECK(result.timed_out_);
+    CHECK(result.signal_ == SIGTERM);
+}
+
+TEST_SUITE_END();
+
+/*!@}*/
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2026  T+A elektroakustik GmbH & Co. KG
+ *
+ * This file is part of TACAMan.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston,
+ * MA  02110-1301, USA.
+ */
+
+#if HAVE_CONFIG_H
+#include <config.h>
+#endif /* HAVE_CONFIG_H */
+
+#include <doctest.h>
+
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <cstdlib>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "stagedfile.hh"
+
+/*!
+ * \addtogroup stagedfile_tests Unit tests
+ *
+ * Unit tests for files which appear only once complete.
+ */
+/*!@{*/
+
+TEST_SUITE_BEGIN("Staged files");
+
+class Fixture
+{
+  protected:
+    std::string dir;
+
+  public:
+    explicit Fixture()
+    {
+        char name[] = "test_stagedfile.XXXXXX";
+        REQUIRE(mkdtemp(name) != nullptr);
+        dir = name;
+    }
+
+    ~Fixture()
+    {
+        for(const auto &name : list_directory())
+            unlink((dir + '/' + name).c_str());
+
+        rmdir(dir.c_str());
+    }
+
+    std::vector<std::string> list_directory() const
+    {
+        std::vector<std::string> result;
+        DIR *d = opendir(dir.c_str());
+
+        if(d == nullptr)
+            return result;
+
+        while(const struct dirent *de = readdir(d))
+        {
+            const std::string name(de->d_name);
+
+            if(name != "." && name != "..")
+                result.push_back(name);
+        }
+
+        closedir(d);
+
+        return result;
+    }
+
+    std::string read_file(const std::string &name) const
+    {
+        std::ifstream in(dir + '/' + name, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(in),
+                           std::istreambuf_iterator<char>());
+    }
+};
+
+TEST_CASE_FIXTURE(Fixture, "Staged file is not visible before it is linked")
+{
+    Converter::StagedFile file;
+
+    REQUIRE(file.create(dir));
+    CHECK(file.is_open());
+    REQUIRE(file.write(reinterpret_cast<const uint8_t *>("abc"), 3));
+
+    if(file.is_anonymous())
+        CHECK(list_directory().empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Linked file has the data written to it")
+{
+    Converter::StagedFile file;
+    const std::vector<uint8_t> data(300000, 0xa5);
+
+    REQUIRE(file.create(dir));
+    REQUIRE(file.write(data.data(), 1000));
+    REQUIRE(file.write(data.data() + 1000, data.size() - 1000));
+    REQUIRE(file.link_to(dir + "/result"));
+    CHECK_FALSE(file.is_open());
+
+    const auto names(list_directory());
+    REQUIRE(names.size() == 1);
+    CHECK(names.front() == "result");
+    CHECK(read_file("result") == std::string(data.begin(), data.end()));
+}
+
+TEST_CASE_FIXTURE(Fixture, "Discarded file leaves nothing behind")
+{
+    {
+        Converter::StagedFile file;
+
+        REQUIRE(file.create(dir));
+        REQUIRE(file.write(reinterpret_cast<const uint8_t *>("abc"), 3));
+        file.discard();
+        CHECK_FALSE(file.is_open());
+    }
+
+    {
+        Converter::StagedFile file;
+
+        REQUIRE(file.create(dir));
+        REQUIRE(file.write(reinterpret_cast<const uint8_t *>("def"), 3));
+    }
+
+    CHECK(list_directory().empty());
+}
+
+TEST_CASE_FIXTURE(Fixture, "Staged file can be created again after linking")
+{
+    Converter::StagedFile file;
+
+    REQUIRE(file.create(dir));
+    REQUIRE(file.write(reinterpret_cast<const uint8_t *>("first"), 5));
+    REQUIRE(file.link_to(dir + "/a"));
+
+    REQUIRE(file.create(dir));
+    REQUIRE(file.write(reinterpret_cast<const uint8_t *>("second"), 6));
+    REQUIRE(file.link_to(dir + "/b"));
+
+    CHECK(read_file("a") == "first");
+    CHECK(read_file("b") == "second");
+}
+
+TEST_SUITE_END();
+
+/*!@}*/